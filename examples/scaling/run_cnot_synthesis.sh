@@ -0,0 +1,50 @@
+#!/bin/bash
+
+# Compares the linear reversible synthesizers of the CNOT resynthesis pass
+# Usage: ./run_cnot_synthesis.sh [QUBITS ...] (default: 16 32 64 128 256 512)
+# Set STAQ to point to the staq executable and SYNTHESIZERS to the
+# synthesizers to compare.
+# Each circuit is n^2 random CNOT gates on n qubits, which resynthesize as a
+# single random linear reversible block. Times include parsing the circuit.
+
+STAQ=${STAQ:-../../build/staq}
+SYNTHESIZERS=${SYNTHESIZERS:-"gauss-jordan pmh"}
+SIZES=${@:-"16 32 64 128 256 512"}
+TIMEFORMAT=%R
+
+tmp=/tmp/staq_cnot_synthesis.$$
+mkdir -p $tmp
+
+printf "%8s%10s" "qubits" "CX in"
+for synthesizer in $SYNTHESIZERS; do
+    printf "%24s" "$synthesizer (CX/s)"
+done
+printf "\n"
+
+for size in $SIZES; do
+    awk -v n=$size 'BEGIN {
+        srand(1)
+        print "OPENQASM 2.0;\ninclude \"qelib1.inc\";"
+        print "qreg q[" n "];"
+        for (i = 0; i < n * n; i++) {
+            a = int(rand() * n)
+            b = (a + 1 + int(rand() * (n - 1))) % n
+            print "cx q[" a "],q[" b "];"
+        }
+    }' > $tmp/circuit.qasm
+    line=$(printf "%8s%10s" "$size" "$((size * size))")
+
+    for synthesizer in $SYNTHESIZERS; do
+        t=$( { time "$STAQ" -c --cnot-synthesis "$synthesizer" \
+            -f resources $tmp/circuit.qasm > $tmp/out 2> /dev/null; } 2>&1 )
+        if [ $? -ne 0 ] || ! grep -q "cx:" $tmp/out; then
+            line+=$(printf "%24s" "-")
+            continue
+        fi
+        cx=$(grep "cx:" $tmp/out | awk '{print $2}')
+        line+=$(printf "%24s" "$cx/$t")
+    done
+    echo "$line"
+done
+
+rm -rf $tmp
@@ -0,0 +1,86 @@
+#!/bin/bash
+
+# Measures how mapping scales with the device size on generated topologies
+# Usage: ./run_scaling.sh [QUBITS ...] (default: 100 300 1000)
+# Set STAQ and GENERATOR to point to the staq and staq_device_generator
+# executables, MAPPERS to the mappers to compare (steiner is much slower on
+# large devices), TOPOLOGIES to a subset of "heavy-hex grid ladder modules
+# regular", GATES to the number of random gates per circuit and STAQ_FLAGS to
+# pass additional flags to every run.
+# Every device is compiled first (see staq_device_generator --compile), so the
+# compile column is the cost of the routing tables and the mapper columns
+# exclude it. Devices keep n^2 routing tables, which limits the sizes to a few
+# thousand qubits.
+
+STAQ=${STAQ:-../../build/staq}
+GENERATOR=${GENERATOR:-../../build/tools/staq_device_generator}
+MAPPERS=${MAPPERS:-"swap sabre"}
+TOPOLOGIES=${TOPOLOGIES:-"heavy-hex grid ladder modules regular"}
+GATES=${GATES:-2000}
+SIZES=${@:-"100 300 1000"}
+FIDELITIES="--seed 1 --sq-fidelity 0.999 0.0005 --tq-fidelity 0.99 0.005"
+TIMEFORMAT=%R
+
+tmp=/tmp/staq_scaling.$$
+mkdir -p $tmp
+
+# Generator options for a topology of about $2 qubits
+layout() {
+    case $1 in
+    heavy-hex) echo "--heavy-hex $(awk -v n=$2 'BEGIN {
+        r = int(sqrt(n / 5.2)); print (r < 1 ? 1 : r) }')" ;;
+    grid) echo "-r $(awk -v n=$2 'BEGIN { print int(sqrt(n)) }')" \
+        "--defects 0.02" ;;
+    ladder) echo "--ladder $(($2 / 2))" ;;
+    modules) echo "--modules $(($2 / 20)) 20 2" ;;
+    regular) echo "--random-regular $(($2 / 2 * 2)) 3" ;;
+    esac
+}
+
+printf "%-12s%8s%12s" "topology" "qubits" "compile (s)"
+for mapper in $MAPPERS; do
+    printf "%20s" "$mapper (CX/s)"
+done
+printf "\n"
+
+for size in $SIZES; do
+    for topology in $TOPOLOGIES; do
+        device=$tmp/device.json
+        "$GENERATOR" $(layout $topology $size) $FIDELITIES > $device
+        qubits=$(grep -c '"id"' $device)
+        t=$( { time "$GENERATOR" --compile $device > /dev/null; } 2>&1 )
+        line=$(printf "%-12s%8s%12s" "$topology" "$qubits" "$t")
+
+        # Random circuit on all qubits of the device, one H gate for every
+        # three CNOT gates
+        awk -v n=$qubits -v gates=$GATES 'BEGIN {
+            srand(1)
+            print "OPENQASM 2.0;\ninclude \"qelib1.inc\";"
+            print "qreg q[" n "];"
+            for (i = 0; i < gates; i++) {
+                a = int(rand() * n)
+                b = (a + 1 + int(rand() * (n - 1))) % n
+                if (i % 4 == 3)
+                    print "h q[" a "];"
+                else
+                    print "cx q[" a "],q[" b "];"
+            }
+        }' > $tmp/circuit.qasm
+
+        for mapper in $MAPPERS; do
+            t=$( { time "$STAQ" -m -d $device -M "$mapper" -l linear \
+                $STAQ_FLAGS -f resources $tmp/circuit.qasm > $tmp/out \
+                2> /dev/null; } 2>&1 )
+            if [ $? -ne 0 ] || ! grep -q "CX:" $tmp/out; then
+                line+=$(printf "%20s" "-")
+                continue
+            fi
+            cx=$(grep "CX:" $tmp/out | awk '{print $2}')
+            line+=$(printf "%20s" "$cx/$t")
+        done
+        echo "$line"
+        rm -f $device $device.bin
+    done
+done
+
+rm -rf $tmp
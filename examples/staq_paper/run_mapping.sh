@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Compares the mapping algorithms on the benchmark circuits
+# Usage: ./run_mapping.sh [DEVICE.json ...] (default: ibm_tokyo, rigetti_aspen4)
+# Set STAQ to point to the staq executable, and STAQ_FLAGS to pass additional
+# flags (e.g. --disable-layout-optimization) to every run
+
+STAQ=${STAQ:-../../build/staq}
+MAPPERS=${MAPPERS:-"swap steiner sabre"}
+DEVICES=${@:-"../../qpus/ibm_tokyo.json ../../qpus/rigetti_aspen4.json"}
+TIMEFORMAT=%R
+
+for device in $DEVICES; do
+    echo "Device: $device"
+    device_qubits=$(grep -c '"id"' "$device")
+    printf "%-24s" "circuit"
+    for mapper in $MAPPERS; do
+        printf "%24s" "$mapper (CX/depth/s)"
+    done
+    printf "\n"
+
+    for circuit in benchmarks/*.qasm; do
+        qubits=$(grep -o 'qreg [^;]*' "$circuit" | grep -o '[0-9]*\]' |
+            awk '{ s += $1 } END { print s }')
+        if [ "$qubits" -gt "$device_qubits" ]; then
+            continue
+        fi
+        line=$(printf "%-24s" "$(basename "$circuit" .qasm)")
+        for mapper in $MAPPERS; do
+            { t=$( { time "$STAQ" -S -O2 -m -d "$device" -M "$mapper" \
+                $STAQ_FLAGS -f resources "$circuit" > /tmp/staq_map.$$ \
+                2> /dev/null; } 2>&1 ); } 2> /dev/null
+            if [ $? -ne 0 ] || ! grep -q "depth" /tmp/staq_map.$$; then
+                line+=$(printf "%24s" "-")
+                continue
+            fi
+            cx=$(grep "CX:" /tmp/staq_map.$$ | awk '{print $2}')
+            depth=$(grep "depth:" /tmp/staq_map.$$ | awk '{print $2}')
+            line+=$(printf "%24s" "$cx/$depth/$t")
+        done
+        echo "$line"
+    done
+    echo
+done
+
+rm -f /tmp/staq_map.$$
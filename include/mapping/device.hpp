@@ -35,12 +35,15 @@
 
 #include <limits>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <list>
 #include <optional>
 #include <queue>
 #include <set>
+#include <sstream>
 #include <unordered_map>
 #include <vector>
 #include <fstream>
@@ -61,6 +64,56 @@ using spanning_tree = std::list<std::pair<int, int>>;
 
 static double FIDELITY_1 = 1 - std::numeric_limits<double>::epsilon();
 
+class Device;
+
+/**
+ * \brief Routing cost model
+ *
+ * Gives the weight of the edge between two qubits coupled in either direction
+ * for the shortest paths and Steiner trees used by the mappers. Called as
+ * cost(device, i, j), it must not itself query paths or distances.
+ */
+using routing_cost = std::function<double(Device&, int, int)>;
+
+/**
+ * \class staq::mapping::GateSink
+ * \brief Receives the gates of a mapped circuit, on physical qubits
+ *
+ * Interface through which the mapper dry runs report the circuit they would
+ * produce without building it. Only CNOT gates, U gates and measurements are
+ * reported.
+ */
+class GateSink {
+  public:
+    virtual ~GateSink() = default;
+
+    virtual void cnot(int ctrl, int tgt) = 0;
+    virtual void u(int q) = 0;
+    virtual void measure(int q) = 0;
+};
+
+/**
+ * \brief Scratch space of Device::steiner, owned by the caller and kept
+ * between calls so that a tree costs no allocation once the buffers have grown
+ */
+struct steiner_workspace {
+    std::vector<double> cost;           ///< Distance of a qubit to the tree
+    std::vector<int> edge_in;           ///< Closest tree qubit of a qubit
+    std::vector<std::uint64_t> in_tree; ///< Bitset of the tree qubits
+    std::vector<int> terminals;         ///< Terminals, in given order
+    std::vector<int> pending;           ///< Terminals not yet connected
+    std::vector<int> path;              ///< Last walked shortest path
+    std::vector<int> fresh;             ///< Qubits just added to the tree
+
+    void reset(int n) {
+        cost.resize(n);
+        edge_in.resize(n);
+        in_tree.assign((n + 63) / 64, 0);
+    }
+    bool contains(int q) const { return (in_tree[q / 64] >> (q % 64)) & 1; }
+    void add(int q) { in_tree[q / 64] |= std::uint64_t{1} << (q % 64); }
+};
+
 /**
  * \class staq::mapping::Device
  * \brief Class representing physical devices with restricted topologies & gate
@@ -148,6 +201,21 @@ class Device {
             throw std::logic_error("Qubit not coupled");
     }
 
+    /**
+     * \brief Set the routing cost model
+     *
+     * Shortest paths and Steiner trees are recomputed with the new edge
+     * weights. By default an edge weighs the negative log of its two-qubit
+     * fidelity (see coupling_cost).
+     *
+     * \param cost The cost model, or nullptr for the default
+     */
+    void set_routing_cost(routing_cost cost) {
+        routing_cost_ = std::move(cost);
+        dist.clear();
+        shortest_paths.clear();
+    }
+
     /**
      * \brief Get a shortest path between two qubits
      *
@@ -228,57 +296,40 @@ class Device {
      *
      * Given a set of terminal nodes and a root node in the coupling graph,
      * attempts to find a minimal weight set of edges connecting the root to
-     * each terminal.
+     * each terminal. The edges are ordered so that each edge's parent is the
+     * root or the child of an earlier edge.
+     *
+     * Repeatedly connects the terminal closest to the tree by a shortest
+     * path.
      *
      * \param terminals A list of terminal qubits to be connected
      * \param root A root for the Steiner tree
+     * \param ws Scratch space, which callers computing many trees should
+     * reuse and threads must not share
      * \return A spanning tree represented as a list of edges
      */
-    spanning_tree steiner(std::list<int> terminals, int root) {
+    spanning_tree steiner(const std::list<int>& terminals, int root,
+                          steiner_workspace& ws) {
         compute_shortest_paths();
 
-        spanning_tree ret;
+        ws.terminals.assign(terminals.begin(), terminals.end());
+        ws.reset(qubits_);
 
-        // Internal data structures
-        std::vector<double> vertex_cost(qubits_);
-        std::vector<int> edge_in(qubits_);
-        std::set<int> in_tree{root};
-
-        auto min_node = terminals.end();
-        for (auto it = terminals.begin(); it != terminals.end(); it++) {
-            vertex_cost[*it] = dist[root][*it];
-            edge_in[*it] = root;
-            if (min_node == terminals.end() ||
-                (vertex_cost[*it] < vertex_cost[*min_node])) {
-                min_node = it;
-            }
-        }
-
-        // Algorithm proper
-        while (min_node != terminals.end()) {
-            auto current = *min_node;
-            terminals.erase(min_node);
-            auto new_nodes = add_to_tree(
-                ret, shortest_path(edge_in[current], current), in_tree);
-            in_tree.insert(new_nodes.begin(), new_nodes.end());
-
-            // Update costs, edges, and find new minimum edge
-            min_node = terminals.end();
-            for (auto it = terminals.begin(); it != terminals.end(); it++) {
-                for (auto node : new_nodes) {
-                    if (dist[node][*it] < vertex_cost[*it]) {
-                        vertex_cost[*it] = dist[node][*it];
-                        edge_in[*it] = node;
-                    }
-                }
-                if (min_node == terminals.end() ||
-                    (vertex_cost[*it] < vertex_cost[*min_node])) {
-                    min_node = it;
-                }
-            }
-        }
+        return steiner_greedy(root, ws);
+    }
 
-        return ret;
+    /**
+     * \brief Get an approximation to a minimal Steiner tree
+     *
+     * Same as steiner(terminals, root, ws) with a fresh workspace
+     *
+     * \param terminals A list of terminal qubits to be connected
+     * \param root A root for the Steiner tree
+     * \return A spanning tree represented as a list of edges
+     */
+    spanning_tree steiner(std::list<int> terminals, int root) {
+        steiner_workspace ws;
+        return steiner(terminals, root, ws);
     }
 
     /**
@@ -352,13 +403,151 @@ class Device {
         return js.dump(2);
     }
 
+    /**
+     * \brief Serialize to the compiled (binary) device format
+     *
+     * The compiled format stores the couplings, the fidelities and the
+     * all-pairs shortest paths (distances and next hops) of the default
+     * routing cost, so that loading a device skips both JSON parsing and
+     * Floyd-Warshall. All tables are at fixed, 8-byte aligned offsets in
+     * native byte order, so the file can also be memory-mapped. The key
+     * identifies the source the device was built from (see parse_json).
+     *
+     * \param os The output stream, in binary mode
+     * \param key A hash of the device source
+     */
+    void write_compiled(std::ostream& os, std::uint64_t key) {
+        if (routing_cost_)
+            throw std::logic_error(
+                "Only the default routing cost can be compiled");
+        compute_shortest_paths();
+
+        auto n = static_cast<std::size_t>(qubits_);
+        auto pad = [&os]() {
+            static const char zeros[8] = {};
+            os.write(zeros, (8 - os.tellp() % 8) % 8);
+        };
+        auto put = [&os](auto x) {
+            os.write(reinterpret_cast<const char*>(&x), sizeof(x));
+        };
+
+        os.write(compiled_magic, sizeof(compiled_magic));
+        put(compiled_byte_order);
+        put(static_cast<std::uint32_t>(name_.size()));
+        put(key);
+        put(static_cast<std::uint64_t>(n));
+        os.write(name_.data(), name_.size());
+        pad();
+        for (std::size_t i = 0; i < n; i++)
+            for (std::size_t j = 0; j < n; j++)
+                put(static_cast<std::uint8_t>(couplings_[i][j]));
+        pad();
+        for (std::size_t i = 0; i < n; i++)
+            put(single_qubit_fidelities_[i]);
+        for (std::size_t i = 0; i < n; i++)
+            for (std::size_t j = 0; j < n; j++)
+                put(coupling_fidelities_[i][j]);
+        for (std::size_t i = 0; i < n; i++)
+            for (std::size_t j = 0; j < n; j++)
+                put(dist[i][j]);
+        for (std::size_t i = 0; i < n; i++)
+            for (std::size_t j = 0; j < n; j++)
+                put(static_cast<std::int32_t>(shortest_paths[i][j]));
+        pad();
+    }
+
+    /**
+     * \brief Deserialize from the compiled (binary) device format
+     * \param fname The compiled device file
+     * \param key The expected hash of the device source
+     * \return The device, or std::nullopt if the file is missing, stale
+     * (different key) or not a compiled device for this platform
+     */
+    static std::optional<Device> read_compiled(const std::string& fname,
+                                               std::uint64_t key) {
+        std::ifstream ifs(fname, std::ios::binary | std::ios::ate);
+        if (!ifs)
+            return std::nullopt;
+        std::vector<char> buf(static_cast<std::size_t>(ifs.tellg()));
+        ifs.seekg(0);
+        if (!ifs.read(buf.data(), buf.size()))
+            return std::nullopt;
+
+        std::size_t pos = 0;
+        auto skip_to = [&pos](std::size_t next) { pos = next; };
+        auto aligned = [&pos]() { return (pos + 7) / 8 * 8; };
+        auto get = [&buf, &pos](auto& x) {
+            if (pos + sizeof(x) > buf.size())
+                return false;
+            std::memcpy(&x, buf.data() + pos, sizeof(x));
+            pos += sizeof(x);
+            return true;
+        };
+
+        char magic[sizeof(compiled_magic)];
+        std::uint32_t byte_order = 0, name_size = 0;
+        std::uint64_t stored_key = 0, n = 0;
+        if (!get(magic) ||
+            std::memcmp(magic, compiled_magic, sizeof(magic)) != 0 ||
+            !get(byte_order) || byte_order != compiled_byte_order ||
+            !get(name_size) || !get(stored_key) || stored_key != key ||
+            !get(n))
+            return std::nullopt;
+
+        // Size check before allocating anything
+        if (n > buf.size() || name_size > buf.size())
+            return std::nullopt;
+        auto name_end = pos + name_size;
+        auto size = (name_end + 7) / 8 * 8 + (n * n + 7) / 8 * 8 +
+                    8 * (n + 2 * n * n) + (4 * n * n + 7) / 8 * 8;
+        if (size != buf.size())
+            return std::nullopt;
+
+        Device ret;
+        ret.name_.assign(buf.data() + pos, name_size);
+        ret.qubits_ = static_cast<int>(n);
+        skip_to(name_end);
+        skip_to(aligned());
+        ret.couplings_.assign(n, std::vector<bool>(n));
+        for (std::size_t i = 0; i < n; i++)
+            for (std::size_t j = 0; j < n; j++)
+                ret.couplings_[i][j] = buf[pos++] != 0;
+        skip_to(aligned());
+        ret.single_qubit_fidelities_.resize(n);
+        for (std::size_t i = 0; i < n; i++)
+            get(ret.single_qubit_fidelities_[i]);
+        ret.coupling_fidelities_.assign(n, std::vector<double>(n));
+        for (std::size_t i = 0; i < n; i++)
+            for (std::size_t j = 0; j < n; j++)
+                get(ret.coupling_fidelities_[i][j]);
+        ret.dist.assign(n, std::vector<double>(n));
+        for (std::size_t i = 0; i < n; i++)
+            for (std::size_t j = 0; j < n; j++)
+                get(ret.dist[i][j]);
+        ret.shortest_paths.assign(n, std::vector<int>(n));
+        for (std::size_t i = 0; i < n; i++) {
+            for (std::size_t j = 0; j < n; j++) {
+                std::int32_t next = 0;
+                get(next);
+                ret.shortest_paths[i][j] = next;
+            }
+        }
+
+        return ret;
+    }
+
   private:
+    static constexpr char compiled_magic[8] = {'S', 'T', 'A', 'Q',
+                                               'D', 'E', 'V', '1'};
+    static constexpr std::uint32_t compiled_byte_order = 0x01020304;
+
     std::vector<std::vector<bool>>
         couplings_; ///< The adjacency matrix of the device topology
     std::vector<double>
         single_qubit_fidelities_; ///< The fidelities of single-qubit gates
     std::vector<std::vector<double>>
         coupling_fidelities_; ///< The fidelities of two-qubit gates
+    routing_cost routing_cost_; ///< Edge weights, if not the default
 
     /** @name All-pairs-shortest-paths */
     /**@{*/
@@ -386,6 +575,10 @@ class Device {
                     if (i == j) {
                         dist[i][j] = 0;
                         shortest_paths[i][j] = j;
+                    } else if (routing_cost_ &&
+                               (couplings_[i][j] || couplings_[j][i])) {
+                        dist[i][j] = routing_cost_(*this, i, j);
+                        shortest_paths[i][j] = j;
                     } else if (couplings_[i][j]) {
                         dist[i][j] = -std::log(coupling_fidelities_[i][j]);
                         shortest_paths[i][j] = j;
@@ -415,41 +608,134 @@ class Device {
     }
 
     /**
-     * \brief Adds a path to a spanning tree
+     * \brief Greedy Steiner tree of the workspace terminals
      *
-     * Inserts a path into a spanning tree so that edges are not duplicated, and
-     * moreover maintains the spanning tree property & the topological order on
-     * the tree
+     * Grows a tree from the root, connecting the terminal closest to the tree
+     * by a shortest path until none remain, ties going to the earliest
+     * terminal. A path is only added from its last qubit already in the tree.
      *
-     * \param s_tree The input spanning tree
-     * \param p Const reference to the path to be inserted
-     * \param in_tree The set of nodes already in the tree
-     * \return The set of nodes in the resulting spanning tree
+     * \param root The root of the tree
+     * \param ws The workspace holding the terminals
+     * \return The tree, in topological order
      */
-    std::set<int> add_to_tree(spanning_tree& s_tree, const path& p,
-                              const std::set<int>& in_tree) {
-        std::set<int> ret;
-
-        int next = -1;
-        auto insert_iter = s_tree.end();
-        for (auto it = p.rbegin(); it != p.rend(); it++) {
-            // If we're not at the endpoint, insert the edge
-            if (next != -1) {
-                s_tree.insert(insert_iter, std::make_pair(*it, next));
-                --insert_iter;
-            }
-            next = *it;
-            ret.insert(*it);
+    spanning_tree steiner_greedy(int root, steiner_workspace& ws) {
+        spanning_tree ret;
 
-            // If the current node is already in the tree, we're done
-            if (in_tree.find(*it) != in_tree.end())
-                break;
+        ws.add(root);
+        ws.pending = ws.terminals;
+        std::size_t min_node = 0;
+        for (std::size_t k = 0; k < ws.pending.size(); k++) {
+            auto t = ws.pending[k];
+            ws.cost[t] = dist[root][t];
+            ws.edge_in[t] = root;
+            if (ws.cost[t] < ws.cost[ws.pending[min_node]])
+                min_node = k;
+        }
+
+        while (!ws.pending.empty()) {
+            auto current = ws.pending[min_node];
+            ws.pending.erase(ws.pending.begin() + min_node);
+
+            // Walk the next hops, then keep the part of the path after its
+            // last qubit already in the tree
+            walk(ws.edge_in[current], current, ws.path);
+            auto first = ws.path.size() - 1;
+            while (!ws.contains(ws.path[first]))
+                --first;
+            ws.fresh.clear();
+            for (auto k = first; k + 1 < ws.path.size(); k++) {
+                ret.emplace_back(ws.path[k], ws.path[k + 1]);
+                ws.add(ws.path[k + 1]);
+                ws.fresh.push_back(ws.path[k + 1]);
+            }
+            std::sort(ws.fresh.begin(), ws.fresh.end());
+
+            // Only the new qubits can bring a terminal closer to the tree
+            for (auto node : ws.fresh) {
+                auto& row = dist[node];
+                for (auto t : ws.pending) {
+                    if (row[t] < ws.cost[t]) {
+                        ws.cost[t] = row[t];
+                        ws.edge_in[t] = node;
+                    }
+                }
+            }
+            min_node = 0;
+            for (std::size_t k = 1; k < ws.pending.size(); k++) {
+                if (ws.cost[ws.pending[k]] < ws.cost[ws.pending[min_node]])
+                    min_node = k;
+            }
         }
 
         return ret;
     }
+
+    /**
+     * \brief Stores a shortest path by following next hops
+     * \note The path is just i if j is unreachable
+     */
+    void walk(int i, int j, std::vector<int>& path) {
+        path.assign(1, i);
+        if (shortest_paths[i][j] == qubits_)
+            return;
+        while (i != j) {
+            i = shortest_paths[i][j];
+            path.push_back(i);
+        }
+    }
 };
 
+/**
+ * \brief Default routing cost
+ *
+ * The negative log of the fidelity of a CNOT across the coupling, in the
+ * direction i to j if the device has it.
+ */
+inline double coupling_cost(Device& device, int i, int j) {
+    return -std::log(device.coupled(i, j) ? device.tq_fidelity(i, j)
+                                          : device.tq_fidelity(j, i));
+}
+
+/** \brief Routing cost counting couplings, i.e. the number of swaps */
+inline double hop_cost(Device&, int, int) { return 1; }
+
+/**
+ * \brief Routing cost of a swap across the coupling
+ *
+ * The negative log of the estimated success probability of the swap the
+ * mappers generate: three CNOT gates, two of them along the coupling, where
+ * a CNOT against the direction of the coupling also takes four Hadamard gates
+ * whose single-qubit error is counted. Every edge of a path is weighed as a
+ * swap, including the last one which carries the CNOT gate itself.
+ */
+inline double swap_cost(Device& device, int i, int j) {
+    auto cnot = [&device](int ctrl, int tgt) {
+        if (device.coupled(ctrl, tgt))
+            return -std::log(device.tq_fidelity(ctrl, tgt));
+        return -std::log(device.tq_fidelity(tgt, ctrl)) -
+               2 * std::log(device.sq_fidelity(ctrl)) -
+               2 * std::log(device.sq_fidelity(tgt));
+    };
+    if (!device.coupled(i, j))
+        std::swap(i, j);
+    return 2 * cnot(i, j) + cnot(j, i);
+}
+
+/** \brief Hash (64-bit FNV-1a) of a device source, keying compiled devices */
+inline std::uint64_t device_source_hash(const std::string& source) {
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/** \brief The compiled device file accompanying a JSON device file */
+inline std::string compiled_device_path(const std::string& fname) {
+    return fname + ".bin";
+}
+
 /**
  * \brief JSON deserialization of Device object
  * The JSON object should have:
@@ -457,10 +743,22 @@ class Device {
  * - qubits: list of {{id: int}, optional {fidelity: double}}
  * - couplings: list of {{control: int}, {target: int}, optional {fidelity:
  * double}} Unspecified fidelities are set to a default value
+ *
+ * If a compiled device (see compile_device) built from the same JSON source
+ * sits next to the file, it is loaded instead, routing tables included.
  */
 inline Device parse_json(std::string fname) {
-    std::ifstream ifs(fname);
-    json j = json::parse(ifs);
+    std::ifstream ifs(fname, std::ios::binary);
+    std::stringstream source;
+    source << ifs.rdbuf();
+    auto src = source.str();
+
+    auto compiled = Device::read_compiled(compiled_device_path(fname),
+                                          device_source_hash(src));
+    if (compiled)
+        return std::move(*compiled);
+
+    json j = json::parse(src);
 
     std::string name = j["name"];
     int n = j["qubits"].size();
@@ -504,6 +802,30 @@ inline Device parse_json(std::string fname) {
     return Device(name, n, dag, sq_fi, tq_fi);
 }
 
+/**
+ * \brief Compiles a JSON device file
+ *
+ * Writes the compiled form of the device, keyed by the hash of the JSON
+ * source, to compiled_device_path(fname), where parse_json picks it up.
+ *
+ * \param fname The JSON device file
+ * \return The path of the compiled device
+ */
+inline std::string compile_device(const std::string& fname) {
+    std::ifstream ifs(fname, std::ios::binary);
+    std::stringstream source;
+    source << ifs.rdbuf();
+
+    auto dev = parse_json(fname);
+    dev.set_routing_cost(nullptr);
+    auto out = compiled_device_path(fname);
+    std::ofstream ofs(out, std::ios::binary);
+    dev.write_compiled(ofs, device_source_hash(source.str()));
+    if (!ofs)
+        throw std::runtime_error("Could not write " + out);
+    return out;
+}
+
 /** \brief Generates a fully connected device with a given number of qubits */
 inline Device fully_connected(uint32_t n) {
     auto tmp = std::vector<std::vector<bool>>(n, std::vector<bool>(n, true));
@@ -0,0 +1,121 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file mapping/fidelity.hpp
+ * \brief Fidelity estimation of mapped circuits
+ */
+
+#pragma once
+
+#include "qasmtools/ast/traversal.hpp"
+#include "mapping/device.hpp"
+
+#include <cmath>
+
+namespace staq {
+namespace mapping {
+
+namespace ast = qasmtools::ast;
+
+/**
+ * \class staq::mapping::FidelityEstimator
+ * \brief Estimates the success probability of a mapped circuit
+ * \note Assumes the circuit has been mapped onto the single global register
+ * of the device
+ *
+ * The estimate is the product of the device fidelities of all gates, with
+ * single-qubit gates at their qubit's fidelity and CNOT gates at their
+ * coupling's. Measurements and resets are not counted, and gates under a
+ * classical control count as if applied.
+ */
+class FidelityEstimator final : public ast::Traverse {
+  public:
+    FidelityEstimator(Device& device) : Traverse(), device_(device) {}
+
+    /**
+     * \brief Estimates the fidelity of a mapped program
+     * \return The natural log of the estimate, which does not underflow
+     */
+    double run(ast::Program& prog) {
+        infidelity_ = 0;
+        prog.accept(*this);
+        return -infidelity_;
+    }
+
+    void visit(ast::GateDecl&) override {}
+    void visit(ast::OracleDecl&) override {}
+
+    void visit(ast::CNOTGate& gate) override {
+        add_cnot(index(gate.ctrl()), index(gate.tgt()));
+    }
+
+    void visit(ast::UGate& gate) override {
+        infidelity_ -= std::log(device_.sq_fidelity(index(gate.arg())));
+    }
+
+    void visit(ast::DeclaredGate& gate) override {
+        if (gate.num_qargs() == 1) {
+            infidelity_ -= std::log(device_.sq_fidelity(index(gate.qarg(0))));
+        } else if (gate.num_qargs() == 2) {
+            add_cnot(index(gate.qarg(0)), index(gate.qarg(1)));
+        } else {
+            throw std::logic_error("Unmapped multi-qubit gate " + gate.name());
+        }
+    }
+
+  private:
+    Device device_;
+    double infidelity_ = 0;
+
+    void add_cnot(int ctrl, int tgt) {
+        if (!device_.coupled(ctrl, tgt))
+            throw std::logic_error("CNOT between non-coupled vertices!");
+        infidelity_ -= std::log(device_.tq_fidelity(ctrl, tgt));
+    }
+
+    int index(ast::VarAccess& va) {
+        if (va.offset())
+            return *(va.offset());
+        else
+            throw std::logic_error(
+                "Gate argument is not a register dereference!");
+    }
+};
+
+/** \brief Log of the estimated fidelity of a program mapped onto a device */
+inline double estimate_log_fidelity(Device& device, ast::Program& prog) {
+    FidelityEstimator estimator(device);
+    return estimator.run(prog);
+}
+
+/** \brief Estimates the fidelity of a program mapped onto a device */
+inline double estimate_fidelity(Device& device, ast::Program& prog) {
+    return std::exp(estimate_log_fidelity(device, prog));
+}
+
+} // namespace mapping
+} // namespace staq
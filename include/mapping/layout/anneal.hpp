@@ -0,0 +1,449 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file mapping/layout/anneal.hpp
+ * \brief Simulated annealing layout optimization
+ */
+
+#pragma once
+
+#include "qasmtools/ast/traversal.hpp"
+#include "mapping/device.hpp"
+#include "mapping/layout/basic.hpp"
+#include "mapping/mapping/swap.hpp"
+#include "mapping/mapping/steiner.hpp"
+#include "mapping/mapping/sabre.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace staq {
+namespace mapping {
+
+namespace ast = qasmtools::ast;
+
+/**
+ * \brief Cost of a placement of the logical qubits, lower is better
+ *
+ * Entry i of a placement is the physical qubit of the i-th logical qubit, in
+ * the iteration order of the layout the search started from.
+ */
+using placement_cost = std::function<double(const std::vector<int>&)>;
+
+/** \brief Quantities a layout search can minimize */
+enum class layout_objective { cnot, fidelity, depth };
+
+/**
+ * \class staq::mapping::LayoutAnnealer
+ * \brief Simulated annealing over initial layouts
+ *
+ * Starting from a given layout, randomly moves a logical qubit either to a
+ * neighbor of its physical qubit or to an arbitrary one (swapping with the
+ * logical qubit already there, if any), accepting worse layouts with the
+ * Metropolis criterion. The temperature decays geometrically over the budget
+ * of each restart, from a value calibrated on a sample of random moves.
+ * Restarts after the first begin from a random perturbation of the initial
+ * layout, and the best layout over all restarts is returned.
+ *
+ * The search only depends on the seed when run with an iteration budget; a
+ * time budget makes it depend on the speed of the machine.
+ */
+class LayoutAnnealer {
+  public:
+    /**
+     * \class staq::mapping::LayoutAnnealer::config
+     * \brief Holds configuration options
+     */
+    struct config {
+        int time_budget_ms = 1000; ///< Total wall-clock budget, 0 for none
+        int iterations = 0;        ///< Moves per restart, 0 for no limit
+        int restarts = 1;          ///< Number of independent runs
+        unsigned seed = 0;         ///< Seed of the random number generator
+    };
+
+    LayoutAnnealer(Device& device) : device_(device) {}
+    LayoutAnnealer(Device& device, const config& params)
+        : device_(device), config_(params) {}
+
+    /**
+     * \brief Main optimization method
+     * \param init The initial layout
+     * \param cost The cost function, in terms of the logical order of init
+     * \return The best layout found
+     */
+    layout run(const layout& init, const placement_cost& cost) {
+        if (config_.time_budget_ms <= 0 && config_.iterations <= 0) {
+            throw std::logic_error("Layout annealing needs a budget");
+        }
+        init_adjacency();
+
+        std::vector<ast::VarAccess> qubits;
+        std::vector<int> start;
+        for (auto& [va, idx] : init) {
+            qubits.push_back(va);
+            start.push_back(idx);
+        }
+
+        auto best = start;
+        auto best_cost = cost(best);
+        auto restarts = std::max(1, config_.restarts);
+        auto slice = std::chrono::milliseconds(config_.time_budget_ms) /
+                     restarts;
+
+        for (int r = 0; r < restarts && !qubits.empty(); r++) {
+            std::seed_seq seq{config_.seed, static_cast<unsigned>(r)};
+            std::mt19937 rng(seq);
+
+            current_ = start;
+            occupant_.assign(device_.qubits_, -1);
+            for (std::size_t q = 0; q < current_.size(); q++) {
+                occupant_[current_[q]] = static_cast<int>(q);
+            }
+            if (r > 0) {
+                for (std::size_t k = 0; k < current_.size(); k++) {
+                    apply(propose(rng));
+                }
+            }
+
+            auto [placement, value] = anneal(cost, rng, slice);
+            if (value < best_cost) {
+                best = placement;
+                best_cost = value;
+            }
+        }
+
+        layout ret;
+        for (std::size_t q = 0; q < qubits.size(); q++) {
+            ret[qubits[q]] = best[q];
+        }
+        return ret;
+    }
+
+  private:
+    // A move of a logical qubit to a physical qubit
+    struct move {
+        int qubit;
+        int target;
+    };
+
+    Device device_;
+    config config_;
+    std::vector<std::vector<int>> neighbors_;
+    std::vector<int> current_;  // physical qubit of each logical qubit
+    std::vector<int> occupant_; // logical qubit on each physical qubit, or -1
+
+    void init_adjacency() {
+        neighbors_.assign(device_.qubits_, {});
+        for (int i = 0; i < device_.qubits_; i++) {
+            for (int j = 0; j < device_.qubits_; j++) {
+                if (i != j && (device_.coupled(i, j) || device_.coupled(j, i)))
+                    neighbors_[i].push_back(j);
+            }
+        }
+    }
+
+    move propose(std::mt19937& rng) {
+        auto n = static_cast<int>(current_.size());
+        auto q = std::uniform_int_distribution<int>(0, n - 1)(rng);
+        auto& adj = neighbors_[current_[q]];
+
+        int target;
+        if (!adj.empty() && std::bernoulli_distribution(0.5)(rng)) {
+            auto k = std::uniform_int_distribution<std::size_t>(
+                0, adj.size() - 1)(rng);
+            target = adj[k];
+        } else {
+            target = std::uniform_int_distribution<int>(
+                0, device_.qubits_ - 1)(rng);
+        }
+        return {q, target};
+    }
+
+    // Applies a move and returns its inverse
+    move apply(const move& m) {
+        auto from = current_[m.qubit];
+        auto other = occupant_[m.target];
+        occupant_[from] = other;
+        occupant_[m.target] = m.qubit;
+        current_[m.qubit] = m.target;
+        if (other != -1)
+            current_[other] = from;
+        return {m.qubit, from};
+    }
+
+    std::pair<std::vector<int>, double>
+    anneal(const placement_cost& cost, std::mt19937& rng,
+           std::chrono::milliseconds slice) {
+        using clock = std::chrono::steady_clock;
+        auto start = clock::now();
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+        double value = cost(current_);
+        auto best = current_;
+        auto best_value = value;
+
+        // Calibrate the initial temperature so that an average uphill move
+        // is accepted half of the time
+        double uphill = 0;
+        int samples = 0;
+        for (int k = 0; k < 16; k++) {
+            auto undo = apply(propose(rng));
+            auto delta = cost(current_) - value;
+            apply(undo);
+            if (delta > 0) {
+                uphill += delta;
+                samples++;
+            }
+        }
+        double t0 = samples > 0 ? uphill / samples / std::log(2.0) : 1.0;
+
+        for (int k = 0;; k++) {
+            // Fraction of the budget used so far
+            double progress = 0;
+            if (config_.iterations > 0) {
+                if (k >= config_.iterations)
+                    break;
+                progress = static_cast<double>(k) / config_.iterations;
+            }
+            if (config_.time_budget_ms > 0) {
+                auto elapsed = clock::now() - start;
+                if (elapsed >= slice)
+                    break;
+                progress = std::max(
+                    progress, std::chrono::duration<double>(elapsed) / slice);
+            }
+            double temperature = t0 * std::pow(1e-3, progress);
+
+            auto undo = apply(propose(rng));
+            auto next = cost(current_);
+            auto delta = next - value;
+            if (delta <= 0 || uniform(rng) < std::exp(-delta / temperature)) {
+                value = next;
+                if (value < best_value) {
+                    best = current_;
+                    best_value = value;
+                }
+            } else {
+                apply(undo);
+            }
+        }
+
+        return {best, best_value};
+    }
+};
+
+/**
+ * \class staq::mapping::MappedCost
+ * \brief Measures a mapped circuit
+ *
+ * Computes the number of CNOT gates, the depth and the negative log of the
+ * estimated fidelity (the product of the device fidelities of all gates) of
+ * a circuit mapped onto a device, either by traversing it or from the gates
+ * a mapper dry run reports.
+ */
+class MappedCost final : public ast::Traverse, public GateSink {
+  public:
+    MappedCost(Device& device) : Traverse(), device_(device) { reset(); }
+
+    /** \brief Clears the measurements */
+    void reset() {
+        cnots_ = 0;
+        infidelity_ = 0;
+        depths_.assign(device_.qubits_, 0);
+    }
+
+    /** \brief The measurements so far with respect to an objective */
+    double value(layout_objective objective) const {
+        switch (objective) {
+            case layout_objective::cnot:
+                return cnots_;
+            case layout_objective::fidelity:
+                return infidelity_;
+            default:
+                return *std::max_element(depths_.begin(), depths_.end());
+        }
+    }
+
+    /** \brief Measures a mapped program with respect to an objective */
+    double run(ast::Program& prog, layout_objective objective) {
+        reset();
+        prog.accept(*this);
+        return value(objective);
+    }
+
+    void cnot(int ctrl, int tgt) override {
+        cnots_++;
+        infidelity_ -= std::log(device_.tq_fidelity(ctrl, tgt));
+        depths_[ctrl] = depths_[tgt] =
+            std::max(depths_[ctrl], depths_[tgt]) + 1;
+    }
+    void u(int q) override {
+        infidelity_ -= std::log(device_.sq_fidelity(q));
+        depths_[q]++;
+    }
+    void measure(int q) override { depths_[q]++; }
+
+    void visit(ast::GateDecl&) override {}
+    void visit(ast::OracleDecl&) override {}
+
+    void visit(ast::CNOTGate& gate) override {
+        cnot(*gate.ctrl().offset(), *gate.tgt().offset());
+    }
+    void visit(ast::UGate& gate) override { u(*gate.arg().offset()); }
+    void visit(ast::MeasureStmt& stmt) override {
+        measure(*stmt.q_arg().offset());
+    }
+    void visit(ast::DeclaredGate& gate) override {
+        throw std::logic_error("Cannot cost uninlined gate " + gate.name());
+    }
+
+  private:
+    Device device_;
+    int cnots_ = 0;
+    double infidelity_ = 0;
+    std::vector<int> depths_;
+};
+
+/**
+ * \class staq::mapping::InlinedCheck
+ * \brief Rejects programs which still call declared gates
+ *
+ * The mapper dry runs only report CNOT, U and measurement gates, so any
+ * other gate would be left out of a layout's cost.
+ */
+class InlinedCheck final : public ast::Traverse {
+  public:
+    void run(ast::Program& prog) { prog.accept(*this); }
+
+    void visit(ast::GateDecl&) override {}
+    void visit(ast::OracleDecl&) override {}
+    void visit(ast::DeclaredGate& gate) override {
+        throw std::logic_error("Cannot cost uninlined gate " + gate.name());
+    }
+};
+
+/**
+ * \brief Builds the cost function of a mapper for layout search
+ *
+ * Costs are computed by dry runs of the mapper, which never copy or modify
+ * the program. The Steiner CNOT count only dry-runs the CNOT-dihedral chunks
+ * of the program; the other costs replay the whole mapped circuit into a
+ * MappedCost. A program still calling declared gates is rejected with a
+ * std::logic_error, as the dry runs would leave those gates out of the cost.
+ *
+ * \param device The physical device
+ * \param prog The program, fully inlined but not yet laid out
+ * \param init The layout fixing the order of the logical qubits
+ * \param mapper The mapping algorithm, one of "swap", "steiner" or "sabre"
+ * \param objective The quantity to minimize
+ * \note The device and program must outlive the returned function
+ */
+inline placement_cost layout_cost(Device& device, ast::Program& prog,
+                                  const layout& init, const std::string& mapper,
+                                  layout_objective objective) {
+    InlinedCheck().run(prog);
+    auto measure = std::make_shared<MappedCost>(device);
+
+    if (mapper == "steiner") {
+        if (objective == layout_objective::cnot) {
+            auto chunks = std::make_shared<SteinerChunks>(prog, init);
+            auto alg = std::make_shared<SteinerDry>(device);
+            return [chunks, alg](const std::vector<int>& placement) {
+                int ret = 0;
+                for (auto& chunk : chunks->chunks()) {
+                    ret += alg->get_cnot_count(chunk, placement);
+                }
+                return static_cast<double>(ret);
+            };
+        }
+
+        std::vector<ast::VarAccess> qubits;
+        for (auto& [va, idx] : init) {
+            qubits.push_back(va);
+        }
+        auto alg = std::make_shared<SteinerDry>(device);
+        return [&prog, qubits, alg, measure,
+                objective](const std::vector<int>& placement) {
+            layout l;
+            for (std::size_t q = 0; q < qubits.size(); q++) {
+                l[qubits[q]] = placement[q];
+            }
+            measure->reset();
+            alg->replay(prog, l, *measure);
+            return measure->value(objective);
+        };
+    } else if (mapper == "swap") {
+        auto alg = std::make_shared<SwapDry>(device, prog, init);
+        if (objective == layout_objective::cnot) {
+            return [alg](const std::vector<int>& placement) {
+                return static_cast<double>(alg->get_cnot_count(placement));
+            };
+        }
+        return [alg, measure, objective](const std::vector<int>& placement) {
+            measure->reset();
+            alg->replay(placement, *measure);
+            return measure->value(objective);
+        };
+    }
+
+    auto alg = std::make_shared<SabreDry>(device, prog, init);
+    if (objective == layout_objective::cnot) {
+        return [alg](const std::vector<int>& placement) {
+            return static_cast<double>(alg->get_cnot_count(placement));
+        };
+    }
+    return [alg, measure, objective](const std::vector<int>& placement) {
+        measure->reset();
+        alg->replay(placement, *measure);
+        return measure->value(objective);
+    };
+}
+
+/**
+ * \brief Optimizes a layout by simulated annealing
+ * \param device The physical device
+ * \param init The initial layout
+ * \param cost The cost function, in terms of the logical order of init
+ * \param params Options for the search
+ */
+inline layout
+compute_annealed_layout(Device& device, const layout& init,
+                        const placement_cost& cost,
+                        const LayoutAnnealer::config& params = {}) {
+    LayoutAnnealer alg(device, params);
+    return alg.run(init, cost);
+}
+
+} // namespace mapping
+} // namespace staq
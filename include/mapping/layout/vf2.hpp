@@ -0,0 +1,503 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file mapping/layout/vf2.hpp
+ * \brief Subgraph isomorphism layout generation
+ */
+
+#pragma once
+
+#include "qasmtools/ast/traversal.hpp"
+#include "mapping/device.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace staq {
+namespace mapping {
+
+namespace ast = qasmtools::ast;
+
+/**
+ * \class staq::mapping::VF2Layout
+ * \brief An initial layout embedding the interaction graph into the device
+ *
+ * Searches for an embedding of the circuit's interaction graph (logical
+ * qubits, with an edge between any two qubits sharing a CNOT gate) into the
+ * coupling graph of the device, so that no CNOT gate needs routing. The
+ * search is a VF2-style backtracking over a connectivity-first ordering of
+ * the logical qubits, pruned by degrees and by the number of free neighbors
+ * of candidate physical qubits, and candidates are tried in decreasing order
+ * of coupling fidelity.
+ *
+ * If no embedding is found within the search budget, the heaviest interactions
+ * (by number of CNOT gates) which do embed are found by binary search and the
+ * remaining qubits are placed as close as possible to the qubits they
+ * interact with. Several embeddings are then enumerated and completed, and
+ * the one with the smallest weighted distance between interacting qubits
+ * (then the best coupling fidelity) is kept.
+ *
+ * The search is capped by a number of search states, which keeps the layout
+ * reproducible. An optional wall-clock budget can cut it shorter, at the
+ * cost of layouts depending on the load of the machine. Either way each
+ * attempt gets an equal share of the budget, and what is left goes to
+ * comparing embeddings.
+ */
+class VF2Layout final : public ast::Traverse {
+  public:
+    /**
+     * \class staq::mapping::VF2Layout::config
+     * \brief Holds configuration options
+     */
+    struct config {
+        std::size_t max_states = 50000000; ///< Search states, 0 for no limit
+        int time_budget_ms = 0;            ///< Wall-clock budget, 0 for none
+        int max_embeddings = 64;           ///< Embeddings compared at the end
+    };
+
+    VF2Layout(Device& device) : Traverse(), device_(device) {}
+    VF2Layout(Device& device, const config& params)
+        : Traverse(), device_(device), config_(params) {}
+    ~VF2Layout() = default;
+
+    /** \brief Main generation method */
+    layout generate(ast::Program& prog) {
+        access_paths_.clear();
+        histogram_.clear();
+        prog.accept(*this);
+
+        if (static_cast<int>(access_paths_.size()) > device_.qubits_) {
+            throw std::logic_error("Not enough physical qubits");
+        }
+        init_device();
+        init_circuit();
+
+        // Heaviest interactions first
+        std::vector<std::pair<int, int>> edges;
+        std::vector<int> weights;
+        for (auto& [e, w] : edge_weights_) {
+            edges.push_back(e);
+            weights.push_back(w);
+        }
+        std::vector<std::size_t> order(edges.size());
+        for (std::size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(),
+                         [&weights](std::size_t a, std::size_t b) {
+                             return weights[a] > weights[b];
+                         });
+
+        // Try the full interaction graph, then bisect on the number of
+        // (heaviest) edges which can be embedded. Each attempt gets an equal
+        // share of the budget, and what is left goes to comparing embeddings
+        int attempts = 2;
+        for (auto e = edges.size(); e > 0; e /= 2)
+            attempts++;
+        auto max_states = config_.max_states > 0
+                              ? config_.max_states
+                              : std::numeric_limits<std::size_t>::max();
+        auto state_share = max_states / attempts;
+        auto share = std::chrono::milliseconds(config_.time_budget_ms) /
+                     attempts;
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(config_.time_budget_ms);
+        states_ = 0;
+
+        auto prefix = [&edges, &order](std::size_t k) {
+            std::vector<std::pair<int, int>> ret;
+            for (std::size_t i = 0; i < k; i++)
+                ret.push_back(edges[order[i]]);
+            return ret;
+        };
+
+        std::vector<int> best(n_, -1);
+        std::size_t embedded = 0;
+        std::size_t lo = 0;
+        std::size_t hi = edges.size();
+        for (bool first = true; lo <= hi; first = false) {
+            auto k = first ? hi : lo + (hi - lo) / 2;
+            deadline_ =
+                std::min(deadline, std::chrono::steady_clock::now() + share);
+            state_limit_ = std::min(max_states, states_ + state_share);
+            if (embed(prefix(k), 1)) {
+                best = mapping_;
+                embedded = k;
+                if (k == hi)
+                    break;
+                lo = k + 1;
+            } else {
+                if (k == 0)
+                    break;
+                hi = k - 1;
+            }
+        }
+
+        // Compare the completions of several embeddings of that subgraph
+        best_ = complete(best);
+        best_score_ = score(best_);
+        deadline_ = deadline;
+        state_limit_ = max_states;
+        embed(prefix(embedded), std::max(1, config_.max_embeddings));
+
+        layout ret;
+        for (int u = 0; u < n_; u++)
+            ret[access_paths_[u]] = best_[u];
+        return ret;
+    }
+
+    // Ignore gate declarations
+    void visit(ast::GateDecl&) override {}
+
+    void visit(ast::RegisterDecl& decl) override {
+        if (decl.is_quantum()) {
+            for (int i = 0; i < decl.size(); i++)
+                access_paths_.push_back(
+                    ast::VarAccess(decl.pos(), decl.id(), i));
+        }
+    }
+
+    void visit(ast::CNOTGate& gate) override {
+        histogram_[std::make_pair(gate.ctrl(), gate.tgt())] += 1;
+    }
+
+  private:
+    Device device_;
+    config config_;
+    std::vector<ast::VarAccess> access_paths_;
+    std::map<std::pair<ast::VarAccess, ast::VarAccess>, int> histogram_;
+
+    // Device graph (undirected) with the best fidelity of each coupling
+    std::vector<std::vector<int>> phys_adj_;
+    std::vector<std::vector<bool>> phys_linked_;
+    std::vector<std::vector<double>> phys_fidelity_;
+    std::vector<std::vector<int>> phys_dist_;
+
+    // Interaction graph, over indices into access_paths_
+    int n_ = 0;
+    std::map<std::pair<int, int>, int> edge_weights_;
+
+    // Search state
+    std::vector<std::vector<int>> adj_;
+    std::vector<int> order_;
+    std::vector<int> mapping_;
+    std::vector<int> occupant_;
+    std::chrono::steady_clock::time_point deadline_;
+    std::size_t states_ = 0;      ///< Search states visited
+    std::size_t state_limit_ = 0; ///< Search states allowed
+    bool timed_out_ = false;
+    int wanted_ = 1;
+    int found_ = 0;
+
+    // Best completed placement seen so far
+    std::vector<int> best_;
+    std::pair<long long, double> best_score_;
+
+    void init_device() {
+        auto m = device_.qubits_;
+        phys_adj_.assign(m, {});
+        phys_linked_.assign(m, std::vector<bool>(m, false));
+        phys_fidelity_.assign(m, std::vector<double>(m, 0));
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < m; j++) {
+                if (i == j)
+                    continue;
+                if (device_.coupled(i, j))
+                    phys_fidelity_[i][j] = device_.tq_fidelity(i, j);
+                if (device_.coupled(j, i))
+                    phys_fidelity_[i][j] = std::max(phys_fidelity_[i][j],
+                                                    device_.tq_fidelity(j, i));
+                if (device_.coupled(i, j) || device_.coupled(j, i)) {
+                    phys_adj_[i].push_back(j);
+                    phys_linked_[i][j] = true;
+                }
+            }
+        }
+
+        // Hop distances, with m standing in for unreachable
+        phys_dist_.assign(m, std::vector<int>(m, m));
+        for (int i = 0; i < m; i++) {
+            std::vector<int> queue{i};
+            phys_dist_[i][i] = 0;
+            for (std::size_t k = 0; k < queue.size(); k++) {
+                auto p = queue[k];
+                for (auto q : phys_adj_[p]) {
+                    if (phys_dist_[i][q] == m) {
+                        phys_dist_[i][q] = phys_dist_[i][p] + 1;
+                        queue.push_back(q);
+                    }
+                }
+            }
+            phys_dist_[i][i] = 0;
+        }
+    }
+
+    void init_circuit() {
+        n_ = static_cast<int>(access_paths_.size());
+        std::map<ast::VarAccess, int> index;
+        for (int i = 0; i < n_; i++)
+            index[access_paths_[i]] = i;
+
+        edge_weights_.clear();
+        for (auto& [args, count] : histogram_) {
+            auto a = index.find(args.first);
+            auto b = index.find(args.second);
+            if (a == index.end() || b == index.end())
+                throw std::logic_error("Unknown qubit in CNOT gate");
+            if (a->second == b->second)
+                continue;
+            auto e = std::make_pair(std::min(a->second, b->second),
+                                    std::max(a->second, b->second));
+            edge_weights_[e] += count;
+        }
+    }
+
+    bool out_of_budget() {
+        if (timed_out_)
+            return true;
+        if (++states_ > state_limit_) {
+            timed_out_ = true;
+        } else if (config_.time_budget_ms > 0 && (states_ & 0x3ff) == 0 &&
+                   std::chrono::steady_clock::now() >= deadline_) {
+            timed_out_ = true;
+        }
+        return timed_out_;
+    }
+
+    // Weighted distance between interacting qubits, then infidelity
+    std::pair<long long, double> score(const std::vector<int>& placement) {
+        std::pair<long long, double> ret{0, 0};
+        for (auto& [e, w] : edge_weights_) {
+            auto [a, b] = e;
+            auto d = phys_dist_[placement[a]][placement[b]];
+            ret.first += static_cast<long long>(w) * (d - 1);
+            if (d == 1)
+                ret.second += w * (1 - phys_fidelity_[placement[a]]
+                                                     [placement[b]]);
+        }
+        return ret;
+    }
+
+    // Searches for up to wanted embeddings of the given edges. The first one
+    // is left in mapping_, and with more than one the best completion is
+    // kept in best_
+    bool embed(const std::vector<std::pair<int, int>>& edges, int wanted) {
+        adj_.assign(n_, {});
+        for (auto [a, b] : edges) {
+            adj_[a].push_back(b);
+            adj_[b].push_back(a);
+        }
+
+        // Connectivity-first order: repeatedly start from the unordered qubit
+        // of highest degree, then add the qubit with the most ordered
+        // neighbors (ties to the highest degree)
+        order_.clear();
+        std::vector<bool> ordered(n_, false);
+        std::vector<int> links(n_, 0);
+        for (int step = 0; step < n_; step++) {
+            int next = -1;
+            for (int u = 0; u < n_; u++) {
+                if (ordered[u] || adj_[u].empty())
+                    continue;
+                if (next == -1 || links[u] > links[next] ||
+                    (links[u] == links[next] &&
+                     adj_[u].size() > adj_[next].size()))
+                    next = u;
+            }
+            if (next == -1)
+                break;
+            ordered[next] = true;
+            order_.push_back(next);
+            for (auto v : adj_[next])
+                links[v]++;
+        }
+
+        mapping_.assign(n_, -1);
+        occupant_.assign(device_.qubits_, -1);
+        timed_out_ = false;
+        wanted_ = wanted;
+        found_ = 0;
+        if (!order_.empty())
+            extend(0);
+        return order_.empty() || found_ > 0;
+    }
+
+    // Returns true once the search should stop
+    bool extend(std::size_t depth) {
+        if (depth == order_.size()) {
+            found_++;
+            if (wanted_ > 1) {
+                auto candidate = complete(mapping_);
+                auto candidate_score = score(candidate);
+                if (candidate_score < best_score_) {
+                    best_ = std::move(candidate);
+                    best_score_ = candidate_score;
+                }
+            }
+            return found_ >= wanted_;
+        }
+        if (out_of_budget())
+            return true;
+
+        auto u = order_[depth];
+
+        // Candidates: neighbors of a mapped neighbor, or all free qubits
+        int anchor = -1;
+        for (auto v : adj_[u]) {
+            if (mapping_[v] != -1) {
+                anchor = mapping_[v];
+                break;
+            }
+        }
+        std::vector<int> candidates;
+        if (anchor != -1) {
+            candidates = phys_adj_[anchor];
+            std::stable_sort(candidates.begin(), candidates.end(),
+                             [this, anchor](int a, int b) {
+                                 return phys_fidelity_[anchor][a] >
+                                        phys_fidelity_[anchor][b];
+                             });
+        } else {
+            for (int p = 0; p < device_.qubits_; p++)
+                candidates.push_back(p);
+            std::stable_sort(candidates.begin(), candidates.end(),
+                             [this](int a, int b) {
+                                 return phys_adj_[a].size() >
+                                        phys_adj_[b].size();
+                             });
+        }
+
+        for (auto p : candidates) {
+            if (occupant_[p] != -1 || phys_adj_[p].size() < adj_[u].size())
+                continue;
+
+            // Every mapped neighbor must be coupled to p, and the unmapped
+            // ones need enough free neighbors of p
+            bool feasible = true;
+            std::size_t unmapped = 0;
+            for (auto v : adj_[u]) {
+                if (mapping_[v] == -1) {
+                    unmapped++;
+                } else if (!phys_linked_[p][mapping_[v]]) {
+                    feasible = false;
+                    break;
+                }
+            }
+            if (!feasible)
+                continue;
+            std::size_t free = 0;
+            for (auto q : phys_adj_[p]) {
+                if (occupant_[q] == -1)
+                    free++;
+            }
+            if (free < unmapped)
+                continue;
+
+            mapping_[u] = p;
+            occupant_[p] = u;
+            if (extend(depth + 1))
+                return true;
+            mapping_[u] = -1;
+            occupant_[p] = -1;
+
+            if (timed_out_)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Places the qubits left out of a partial embedding
+    std::vector<int> complete(std::vector<int> placement) {
+        std::vector<bool> allocated(device_.qubits_, false);
+        for (auto p : placement) {
+            if (p != -1)
+                allocated[p] = true;
+        }
+
+        // Qubit with the heaviest interactions with placed qubits first, onto
+        // the free physical qubit minimizing its weighted distance to them
+        for (;;) {
+            std::vector<int> pull(n_, 0);
+            for (auto& [e, w] : edge_weights_) {
+                auto [a, b] = e;
+                if ((placement[a] == -1) != (placement[b] == -1))
+                    pull[placement[a] == -1 ? a : b] += w;
+            }
+            auto best_u = static_cast<int>(
+                std::max_element(pull.begin(), pull.end()) - pull.begin());
+            if (n_ == 0 || pull[best_u] == 0)
+                break;
+
+            int target = -1;
+            long long target_cost = 0;
+            for (int p = 0; p < device_.qubits_; p++) {
+                if (allocated[p])
+                    continue;
+                long long cost = 0;
+                for (auto& [e, w] : edge_weights_) {
+                    auto [a, b] = e;
+                    auto v = a == best_u ? b : (b == best_u ? a : -1);
+                    if (v != -1 && placement[v] != -1)
+                        cost += static_cast<long long>(w) *
+                                phys_dist_[p][placement[v]];
+                }
+                if (target == -1 || cost < target_cost) {
+                    target = p;
+                    target_cost = cost;
+                }
+            }
+            placement[best_u] = target;
+            allocated[target] = true;
+        }
+
+        // Anything else, first-come first-served
+        int next = 0;
+        for (int u = 0; u < n_; u++) {
+            if (placement[u] == -1) {
+                while (allocated[next])
+                    next++;
+                placement[u] = next;
+                allocated[next] = true;
+            }
+        }
+        return placement;
+    }
+};
+
+/** \brief Generates a subgraph isomorphism layout for a program on a device */
+inline layout compute_vf2_layout(Device& device, ast::Program& prog,
+                                 const VF2Layout::config& params = {}) {
+    VF2Layout gen(device, params);
+    return gen.generate(prog);
+}
+
+} // namespace mapping
+} // namespace staq
@@ -0,0 +1,849 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file mapping/mapping/sabre.hpp
+ * \brief Lookahead swap-based hardware mapper
+ */
+
+#pragma once
+
+#include "qasmtools/ast/replacer.hpp"
+#include "qasmtools/ast/traversal.hpp"
+#include "mapping/device.hpp"
+#include "mapping/layout/basic.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <list>
+#include <map>
+#include <optional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace staq {
+namespace mapping {
+
+namespace ast = qasmtools::ast;
+namespace parser = qasmtools::parser;
+
+class SabreDry;
+
+/**
+ * \class staq::mapping::SabreMapper
+ * \brief SABRE-style lookahead swap-inserting mapping algorithm
+ * \note Assumes the circuit has a single global register with the configured
+ * name
+ *
+ * Maps an AST to a given device following the SWAP-based bidirectional
+ * heuristic search of arXiv:1809.02573. The program is split into a dependency
+ * graph over qubit (and classical register) wires, and gates are executed
+ * from a front layer as soon as their arguments are adjacent on the device.
+ * When every gate in the front layer is blocked, the swap minimizing a
+ * decay-weighted distance heuristic over the front layer and a lookahead
+ * window of upcoming two-qubit gates is inserted. Only the gates touching the
+ * two swapped qubits are re-scored for each candidate swap.
+ *
+ * The initial placement is refined by alternating forward and backward
+ * routing passes, keeping the placement with the fewest swaps. Like the
+ * SwapMapper, the final qubit permutation is returned rather than undone.
+ */
+class SabreMapper final {
+    friend class SabreDry;
+
+  public:
+    /**
+     * \class staq::mapping::SabreMapper::config
+     * \brief Holds configuration options
+     */
+    struct config {
+        std::string register_name = "q";
+        int lookahead = 20;            ///< size of the extended gate set
+        double lookahead_weight = 0.5; ///< weight of the extended gate set
+        double decay_delta = 0.001;    ///< decay increment per swapped qubit
+        int decay_reset = 5;           ///< swaps between decay resets
+        int layout_passes = 1;         ///< forward-backward refinement rounds
+    };
+
+    SabreMapper(Device& device) : device_(device) { init_device(); }
+    SabreMapper(Device& device, const config& params)
+        : device_(device), config_(params) {
+        init_device();
+    }
+
+    /**
+     * \brief Maps the program onto the device
+     * \return The permutation of physical qubits, mapping each qubit's
+     * initial location to its final location
+     */
+    std::map<int, int> run(ast::Program& prog) {
+        analyze(prog);
+
+        std::vector<int> forward(nodes_.size());
+        for (std::size_t i = 0; i < nodes_.size(); i++)
+            forward[i] = static_cast<int>(i);
+        std::vector<int> backward(forward.rbegin(), forward.rend());
+
+        // Forward-backward refinement of the initial placement
+        std::vector<int> current(device_.qubits_);
+        for (int i = 0; i < device_.qubits_; i++)
+            current[i] = i;
+        initial_ = current;
+
+        if (config_.layout_passes > 0) {
+            int best = std::numeric_limits<int>::max();
+            for (int pass = 0; pass <= config_.layout_passes; pass++) {
+                auto [swaps, final_l2p] = route(forward, current, nullptr);
+                if (swaps < best) {
+                    best = swaps;
+                    initial_ = current;
+                }
+                if (pass < config_.layout_passes)
+                    current = route(backward, final_l2p, nullptr).second;
+            }
+        }
+
+        // Final routing pass
+        std::list<ast::ptr<ast::Stmt>> body;
+        auto final_l2p = route(forward, initial_, &body).second;
+        prog.body() = std::move(body);
+        nodes_.clear();
+
+        std::map<int, int> ret;
+        for (int i = 0; i < device_.qubits_; i++)
+            ret[initial_[i]] = final_l2p[i];
+        return ret;
+    }
+
+    /**
+     * \brief The refined initial placement of the last run
+     * \return A vector mapping each register index to its initial physical
+     * qubit
+     */
+    const std::vector<int>& initial_placement() const { return initial_; }
+
+  private:
+    /* A node of the dependency graph */
+    struct node {
+        ast::ptr<ast::Stmt> stmt;
+        std::vector<int> wires;        // quantum & classical wires touched
+        int q1 = -1, q2 = -1;          // the arguments of a two-qubit gate
+        ast::CNOTGate* cnot = nullptr; // non-null if the gate is a CNOT
+        ast::IfStmt* cond = nullptr;   // non-null if the gate is conditional
+        int u = -1;                    // the argument of a U gate
+        int measured = -1;             // the qubit of a measurement
+    };
+
+    /* Collects the wires a statement acts on */
+    class WireCollector final : public ast::Traverse {
+      public:
+        WireCollector(SabreMapper& mapper, node& nd)
+            : mapper_(mapper), node_(nd) {}
+
+        std::vector<int> qubits;
+        int qargs = 0;
+        bool is_gate = false;
+
+        // Declarations are not executed, so their bodies touch no wires
+        void visit(ast::GateDecl&) override {}
+        void visit(ast::OracleDecl&) override {}
+
+        void visit(ast::VarAccess& va) override {
+            if (va.var() != mapper_.config_.register_name) {
+                node_.wires.push_back(mapper_.classical_wire(va.var()));
+                return;
+            }
+            qargs++;
+            if (va.offset()) {
+                qubits.push_back(*va.offset());
+            } else {
+                for (int i = 0; i < mapper_.device_.qubits_; i++)
+                    qubits.push_back(i);
+            }
+        }
+        void visit(ast::RegisterDecl& decl) override {
+            if (decl.id() != mapper_.config_.register_name)
+                node_.wires.push_back(mapper_.classical_wire(decl.id()));
+        }
+        void visit(ast::IfStmt& stmt) override {
+            node_.wires.push_back(mapper_.classical_wire(stmt.var()));
+            node_.cond = &stmt;
+            stmt.then().accept(*this);
+        }
+        void visit(ast::UGate& gate) override {
+            is_gate = true;
+            Traverse::visit(gate);
+            if (qubits.size() == 1)
+                node_.u = qubits[0];
+        }
+        void visit(ast::MeasureStmt& stmt) override {
+            Traverse::visit(stmt);
+            if (qubits.size() == 1)
+                node_.measured = qubits[0];
+        }
+        void visit(ast::CNOTGate& gate) override {
+            is_gate = true;
+            node_.cnot = &gate;
+            Traverse::visit(gate);
+        }
+        void visit(ast::DeclaredGate& gate) override {
+            is_gate = true;
+            Traverse::visit(gate);
+        }
+
+      private:
+        SabreMapper& mapper_;
+        node& node_;
+    };
+
+    /* Rewrites register accesses according to a placement */
+    class Relabeler final : public ast::Replacer {
+      public:
+        Relabeler(const std::string& name, const std::vector<int>& l2p)
+            : name_(name), l2p_(l2p) {}
+
+        std::optional<ast::VarAccess> replace(ast::VarAccess& va) override {
+            if (va.var() == name_ && va.offset())
+                return ast::VarAccess(va.pos(), va.var(), l2p_[*va.offset()]);
+            else
+                return std::nullopt;
+        }
+
+      private:
+        const std::string& name_;
+        const std::vector<int>& l2p_;
+    };
+
+    static constexpr int INF = std::numeric_limits<int>::max() / 4;
+
+    Device device_;
+    config config_;
+
+    // Device tables
+    std::vector<std::vector<int>> neighbours_;
+    std::vector<int> dist_; // flattened hop-distance matrix
+    int diameter_ = 0;
+
+    // Dependency graph
+    std::vector<node> nodes_;
+    std::unordered_map<std::string, int> classical_wires_;
+    std::vector<int> succ_offsets_;
+    std::vector<int> succ_;
+    std::vector<int> indegree_;
+
+    std::vector<int> initial_;
+
+    int dist(int i, int j) const { return dist_[i * device_.qubits_ + j]; }
+
+    int classical_wire(const std::string& name) {
+        int next = device_.qubits_ + static_cast<int>(classical_wires_.size());
+        return classical_wires_.insert({name, next}).first->second;
+    }
+
+    /* Computes adjacency lists and hop distances of the coupling graph */
+    void init_device() {
+        int n = device_.qubits_;
+        neighbours_.assign(n, {});
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                if (i != j && (device_.coupled(i, j) || device_.coupled(j, i)))
+                    neighbours_[i].push_back(j);
+            }
+        }
+
+        dist_.assign(static_cast<std::size_t>(n) * n, INF);
+        std::vector<int> queue(n);
+        for (int src = 0; src < n; src++) {
+            int* row = &dist_[static_cast<std::size_t>(src) * n];
+            std::size_t head = 0, tail = 0;
+            row[src] = 0;
+            queue[tail++] = src;
+            while (head < tail) {
+                int u = queue[head++];
+                for (int v : neighbours_[u]) {
+                    if (row[v] == INF) {
+                        row[v] = row[u] + 1;
+                        diameter_ = std::max(diameter_, row[v]);
+                        queue[tail++] = v;
+                    }
+                }
+            }
+        }
+    }
+
+    /* Moves the program body into the node list and records wires */
+    void analyze(ast::Program& prog) {
+        nodes_.clear();
+        classical_wires_.clear();
+        nodes_.reserve(prog.body().size());
+
+        for (auto& stmt : prog.body()) {
+            nodes_.emplace_back();
+            auto& nd = nodes_.back();
+            nd.stmt = std::move(stmt);
+
+            WireCollector collector(*this, nd);
+            nd.stmt->accept(collector);
+
+            for (auto q : collector.qubits) {
+                if (q < 0 || q >= device_.qubits_)
+                    throw std::logic_error(
+                        "Gate argument(s) out of device bounds!");
+                nd.wires.push_back(q);
+            }
+            if (collector.is_gate && collector.qargs > 1 &&
+                collector.qubits.size() > 2)
+                throw std::logic_error(
+                    "Gate on more than two qubits, inline before mapping!");
+            if (collector.is_gate && collector.qubits.size() == 2 &&
+                collector.qubits[0] != collector.qubits[1]) {
+                nd.q1 = collector.qubits[0];
+                nd.q2 = collector.qubits[1];
+            } else {
+                nd.cnot = nullptr;
+            }
+        }
+        prog.body().clear();
+    }
+
+    /* Builds successor lists & in-degrees for the nodes in a given order */
+    void build_dag(const std::vector<int>& order) {
+        std::size_t num_wires = device_.qubits_ + classical_wires_.size();
+        std::vector<int> last(num_wires, -1);
+        std::vector<int> stamp(nodes_.size(), -1);
+        std::vector<std::pair<int, int>> edges;
+
+        indegree_.assign(nodes_.size(), 0);
+        for (auto id : order) {
+            for (auto w : nodes_[id].wires) {
+                int pred = last[w];
+                if (pred != -1 && pred != id && stamp[pred] != id) {
+                    stamp[pred] = id;
+                    edges.emplace_back(pred, id);
+                    indegree_[id]++;
+                }
+                last[w] = id;
+            }
+        }
+
+        succ_offsets_.assign(nodes_.size() + 1, 0);
+        for (auto& [pred, succ] : edges)
+            succ_offsets_[pred + 1]++;
+        for (std::size_t i = 0; i < nodes_.size(); i++)
+            succ_offsets_[i + 1] += succ_offsets_[i];
+        succ_.resize(edges.size());
+        std::vector<int> fill(succ_offsets_.begin(), succ_offsets_.end() - 1);
+        for (auto& [pred, succ] : edges)
+            succ_[fill[pred]++] = succ;
+    }
+
+    /**
+     * \brief Routes the nodes in the given order from an initial placement
+     *
+     * If out is non-null, the mapped statements are appended to it. If sink
+     * is non-null, the gates of the mapped circuit are reported to it.
+     *
+     * \return The number of swaps inserted & the final placement
+     */
+    std::pair<int, std::vector<int>>
+    route(const std::vector<int>& order, std::vector<int> l2p,
+          std::list<ast::ptr<ast::Stmt>>* out, GateSink* sink = nullptr) {
+        int n = device_.qubits_;
+        build_dag(order);
+
+        std::vector<int> position(nodes_.size());
+        for (std::size_t i = 0; i < order.size(); i++)
+            position[order[i]] = static_cast<int>(i);
+
+        std::vector<int> p2l(n);
+        for (int i = 0; i < n; i++)
+            p2l[l2p[i]] = i;
+
+        // Ready nodes are executed in order of position, so that the
+        // original gate order is preserved whenever no routing is needed
+        auto cmp = [&position](int a, int b) {
+            return position[a] > position[b];
+        };
+        std::priority_queue<int, std::vector<int>, decltype(cmp)> ready(cmp);
+        for (auto id : order) {
+            if (indegree_[id] == 0)
+                ready.push(id);
+        }
+
+        std::vector<int> front; // blocked two-qubit gates
+        std::vector<double> decay(n, 1.0);
+        std::vector<int> visited(nodes_.size(), -1);
+        int epoch = 0;
+        int swaps = 0;
+        int swaps_since_reset = 0;
+        int swaps_since_progress = 0;
+        int release = 3 * std::max(diameter_, 1);
+
+        auto executable = [&](int id) {
+            auto& nd = nodes_[id];
+            return nd.q1 == -1 || dist(l2p[nd.q1], l2p[nd.q2]) == 1;
+        };
+
+        auto execute_ready = [&]() {
+            bool progress = false;
+            while (!ready.empty()) {
+                int id = ready.top();
+                ready.pop();
+
+                if (!executable(id)) {
+                    front.push_back(id);
+                    continue;
+                }
+
+                progress = true;
+                if (sink)
+                    report(id, l2p, *sink);
+                if (out)
+                    emit(id, l2p, *out);
+                for (int k = succ_offsets_[id]; k < succ_offsets_[id + 1];
+                     k++) {
+                    if (--indegree_[succ_[k]] == 0)
+                        ready.push(succ_[k]);
+                }
+            }
+            return progress;
+        };
+
+        auto apply_swap = [&](int a, int b, parser::Position pos) {
+            if (sink)
+                report_swap(a, b, *sink);
+            if (out)
+                emit_swap(a, b, pos, *out);
+            std::swap(p2l[a], p2l[b]);
+            l2p[p2l[a]] = a;
+            l2p[p2l[b]] = b;
+            swaps++;
+        };
+
+        // Moves blocked gates which became executable back to the ready queue
+        auto release_front = [&]() {
+            auto it = std::partition(front.begin(), front.end(),
+                                     [&](int id) { return !executable(id); });
+            for (auto ti = it; ti != front.end(); ti++)
+                ready.push(*ti);
+            front.erase(it, front.end());
+        };
+
+        // Per-physical-qubit occurrences in the front & extended sets
+        std::vector<std::vector<std::pair<int, bool>>> occurrences(n);
+        std::vector<int> extended;
+        std::vector<std::pair<int, int>> candidates;
+
+        execute_ready();
+        while (!front.empty()) {
+            std::sort(front.begin(), front.end(), [&position](int a, int b) {
+                return position[a] < position[b];
+            });
+
+            for (auto id : front) {
+                auto& nd = nodes_[id];
+                if (dist(l2p[nd.q1], l2p[nd.q2]) >= INF)
+                    throw std::logic_error(
+                        "Could not find a connection between qubits");
+            }
+
+            if (swaps_since_progress >= release) {
+                // Release valve: walk the oldest blocked gate along a
+                // shortest path so that forward progress is guaranteed
+                auto& nd = nodes_[front.front()];
+                int src = l2p[nd.q1];
+                int tgt = l2p[nd.q2];
+                while (dist(src, tgt) > 1) {
+                    for (int next : neighbours_[src]) {
+                        if (dist(next, tgt) == dist(src, tgt) - 1) {
+                            apply_swap(src, next, nd.stmt->pos());
+                            src = next;
+                            break;
+                        }
+                    }
+                }
+            } else {
+                // Extended set: the next two-qubit gates in the dependency
+                // graph reachable from the front layer
+                extended.clear();
+                epoch++;
+                std::queue<int> bfs;
+                for (auto id : front) {
+                    visited[id] = epoch;
+                    bfs.push(id);
+                }
+                while (!bfs.empty() &&
+                       static_cast<int>(extended.size()) < config_.lookahead) {
+                    int id = bfs.front();
+                    bfs.pop();
+                    for (int k = succ_offsets_[id]; k < succ_offsets_[id + 1];
+                         k++) {
+                        int succ = succ_[k];
+                        if (visited[succ] == epoch)
+                            continue;
+                        visited[succ] = epoch;
+                        if (nodes_[succ].q1 != -1) {
+                            extended.push_back(succ);
+                            if (static_cast<int>(extended.size()) >=
+                                config_.lookahead)
+                                break;
+                        }
+                        bfs.push(succ);
+                    }
+                }
+
+                // Base costs & occurrence lists
+                double base_front = 0;
+                double base_ext = 0;
+                auto record = [&](int id, bool in_front) {
+                    auto& nd = nodes_[id];
+                    int a = l2p[nd.q1];
+                    int b = l2p[nd.q2];
+                    (in_front ? base_front : base_ext) += dist(a, b);
+                    occurrences[a].emplace_back(id, in_front);
+                    occurrences[b].emplace_back(id, in_front);
+                };
+                for (auto id : front)
+                    record(id, true);
+                for (auto id : extended)
+                    record(id, false);
+
+                // Candidate swaps on edges adjacent to the front layer
+                candidates.clear();
+                for (auto id : front) {
+                    for (int p : {l2p[nodes_[id].q1], l2p[nodes_[id].q2]}) {
+                        for (int q : neighbours_[p])
+                            candidates.emplace_back(std::min(p, q),
+                                                    std::max(p, q));
+                    }
+                }
+                std::sort(candidates.begin(), candidates.end());
+                candidates.erase(
+                    std::unique(candidates.begin(), candidates.end()),
+                    candidates.end());
+
+                // Incremental scoring: only gates on a or b change distance
+                auto score = [&](int a, int b) {
+                    double delta_front = 0;
+                    double delta_ext = 0;
+                    auto swapped = [a, b](int p) {
+                        return p == a ? b : (p == b ? a : p);
+                    };
+                    for (int p : {a, b}) {
+                        for (auto& [id, in_front] : occurrences[p]) {
+                            auto& nd = nodes_[id];
+                            int x = l2p[nd.q1];
+                            int y = l2p[nd.q2];
+                            if (p == b && (x == a || y == a))
+                                continue; // already counted
+                            double delta =
+                                dist(swapped(x), swapped(y)) - dist(x, y);
+                            (in_front ? delta_front : delta_ext) += delta;
+                        }
+                    }
+
+                    double h = (base_front + delta_front) / front.size();
+                    if (!extended.empty())
+                        h += config_.lookahead_weight *
+                             (base_ext + delta_ext) / extended.size();
+                    return std::max(decay[a], decay[b]) * h;
+                };
+
+                auto best = candidates.front();
+                double best_score = std::numeric_limits<double>::max();
+                for (auto& [a, b] : candidates) {
+                    auto s = score(a, b);
+                    if (s < best_score) {
+                        best_score = s;
+                        best = std::make_pair(a, b);
+                    }
+                }
+
+                for (auto id : front) {
+                    occurrences[l2p[nodes_[id].q1]].clear();
+                    occurrences[l2p[nodes_[id].q2]].clear();
+                }
+                for (auto id : extended) {
+                    occurrences[l2p[nodes_[id].q1]].clear();
+                    occurrences[l2p[nodes_[id].q2]].clear();
+                }
+
+                apply_swap(best.first, best.second,
+                           nodes_[front.front()].stmt->pos());
+                decay[best.first] += config_.decay_delta;
+                decay[best.second] += config_.decay_delta;
+                if (++swaps_since_reset >= config_.decay_reset) {
+                    std::fill(decay.begin(), decay.end(), 1.0);
+                    swaps_since_reset = 0;
+                }
+            }
+
+            swaps_since_progress++;
+            release_front();
+            if (execute_ready()) {
+                std::fill(decay.begin(), decay.end(), 1.0);
+                swaps_since_reset = 0;
+                swaps_since_progress = 0;
+            }
+        }
+
+        return std::make_pair(swaps, std::move(l2p));
+    }
+
+    /* Appends a node to the output, relabelled by the current placement */
+    void emit(int id, const std::vector<int>& l2p,
+              std::list<ast::ptr<ast::Stmt>>& out) {
+        auto& nd = nodes_[id];
+        Relabeler relabel(config_.register_name, l2p);
+        nd.stmt->accept(relabel);
+
+        if (nd.cnot) {
+            int ctrl = l2p[nd.q1];
+            int tgt = l2p[nd.q2];
+            if (!device_.coupled(ctrl, tgt)) {
+                auto pos = nd.stmt->pos();
+                for (auto& gate : generate_swapped_cnot(ctrl, tgt, pos)) {
+                    if (nd.cond)
+                        out.emplace_back(std::make_unique<ast::IfStmt>(
+                            pos, nd.cond->var(), nd.cond->cond(),
+                            std::move(gate)));
+                    else
+                        out.emplace_back(std::move(gate));
+                }
+                return;
+            }
+        }
+
+        out.emplace_back(std::move(nd.stmt));
+    }
+
+    /* Reports a CNOT as emit() produces it */
+    void report_cnot(int ctrl, int tgt, GateSink& sink) {
+        if (device_.coupled(ctrl, tgt)) {
+            sink.cnot(ctrl, tgt);
+        } else {
+            sink.u(ctrl);
+            sink.u(tgt);
+            sink.cnot(tgt, ctrl);
+            sink.u(ctrl);
+            sink.u(tgt);
+        }
+    }
+
+    /* Reports the gates emit() would append for a node */
+    void report(int id, const std::vector<int>& l2p, GateSink& sink) {
+        auto& nd = nodes_[id];
+        if (nd.cnot)
+            report_cnot(l2p[nd.q1], l2p[nd.q2], sink);
+        else if (nd.u != -1)
+            sink.u(l2p[nd.u]);
+        else if (nd.measured != -1)
+            sink.measure(l2p[nd.measured]);
+    }
+
+    /* Reports the gates emit_swap() would append */
+    void report_swap(int i, int j, GateSink& sink) {
+        if (!device_.coupled(i, j))
+            std::swap(i, j);
+        sink.cnot(i, j);
+        report_cnot(j, i, sink);
+        sink.cnot(i, j);
+    }
+
+    /* Appends a swap between two adjacent physical qubits to the output */
+    void emit_swap(int i, int j, parser::Position pos,
+                   std::list<ast::ptr<ast::Stmt>>& out) {
+        auto swap_i = i;
+        auto swap_j = j;
+        if (!device_.coupled(i, j)) {
+            swap_i = j;
+            swap_j = i;
+        }
+
+        // CNOT 1
+        out.emplace_back(generate_cnot(swap_i, swap_j, pos));
+
+        // CNOT 2
+        if (device_.coupled(swap_j, swap_i)) {
+            out.emplace_back(generate_cnot(swap_j, swap_i, pos));
+        } else {
+            for (auto& gate : generate_swapped_cnot(swap_j, swap_i, pos))
+                out.emplace_back(std::move(gate));
+        }
+
+        // CNOT 3
+        out.emplace_back(generate_cnot(swap_i, swap_j, pos));
+    }
+
+    ast::ptr<ast::CNOTGate> generate_cnot(int i, int j, parser::Position pos) {
+        auto ctrl = ast::VarAccess(pos, config_.register_name, i);
+        auto tgt = ast::VarAccess(pos, config_.register_name, j);
+        return std::make_unique<ast::CNOTGate>(
+            ast::CNOTGate(pos, std::move(ctrl), std::move(tgt)));
+    }
+
+    ast::ptr<ast::UGate> generate_hadamard(int i, parser::Position pos) {
+        auto tgt = ast::VarAccess(pos, config_.register_name, i);
+
+        auto tmp1 = std::make_unique<ast::PiExpr>(ast::PiExpr(pos));
+        auto tmp2 = std::make_unique<ast::IntExpr>(ast::IntExpr(pos, 2));
+        auto theta = std::make_unique<ast::BExpr>(ast::BExpr(
+            pos, std::move(tmp1), ast::BinaryOp::Divide, std::move(tmp2)));
+        auto phi = std::make_unique<ast::IntExpr>(ast::IntExpr(pos, 0));
+        auto lambda = std::make_unique<ast::PiExpr>(ast::PiExpr(pos));
+
+        return std::make_unique<ast::UGate>(
+            ast::UGate(pos, std::move(theta), std::move(phi), std::move(lambda),
+                       std::move(tgt)));
+    }
+
+    std::list<ast::ptr<ast::Gate>> generate_swapped_cnot(int i, int j,
+                                                         parser::Position pos) {
+        std::list<ast::ptr<ast::Gate>> result;
+        result.emplace_back(generate_hadamard(i, pos));
+        result.emplace_back(generate_hadamard(j, pos));
+        result.emplace_back(generate_cnot(j, i, pos));
+        result.emplace_back(generate_hadamard(i, pos));
+        result.emplace_back(generate_hadamard(j, pos));
+        return result;
+    }
+};
+
+/**
+ * \class staq::mapping::SabreDry
+ * \brief SABRE mapper dry run
+ * \note Utility class for optimizing over initial layouts
+ *
+ * Takes a copy of a program apart once, then replays the final routing pass
+ * of the SABRE mapper (without layout refinement) under a given placement.
+ * Logical qubits are numbered in the iteration order of the layout given at
+ * construction.
+ */
+class SabreDry {
+  public:
+    SabreDry(Device& device, ast::Program& prog, const layout& l)
+        : mapper_(device, dry_config()) {
+        auto copy = ast::object::clone(prog);
+        apply_layout(l, device, *copy);
+        mapper_.analyze(*copy);
+
+        for (auto& nd : mapper_.nodes_) {
+            if (nd.cnot)
+                cnots_++;
+        }
+        order_.resize(mapper_.nodes_.size());
+        for (std::size_t i = 0; i < order_.size(); i++)
+            order_[i] = static_cast<int>(i);
+        for (auto& [va, idx] : l)
+            registers_.push_back(idx);
+    }
+
+    /**
+     * \brief Dry-runs the SABRE mapper
+     * \param placement The physical qubit of each logical qubit
+     * \return The number of CNOT gates in the mapped circuit
+     */
+    int get_cnot_count(const std::vector<int>& placement) {
+        auto swaps = mapper_.route(order_, l2p(placement), nullptr).first;
+        return cnots_ + 3 * swaps;
+    }
+
+    /**
+     * \brief Dry-runs the SABRE mapper, reporting the mapped circuit
+     * \param placement The physical qubit of each logical qubit
+     * \param sink Receives the gates of the mapped circuit, in order
+     */
+    void replay(const std::vector<int>& placement, GateSink& sink) {
+        mapper_.route(order_, l2p(placement), nullptr, &sink);
+    }
+
+  private:
+    SabreMapper mapper_;
+    std::vector<int> order_;
+    std::vector<int> registers_; // register index of each logical qubit
+    int cnots_ = 0;
+
+    static SabreMapper::config dry_config() {
+        SabreMapper::config ret;
+        ret.layout_passes = 0;
+        return ret;
+    }
+
+    // Placement of the register indices, with the unused indices on the
+    // unused physical qubits
+    std::vector<int> l2p(const std::vector<int>& placement) const {
+        int n = mapper_.device_.qubits_;
+        std::vector<int> ret(n, -1);
+        std::vector<bool> used(n, false);
+        for (std::size_t q = 0; q < registers_.size(); q++) {
+            ret[registers_[q]] = placement[q];
+            used[placement[q]] = true;
+        }
+        int next = 0;
+        for (auto& p : ret) {
+            if (p == -1) {
+                while (used[next])
+                    next++;
+                p = next++;
+            }
+        }
+        return ret;
+    }
+};
+
+/**
+ * \brief Applies the SABRE mapper to an AST given a physical device
+ *
+ * The layout is updated with the refined initial placement
+ *
+ * \return The permutation of physical qubits from the initial to the final
+ * placement
+ */
+inline std::map<int, int>
+sabre_mapping(Device& device, ast::Program& prog, layout& init,
+              const SabreMapper::config& params = {}) {
+    SabreMapper mapper(device, params);
+    auto ret = mapper.run(prog);
+
+    auto& placement = mapper.initial_placement();
+    for (auto& [access, idx] : init)
+        idx = placement[idx];
+
+    return ret;
+}
+
+/** \brief Applies the SABRE mapper to an AST given a physical device */
+inline std::map<int, int>
+sabre_mapping(Device& device, ast::Program& prog,
+              const SabreMapper::config& params = {}) {
+    SabreMapper mapper(device, params);
+    return mapper.run(prog);
+}
+
+} // namespace mapping
+} // namespace staq
@@ -0,0 +1,265 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file mapping/mapping/sliced.hpp
+ * \brief Time-sliced parallel mapping
+ */
+
+#pragma once
+
+#include "tools/thread_pool.hpp"
+#include "mapping/mapping/swap.hpp"
+#include "mapping/mapping/steiner.hpp"
+
+#include <map>
+#include <vector>
+
+namespace staq {
+namespace mapping {
+
+namespace ast = qasmtools::ast;
+
+/**
+ * \class staq::mapping::SwapTracker
+ * \brief Replays the qubit movements of the swap mapper
+ * \note Utility class for sliced mapping
+ *
+ * Follows the permutation the swap mapper would hold after each statement,
+ * without generating any gates.
+ */
+class SwapTracker final : public ast::Traverse {
+  public:
+    SwapTracker(Device& device) : Traverse(), device_(device) {
+        position_.resize(device.qubits_);
+        occupant_.resize(device.qubits_);
+        for (auto i = 0; i < device.qubits_; i++) {
+            position_[i] = i;
+            occupant_[i] = i;
+        }
+    }
+
+    /** \brief The current permutation, as returned by the swap mapper */
+    std::map<int, int> permutation() const {
+        std::map<int, int> ret;
+        for (std::size_t i = 0; i < position_.size(); i++) {
+            ret[static_cast<int>(i)] = position_[i];
+        }
+        return ret;
+    }
+
+    void visit(ast::GateDecl&) override {}
+    void visit(ast::OracleDecl&) override {}
+
+    void visit(ast::CNOTGate& gate) override {
+        auto ctrl = current(gate.ctrl());
+        auto tgt = current(gate.tgt());
+
+        // Same path and swaps as SwapMapper::replace
+        auto i = ctrl;
+        for (auto j : device_.shortest_path(ctrl, tgt)) {
+            if (j == tgt) {
+                break;
+            } else if (j != i) {
+                std::swap(occupant_[i], occupant_[j]);
+                position_[occupant_[i]] = i;
+                position_[occupant_[j]] = j;
+            }
+            i = j;
+        }
+    }
+
+  private:
+    Device device_;
+    std::vector<int> position_; ///< current physical qubit of each initial one
+    std::vector<int> occupant_; ///< initial qubit at each physical qubit
+    SwapMapper::config config_;
+
+    int current(ast::VarAccess& va) {
+        if (!va.offset())
+            throw std::logic_error(
+                "Gate argument is not a register dereference!");
+        if (va.var() != config_.register_name)
+            return *va.offset();
+        return position_.at(*va.offset());
+    }
+};
+
+/**
+ * \class staq::mapping::SlicedMapper
+ * \brief Maps long circuits slice by slice on a thread pool
+ * \note Assumes the circuit has been inlined onto the single global register
+ * of the device, as for the serial mappers
+ *
+ * Cuts the program body into time slices of about config.slice_size
+ * statements, maps the slices concurrently with independent mappers and
+ * splices the results back in order.
+ *
+ * For the swap mapper, the layout at each slice boundary is predicted by
+ * replaying only the qubit movements of the mapper (see SwapTracker). The
+ * prediction is exact, so every slice starts from the permutation the
+ * previous one ends in, no permutation network is needed between slices and
+ * the output is the same as the serial mapper's.
+ *
+ * The Steiner mapper restarts from the identity after every synthesis point,
+ * so slices are cut where nothing but declarations follows one, again with
+ * the same output as the serial mapper. A slice with no such cut within
+ * twice the slice size is cut anyway, which splits a cnot-dihedral chunk in
+ * two. With partial flushing (config.steiner.partial_flush), a synthesis
+ * point only ends part of the pending chunk, and the end of a slice ends the
+ * rest of it. The output is then still correct, but chunks are split at the
+ * slice boundaries where the serial mapper would keep growing them.
+ */
+class SlicedMapper {
+  public:
+    /**
+     * \class staq::mapping::SlicedMapper::config
+     * \brief Holds configuration options
+     */
+    struct config {
+        int slice_size = 10000; ///< Statements per slice
+        int num_threads = 0;    ///< Workers, or 0 for the hardware concurrency
+        SteinerMapper::config steiner; ///< Options of the Steiner mappers
+    };
+
+    SlicedMapper(Device& device) : device_(device) {}
+    SlicedMapper(Device& device, const config& params)
+        : device_(device), config_(params) {}
+
+    /**
+     * \brief Applies the swap mapper slice by slice
+     * \return The output permutation, as for map_onto_device
+     */
+    std::map<int, int> run_swap(ast::Program& prog) {
+        warm_up();
+        auto slices = cut(prog, false);
+
+        // Predict the boundaries
+        std::vector<std::map<int, int>> starts;
+        SwapTracker tracker(device_);
+        for (auto& slice : slices) {
+            starts.push_back(tracker.permutation());
+            for (auto& stmt : slice->body()) {
+                stmt->accept(tracker);
+            }
+        }
+
+        std::vector<std::map<int, int>> ends(slices.size());
+        tools::ThreadPool pool(config_.num_threads);
+        pool.run(slices.size(), [this, &slices, &starts, &ends](std::size_t k,
+                                                                int) {
+            SwapMapper mapper(device_, starts[k]);
+            ends[k] = mapper.run(*slices[k]);
+        });
+
+        for (std::size_t k = 0; k + 1 < slices.size(); k++) {
+            if (ends[k] != starts[k + 1])
+                throw std::logic_error("Mispredicted slice boundary!");
+        }
+        splice(prog, slices);
+
+        return ends.empty() ? tracker.permutation() : ends.back();
+    }
+
+    /** \brief Applies the Steiner mapper slice by slice */
+    void run_steiner(ast::Program& prog) {
+        warm_up();
+        auto slices = cut(prog, true);
+
+        tools::ThreadPool pool(config_.num_threads);
+        pool.run(slices.size(), [this, &slices](std::size_t k, int) {
+            SteinerMapper mapper(device_, config_.steiner);
+            slices[k]->accept(mapper);
+        });
+
+        splice(prog, slices);
+    }
+
+  private:
+    Device device_;
+    config config_;
+
+    // Computes the all-pairs shortest paths once, before the device is
+    // copied into each mapper
+    void warm_up() {
+        if (device_.qubits_ > 0)
+            device_.shortest_path(0, 0);
+    }
+
+    // Moves the body of prog into slices
+    std::vector<ast::ptr<ast::Program>> cut(ast::Program& prog,
+                                            bool at_synthesis_points) {
+        auto size = static_cast<std::size_t>(std::max(1, config_.slice_size));
+        std::vector<ast::ptr<ast::Program>> ret;
+        auto& body = prog.body();
+        while (!body.empty()) {
+            ret.emplace_back(ast::Program::create(prog.pos(), false, {},
+                                                  prog.bits(), prog.qubits()));
+            auto& slice = ret.back()->body();
+
+            // Whether nothing was accumulated since the last synthesis point
+            bool clean = true;
+            for (std::size_t n = 0; !body.empty(); n++) {
+                auto& stmt = *body.front();
+                if (!at_synthesis_points ||
+                    SteinerMapper::synthesis_point(stmt))
+                    clean = true;
+                else if (!dynamic_cast<ast::Decl*>(&stmt))
+                    clean = false;
+                slice.splice(slice.end(), body, body.begin());
+                if ((n + 1 >= size && clean) || n + 1 >= 2 * size)
+                    break;
+            }
+        }
+        return ret;
+    }
+
+    // Moves the slices back into the body of prog
+    void splice(ast::Program& prog,
+                std::vector<ast::ptr<ast::Program>>& slices) {
+        for (auto& slice : slices) {
+            prog.body().splice(prog.body().end(), slice->body());
+        }
+    }
+};
+
+/** \brief Applies the swap mapper to an AST in parallel time slices */
+inline std::map<int, int>
+sliced_swap_mapping(Device& device, ast::Program& prog,
+                    const SlicedMapper::config& params = {}) {
+    SlicedMapper mapper(device, params);
+    return mapper.run_swap(prog);
+}
+
+/** \brief Applies the Steiner mapper to an AST in parallel time slices */
+inline void sliced_steiner_mapping(Device& device, ast::Program& prog,
+                                   const SlicedMapper::config& params = {}) {
+    SlicedMapper mapper(device, params);
+    mapper.run_steiner(prog);
+}
+
+} // namespace mapping
+} // namespace staq
@@ -36,7 +36,12 @@
 #include "synthesis/linear_reversible.hpp"
 #include "synthesis/cnot_dihedral.hpp"
 #include "mapping/device.hpp"
+#include "tools/thread_pool.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <numeric>
 #include <vector>
 
 namespace staq {
@@ -54,14 +59,24 @@ using namespace qasmtools;
  * and resynthesizing those using gray-synth (arXiv:1712.01859) extended
  * with a device dependent mapping technique based on Steiner trees
  * (arXiv:1904.01972)
+ *
+ * By default every gate other than a CNOT or a z-axis rotation ends the
+ * current chunk. With config.partial_flush, such a gate only ends the part
+ * of the chunk its qubits depend on, i.e. the qubits connected to them by
+ * the pending linear transformation or phases. The rest stays pending and
+ * keeps growing past the gate, which gives fewer, larger chunks.
  */
 class SteinerMapper final : public ast::Replacer {
   public:
     struct config {
         std::string register_name = "q";
+        /// Flush only the qubits a blocking gate depends on
+        bool partial_flush = false;
     };
 
-    SteinerMapper(Device& device) : Replacer(), device_(device) {
+    SteinerMapper(Device& device) : SteinerMapper(device, config{}) {}
+    SteinerMapper(Device& device, const config& params)
+        : Replacer(), device_(device), config_(params) {
         permutation_ = synthesis::linear_op<bool>(
             device.qubits_, std::vector<bool>(device.qubits_, false));
         for (auto i = 0; i < device.qubits_; i++) {
@@ -69,6 +84,33 @@ class SteinerMapper final : public ast::Replacer {
         }
     }
 
+    /**
+     * \brief Whether a statement triggers a synthesis event
+     *
+     * Mapping the statements following such a statement is independent of
+     * the ones before it, which is where sliced mapping cuts a program.
+     */
+    static bool synthesis_point(ast::Stmt& stmt) {
+        auto zero = [](ast::Expr& expr) {
+            auto val = expr.constant_eval();
+            return val && (*val == 0);
+        };
+
+        if (auto gate = dynamic_cast<ast::UGate*>(&stmt)) {
+            return !(zero(gate->theta()) && zero(gate->phi()));
+        } else if (auto gate = dynamic_cast<ast::DeclaredGate*>(&stmt)) {
+            auto name = gate->name();
+            return !(name == "rz" || name == "u1" || name == "z" ||
+                     name == "s" || name == "sdg" || name == "t" ||
+                     name == "tdg");
+        } else {
+            return dynamic_cast<ast::IfStmt*>(&stmt) ||
+                   dynamic_cast<ast::BarrierGate*>(&stmt) ||
+                   dynamic_cast<ast::MeasureStmt*>(&stmt) ||
+                   dynamic_cast<ast::ResetStmt*>(&stmt);
+        }
+    }
+
     // Ignore declarations if they were left in during inlining
     void visit(ast::GateDecl&) override {}
     void visit(ast::OracleDecl&) override {}
@@ -77,31 +119,9 @@ class SteinerMapper final : public ast::Replacer {
         Replacer::visit(prog);
 
         // Synthesize the last leg
-        for (auto& gate :
-             synthesis::gray_steiner(phases_, permutation_, device_)) {
-            std::visit(
-                utils::overloaded{
-                    [this, &prog](std::pair<int, int>& cx) {
-                        if (device_.coupled(cx.first, cx.second)) {
-                            prog.body().emplace_back(
-                                generate_cnot(cx.first, cx.second, prog.pos()));
-                        } else if (device_.coupled(cx.second, cx.first)) {
-                            auto swapped_cnot = generate_swapped_cnot(
-                                cx.first, cx.second, prog.pos());
-                            prog.body().insert(prog.body().end(),
-                                std::make_move_iterator(swapped_cnot.begin()),
-                                std::make_move_iterator(swapped_cnot.end()));
-                        } else {
-                            throw std::logic_error(
-                                "CNOT between non-coupled vertices!");
-                        }
-                    },
-                    [this, &prog](std::pair<ast::ptr<ast::Expr>, int>& rz) {
-                        prog.body().emplace_back(generate_rz(
-                            std::move(rz.first), rz.second, prog.pos()));
-                    }},
-                gate);
-        }
+        for (auto& stmt :
+             synthesize<ast::Stmt>(phases_, permutation_, prog.pos()))
+            prog.body().emplace_back(std::move(stmt));
     }
 
     std::optional<std::list<ast::ptr<ast::Gate>>>
@@ -135,7 +155,7 @@ class SteinerMapper final : public ast::Replacer {
 
             return std::list<ast::ptr<ast::Gate>>();
         } else {
-            return flush<ast::Gate>(gate);
+            return flush<ast::Gate>(gate, {gate.arg()});
         }
     }
     std::optional<std::list<ast::ptr<ast::Gate>>>
@@ -214,7 +234,7 @@ class SteinerMapper final : public ast::Replacer {
 
             return std::list<ast::ptr<ast::Gate>>();
         } else {
-            return flush<ast::Gate>(gate);
+            return flush<ast::Gate>(gate, gate.qargs());
         }
     }
 
@@ -225,15 +245,15 @@ class SteinerMapper final : public ast::Replacer {
     }
     std::optional<std::list<ast::ptr<ast::Gate>>>
     replace(ast::BarrierGate& stmt) override {
-        return flush<ast::Gate>(stmt);
+        return flush<ast::Gate>(stmt, stmt.args());
     }
     std::optional<std::list<ast::ptr<ast::Stmt>>>
     replace(ast::MeasureStmt& stmt) override {
-        return flush<ast::Stmt>(stmt);
+        return flush<ast::Stmt>(stmt, {stmt.q_arg()});
     }
     std::optional<std::list<ast::ptr<ast::Stmt>>>
     replace(ast::ResetStmt& stmt) override {
-        return flush<ast::Stmt>(stmt);
+        return flush<ast::Stmt>(stmt, {stmt.arg()});
     }
 
   private:
@@ -258,24 +278,24 @@ class SteinerMapper final : public ast::Replacer {
         phases_.push_back(std::make_pair(parity, std::move(angle)));
     }
 
-    // Flushes a cnot-dihedral operator (i.e. phases + permutation) to the
-    // circuit before the given node
+    // Synthesizes a cnot-dihedral operator (i.e. phases + permutation)
     template <typename T>
-    std::list<ast::ptr<T>> flush(T& node) {
+    std::list<ast::ptr<T>> synthesize(std::list<synthesis::phase_term>& phases,
+                                      synthesis::linear_op<bool>& permutation,
+                                      parser::Position pos) {
         std::list<ast::ptr<T>> ret;
 
-        // Synthesize circuit
         for (auto& gate :
-             synthesis::gray_steiner(phases_, permutation_, device_)) {
+             synthesis::gray_steiner(phases, permutation, device_)) {
             std::visit(
                 utils::overloaded{
-                    [&ret, this, &node](std::pair<int, int>& cx) {
+                    [&ret, this, &pos](std::pair<int, int>& cx) {
                         if (device_.coupled(cx.first, cx.second)) {
                             ret.emplace_back(
-                                generate_cnot(cx.first, cx.second, node.pos()));
+                                generate_cnot(cx.first, cx.second, pos));
                         } else if (device_.coupled(cx.second, cx.first)) {
-                            auto swapped_cnot = generate_swapped_cnot(
-                                cx.first, cx.second, node.pos());
+                            auto swapped_cnot =
+                                generate_swapped_cnot(cx.first, cx.second, pos);
                             ret.insert(ret.end(),
                                 std::make_move_iterator(swapped_cnot.begin()),
                                 std::make_move_iterator(swapped_cnot.end()));
@@ -285,12 +305,21 @@ class SteinerMapper final : public ast::Replacer {
                         }
                     },
                     [&ret, this,
-                     &node](std::pair<ast::ptr<ast::Expr>, int>& rz) {
-                        ret.emplace_back(generate_rz(std::move(rz.first),
-                                                     rz.second, node.pos()));
+                     &pos](std::pair<ast::ptr<ast::Expr>, int>& rz) {
+                        ret.emplace_back(
+                            generate_rz(std::move(rz.first), rz.second, pos));
                     }},
                 gate);
         }
+
+        return ret;
+    }
+
+    // Flushes a cnot-dihedral operator (i.e. phases + permutation) to the
+    // circuit before the given node
+    template <typename T>
+    std::list<ast::ptr<T>> flush(T& node) {
+        auto ret = synthesize<T>(phases_, permutation_, node.pos());
         ret.emplace_back(ast::object::clone(node));
 
         // Reset the cnot-dihedral circuit
@@ -304,6 +333,29 @@ class SteinerMapper final : public ast::Replacer {
         return ret;
     }
 
+    // Flushes the part of the cnot-dihedral operator the arguments of the
+    // given node depend on, or all of it if partial flushing is disabled
+    template <typename T>
+    std::list<ast::ptr<T>> flush(T& node, std::vector<ast::VarAccess> args) {
+        if (!config_.partial_flush)
+            return flush(node);
+
+        std::vector<int> wires;
+        for (auto& arg : args) {
+            auto idx = get_index(arg);
+            if (!in_bounds(idx))
+                throw std::logic_error("Gate argument out of device bounds!");
+            wires.push_back(idx);
+        }
+
+        auto [phases, permutation] =
+            synthesis::split_dependent(phases_, permutation_, wires);
+        auto ret = synthesize<T>(phases, permutation, node.pos());
+        ret.emplace_back(ast::object::clone(node));
+
+        return ret;
+    }
+
     bool in_bounds(int i) { return 0 <= i && i < device_.qubits_; }
 
     bool is_zero(ast::Expr& expr) {
@@ -366,6 +418,18 @@ class SteinerMapper final : public ast::Replacer {
     }
 };
 
+/**
+ * \brief A CNOT-dihedral chunk of a program over a subset of logical qubits
+ *
+ * The matrix and parities are indexed by position in qubits, so that the
+ * chunk can be placed on the device under any layout.
+ */
+struct steiner_chunk {
+    std::vector<int> qubits;                ///< Logical qubits, increasing
+    synthesis::linear_op<bool> matrix;      ///< Linear part of the chunk
+    std::list<std::vector<bool>> parities;  ///< Parities of the phase terms
+};
+
 /**
  * \class staq::mapping::SteinerDry
  * \brief Steiner mapper dry run
@@ -373,7 +437,8 @@ class SteinerMapper final : public ast::Replacer {
  *
  * Does a dry run of the Steiner mapping algorithm (i.e. doesn't actually
  * change the ast) with a particular layout and collects information about
- * the number of CNOT gates the synthesized circuit would use.
+ * the number of CNOT gates the synthesized circuit would use, or reports the
+ * gates of the synthesized circuit.
  */
 class SteinerDry final : public ast::Traverse {
   public:
@@ -392,6 +457,59 @@ class SteinerDry final : public ast::Traverse {
         return cnots_;
     }
 
+    /**
+     * \brief Dry-runs the Steiner mapper, reporting the mapped circuit
+     * \param prog The (unmapped) program
+     * \param l The layout
+     * \param sink Receives the gates of the mapped circuit, in order
+     */
+    void replay(ast::Program& prog, const layout& l, GateSink& sink) {
+        sink_ = &sink;
+        get_cnot_count(prog, l);
+        sink_ = nullptr;
+    }
+
+    /**
+     * \brief Dry-runs a single chunk of a SteinerChunks decomposition
+     * \param chunk The chunk
+     * \param placement The physical qubit of each logical qubit
+     * \return The number of CNOT gates synthesized for the chunk
+     */
+    int get_cnot_count(const steiner_chunk& chunk,
+                       const std::vector<int>& placement) {
+        cnots_ = 0;
+
+        auto k = chunk.qubits.size();
+        for (std::size_t a = 0; a < k; a++) {
+            auto row = placement[chunk.qubits[a]];
+            if (!in_bounds(row)) {
+                throw std::logic_error("Qubit placed out of device bounds!");
+            }
+            for (std::size_t b = 0; b < k; b++) {
+                permutation_[row][placement[chunk.qubits[b]]] =
+                    chunk.matrix[a][b];
+            }
+        }
+        for (auto& parity : chunk.parities) {
+            std::vector<bool> vec(device_.qubits_, false);
+            for (std::size_t a = 0; a < k; a++) {
+                vec[placement[chunk.qubits[a]]] = parity[a];
+            }
+            phases_.emplace_back(std::move(vec), nullptr);
+        }
+
+        // Only the chunk's rows and columns were set, so only those need to
+        // be reset to the identity
+        count_cnots();
+        for (std::size_t a = 0; a < k; a++) {
+            auto row = placement[chunk.qubits[a]];
+            for (std::size_t b = 0; b < k; b++) {
+                permutation_[row][placement[chunk.qubits[b]]] = a == b;
+            }
+        }
+        return cnots_;
+    }
+
     void visit(ast::GateDecl&) override {}
     void visit(ast::OracleDecl&) override {}
 
@@ -399,30 +517,7 @@ class SteinerDry final : public ast::Traverse {
         Traverse::visit(prog);
 
         // Synthesize the last leg
-        for (auto& gate :
-             synthesis::gray_steiner(phases_, permutation_, device_)) {
-            std::visit(
-                utils::overloaded{
-                    [this, &prog](std::pair<int, int>& cx) {
-                        if (device_.coupled(cx.first, cx.second) ||
-                            device_.coupled(cx.second, cx.first)) {
-                            cnots_++;
-                        } else {
-                            throw std::logic_error(
-                                "CNOT between non-coupled vertices!");
-                        }
-                    },
-                    [this, &prog](std::pair<ast::ptr<ast::Expr>, int>& rz) {}},
-                gate);
-        }
-
-        // Reset the cnot-dihedral circuit
-        phases_.clear();
-        for (auto i = 0; i < device_.qubits_; i++) {
-            for (auto j = 0; j < device_.qubits_; j++) {
-                permutation_[i][j] = i == j ? true : false;
-            }
-        }
+        synthesize();
     }
 
     void visit(ast::CNOTGate& gate) override {
@@ -451,6 +546,8 @@ class SteinerDry final : public ast::Traverse {
 
         } else {
             flush<ast::Gate>(gate);
+            if (sink_)
+                sink_->u(layout_[gate.arg()]);
         }
     }
 
@@ -527,7 +624,9 @@ class SteinerDry final : public ast::Traverse {
         return flush<ast::Gate>(stmt);
     }
     void visit(ast::MeasureStmt& stmt) override {
-        return flush<ast::Stmt>(stmt);
+        flush<ast::Stmt>(stmt);
+        if (sink_)
+            sink_->measure(layout_[stmt.q_arg()]);
     }
     void visit(ast::ResetStmt& stmt) override { return flush<ast::Stmt>(stmt); }
 
@@ -535,6 +634,7 @@ class SteinerDry final : public ast::Traverse {
     Device device_;
     layout layout_;
     int cnots_ = 0;
+    GateSink* sink_ = nullptr;
 
     // Accumulating data
     std::list<synthesis::phase_term> phases_;
@@ -550,38 +650,241 @@ class SteinerDry final : public ast::Traverse {
         phases_.push_back(std::make_pair(parity, std::move(angle)));
     }
 
-    // Flushes a cnot-dihedral operator (i.e. phases + permutation) to the
-    // circuit before the given node
-    template <typename T>
-    void flush(T& node) {
-        // Synthesize circuit
+    // Counts the CNOTs needed for the accumulated cnot-dihedral operator
+    // (i.e. phases + permutation) and resets it
+    void synthesize() {
+        count_cnots();
+        for (auto i = 0; i < device_.qubits_; i++) {
+            for (auto j = 0; j < device_.qubits_; j++) {
+                permutation_[i][j] = i == j ? true : false;
+            }
+        }
+    }
+
+    // Counts the CNOTs needed for the accumulated cnot-dihedral operator and
+    // clears its phases, leaving the permutation to the caller
+    void count_cnots() {
         for (auto& gate :
              synthesis::gray_steiner(phases_, permutation_, device_)) {
             std::visit(
                 utils::overloaded{
-                    [this, &node](std::pair<int, int>& cx) {
-                        if (device_.coupled(cx.first, cx.second) ||
-                            device_.coupled(cx.second, cx.first)) {
-                            cnots_++;
+                    [this](std::pair<int, int>& cx) {
+                        auto [i, j] = cx;
+                        if (device_.coupled(i, j)) {
+                            if (sink_)
+                                sink_->cnot(i, j);
+                        } else if (device_.coupled(j, i)) {
+                            if (sink_) {
+                                sink_->u(i);
+                                sink_->u(j);
+                                sink_->cnot(j, i);
+                                sink_->u(i);
+                                sink_->u(j);
+                            }
                         } else {
                             throw std::logic_error(
                                 "CNOT between non-coupled vertices!");
                         }
+                        cnots_++;
                     },
-                    [this, &node](std::pair<ast::ptr<ast::Expr>, int>& rz) {}},
+                    [this](std::pair<ast::ptr<ast::Expr>, int>& rz) {
+                        if (sink_)
+                            sink_->u(rz.second);
+                    }},
                 gate);
         }
 
-        // Reset the cnot-dihedral circuit
         phases_.clear();
-        for (auto i = 0; i < device_.qubits_; i++) {
-            for (auto j = 0; j < device_.qubits_; j++) {
-                permutation_[i][j] = i == j ? true : false;
+    }
+
+    // Flushes a cnot-dihedral operator (i.e. phases + permutation) to the
+    // circuit before the given node
+    template <typename T>
+    void flush(T&) {
+        synthesize();
+    }
+
+    bool in_bounds(int i) { return 0 <= i && i < device_.qubits_; }
+
+    bool is_zero(ast::Expr& expr) {
+        auto val = expr.constant_eval();
+        return val && (*val == 0);
+    }
+};
+
+/**
+ * \class staq::mapping::SteinerChunks
+ * \brief Layout-independent decomposition of a program for SteinerDry
+ * \note Utility class for optimizing over initial layouts
+ *
+ * Splits a program into the CNOT-dihedral chunks the Steiner mapper
+ * synthesizes between two synthesis events, expressed over the logical qubits
+ * of a layout. The CNOT count of a chunk only depends on where its own qubits
+ * are placed, so after moving a few qubits only the chunks containing them
+ * need to be dry-run again. Chunks which synthesize to no CNOT gates under any
+ * layout (i.e. single-qubit phases only) are dropped.
+ */
+class SteinerChunks final : public ast::Traverse {
+  public:
+    /**
+     * \brief Decomposes a program
+     * \param prog The (unmapped) program
+     * \param l A layout of the program, which fixes the logical qubits
+     */
+    SteinerChunks(ast::Program& prog, const layout& l) : Traverse() {
+        for (auto& [va, idx] : l) {
+            index_[va] = static_cast<int>(qubits_.size());
+            qubits_.push_back(va);
+        }
+        rows_.resize(qubits_.size());
+        in_chunk_.resize(qubits_.size(), false);
+        chunks_of_.resize(qubits_.size());
+        prog.accept(*this);
+    }
+
+    /** \brief The number of logical qubits */
+    std::size_t num_qubits() const { return qubits_.size(); }
+    /** \brief The access of the given logical qubit */
+    const ast::VarAccess& qubit(int q) const { return qubits_[q]; }
+    /** \brief The chunks of the program */
+    const std::vector<steiner_chunk>& chunks() const { return chunks_; }
+    /** \brief Indices of the chunks containing a logical qubit, increasing */
+    const std::vector<int>& chunks_of(int q) const { return chunks_of_[q]; }
+
+    /** \brief The physical qubit of each logical qubit under a layout */
+    std::vector<int> placement(const layout& l) const {
+        std::vector<int> ret;
+        for (auto& va : qubits_) {
+            auto it = l.find(va);
+            if (it == l.end()) {
+                throw std::logic_error("Qubit missing from layout!");
             }
+            ret.push_back(it->second);
         }
+        return ret;
     }
 
-    bool in_bounds(int i) { return 0 <= i && i < device_.qubits_; }
+    void visit(ast::GateDecl&) override {}
+    void visit(ast::OracleDecl&) override {}
+
+    void visit(ast::Program& prog) override {
+        Traverse::visit(prog);
+        flush();
+    }
+
+    void visit(ast::CNOTGate& gate) override {
+        auto ctrl = touch(gate.ctrl());
+        auto tgt = touch(gate.tgt());
+        synthesis::operator^=(rows_[tgt], rows_[ctrl]);
+    }
+
+    void visit(ast::UGate& gate) override {
+        if (is_zero(gate.theta()) && is_zero(gate.phi())) {
+            add_phase(touch(gate.arg()));
+        } else {
+            flush();
+        }
+    }
+
+    void visit(ast::DeclaredGate& gate) override {
+        auto name = gate.name();
+
+        if (name == "rz" || name == "u1" || name == "z" || name == "s" ||
+            name == "sdg" || name == "t" || name == "tdg") {
+            add_phase(touch(gate.qarg(0)));
+        } else {
+            flush();
+        }
+    }
+
+    // Always generate a synthesis event
+    void visit(ast::IfStmt&) override { flush(); }
+    void visit(ast::BarrierGate&) override { flush(); }
+    void visit(ast::MeasureStmt&) override { flush(); }
+    void visit(ast::ResetStmt&) override { flush(); }
+
+  private:
+    std::vector<ast::VarAccess> qubits_;
+    std::unordered_map<ast::VarAccess, int> index_;
+    std::vector<steiner_chunk> chunks_;
+    std::vector<std::vector<int>> chunks_of_;
+
+    // Current chunk, over all logical qubits. Only the rows of qubits in
+    // touched_ are meaningful
+    std::vector<std::vector<bool>> rows_;
+    std::vector<bool> in_chunk_;
+    std::vector<int> touched_;
+    std::list<std::vector<bool>> phases_;
+
+    int touch(const ast::VarAccess& va) {
+        auto it = index_.find(va);
+        if (it == index_.end()) {
+            throw std::logic_error("Qubit missing from layout!");
+        }
+
+        auto q = it->second;
+        if (!in_chunk_[q]) {
+            in_chunk_[q] = true;
+            touched_.push_back(q);
+            rows_[q].assign(qubits_.size(), false);
+            rows_[q][q] = true;
+        }
+        return q;
+    }
+
+    void add_phase(int q) {
+        for (auto& parity : phases_) {
+            if (parity == rows_[q]) {
+                return;
+            }
+        }
+        phases_.push_back(rows_[q]);
+    }
+
+    void flush() {
+        // Identity with single-qubit phases only
+        bool trivial = true;
+        for (auto q : touched_) {
+            for (auto r : touched_) {
+                if (rows_[q][r] != (q == r)) {
+                    trivial = false;
+                }
+            }
+        }
+        for (auto& parity : phases_) {
+            if (std::count(parity.begin(), parity.end(), true) > 1) {
+                trivial = false;
+            }
+        }
+
+        if (!trivial) {
+            steiner_chunk chunk;
+            chunk.qubits = touched_;
+            std::sort(chunk.qubits.begin(), chunk.qubits.end());
+            for (auto q : chunk.qubits) {
+                std::vector<bool> row;
+                for (auto r : chunk.qubits) {
+                    row.push_back(rows_[q][r]);
+                }
+                chunk.matrix.push_back(row);
+                chunks_of_[q].push_back(static_cast<int>(chunks_.size()));
+            }
+            for (auto& parity : phases_) {
+                std::vector<bool> vec;
+                for (auto r : chunk.qubits) {
+                    vec.push_back(parity[r]);
+                }
+                chunk.parities.push_back(vec);
+            }
+            chunks_.push_back(std::move(chunk));
+        }
+
+        for (auto q : touched_) {
+            in_chunk_[q] = false;
+        }
+        touched_.clear();
+        phases_.clear();
+    }
 
     bool is_zero(ast::Expr& expr) {
         auto val = expr.constant_eval();
@@ -589,33 +892,169 @@ class SteinerDry final : public ast::Traverse {
     }
 };
 
+/**
+ * \brief Strategies for the Steiner layout hill climb
+ *
+ * restart takes the first improving swap and rescans from the first
+ * candidate, cyclic takes the first improving swap and resumes the scan from
+ * the next candidate, best takes the best swap of a full scan.
+ */
+enum class layout_search_strategy { restart, cyclic, best };
+
+/**
+ * \brief Options for the Steiner layout optimization
+ *
+ * A budget of 0 means unlimited. The search is deterministic and independent
+ * of the number of threads unless it is cut short by the time budget.
+ */
+struct layout_search_config {
+    int num_threads = 0; ///< Worker threads, 0 for all cores
+    layout_search_strategy search = layout_search_strategy::restart;
+    int max_iterations = 0; ///< Maximum number of accepted swaps
+    int time_budget_ms = 0; ///< Wall-clock budget in milliseconds
+};
+
 /**
  * \brief Layout optimization for the Steiner mapper via hill climb
  *
  * Repeatedly performs dry-runs, modifying the qubit mapping with a
- * single swap each time.
+ * single swap each time. The program is decomposed into chunks once, and a
+ * swap only dry-runs the chunks containing the two swapped qubits. Candidate
+ * swaps are evaluated in parallel, each worker thread using its own
+ * SteinerDry instance.
+ *
+ * By default the first improving swap is taken and the scan restarts from
+ * the first candidate, which gives the same layout as a sequential search.
+ * With the cyclic strategy the scan instead resumes from the next candidate.
+ * Either way the search stops after a full scan without improvement. With
+ * the best strategy every candidate is evaluated and the best one taken, ties
+ * going to the earliest candidate.
  */
-void optimize_steiner_layout(Device& device, layout& init, ast::Program& prog) {
-    SteinerDry alg(device);
-    int current_min = alg.get_cnot_count(prog, init);
-
-outer:
-    for (auto it = init.begin(); it != init.end(); it++) {
-        for (auto ti = std::next(it); ti != init.end(); ti++) {
-            std::swap(it->second, ti->second);
-            auto cnot_count = alg.get_cnot_count(prog, init);
-            if (cnot_count < current_min) {
-                current_min = cnot_count;
-                goto outer;
+inline void optimize_steiner_layout(Device& device, layout& init,
+                                    ast::Program& prog,
+                                    const layout_search_config& config = {}) {
+    using clock = std::chrono::steady_clock;
+    auto deadline =
+        clock::now() + std::chrono::milliseconds(config.time_budget_ms);
+    auto out_of_time = [&config, &deadline]() {
+        return config.time_budget_ms > 0 && clock::now() >= deadline;
+    };
+
+    SteinerChunks chunks(prog, init);
+    auto placement = chunks.placement(init);
+
+    // Candidate swaps, as pairs of logical qubits
+    std::vector<std::pair<int, int>> candidates;
+    for (std::size_t i = 0; i < chunks.num_qubits(); i++) {
+        for (std::size_t j = i + 1; j < chunks.num_qubits(); j++) {
+            candidates.emplace_back(i, j);
+        }
+    }
+    if (candidates.empty())
+        return;
+
+    tools::ThreadPool pool(config.num_threads);
+    std::vector<SteinerDry> algs;
+    for (int i = 0; i < pool.size(); i++) {
+        algs.emplace_back(device);
+    }
+
+    // Dry-runs the given chunks under the current placement
+    std::vector<int> chunk_costs(chunks.chunks().size());
+    auto update_costs = [&](const std::vector<int>& affected) {
+        pool.run(affected.size(), [&](std::size_t k, int worker) {
+            auto c = affected[k];
+            chunk_costs[c] =
+                algs[worker].get_cnot_count(chunks.chunks()[c], placement);
+        });
+    };
+    auto affected_by = [&chunks](int i, int j) {
+        std::vector<int> ret;
+        std::set_union(chunks.chunks_of(i).begin(), chunks.chunks_of(i).end(),
+                       chunks.chunks_of(j).begin(), chunks.chunks_of(j).end(),
+                       std::back_inserter(ret));
+        return ret;
+    };
+
+    std::vector<int> all(chunk_costs.size());
+    std::iota(all.begin(), all.end(), 0);
+    update_costs(all);
+    int current_min =
+        std::accumulate(chunk_costs.begin(), chunk_costs.end(), 0);
+    int iterations = 0;
+
+    // Dry-runs the candidates first, ..., first + count - 1 (cyclically)
+    std::vector<int> costs;
+    auto evaluate = [&](std::size_t first, std::size_t count) {
+        costs.assign(count, 0);
+        pool.run(count, [&](std::size_t k, int worker) {
+            auto [i, j] = candidates[(first + k) % candidates.size()];
+            auto trial = placement;
+            std::swap(trial[i], trial[j]);
+
+            int cost = current_min;
+            for (auto c : affected_by(i, j)) {
+                cost += algs[worker].get_cnot_count(chunks.chunks()[c], trial) -
+                        chunk_costs[c];
+            }
+            costs[k] = cost;
+        });
+    };
+    auto accept = [&](std::size_t idx, int cost) {
+        auto [i, j] = candidates[idx];
+        std::swap(placement[i], placement[j]);
+        update_costs(affected_by(i, j));
+        current_min = cost;
+        iterations++;
+        return config.max_iterations > 0 &&
+               iterations >= config.max_iterations;
+    };
+
+    if (config.search == layout_search_strategy::best) {
+        while (!out_of_time()) {
+            evaluate(0, candidates.size());
+            auto best = std::min_element(costs.begin(), costs.end());
+            if (*best >= current_min || accept(best - costs.begin(), *best))
+                break;
+        }
+    } else {
+        // Batches of one candidate per worker keep the result identical to
+        // a sequential scan
+        std::size_t batch = pool.size();
+        std::size_t pos = 0;
+        std::size_t unimproved = 0;
+        while (unimproved < candidates.size() && !out_of_time()) {
+            auto count = std::min(batch, candidates.size() - unimproved);
+            evaluate(pos, count);
+            auto better = std::find_if(costs.begin(), costs.end(),
+                                       [current_min](int cost) {
+                                           return cost < current_min;
+                                       });
+            if (better == costs.end()) {
+                pos = (pos + count) % candidates.size();
+                unimproved += count;
+            } else {
+                auto k = static_cast<std::size_t>(better - costs.begin());
+                if (accept((pos + k) % candidates.size(), *better))
+                    break;
+                if (config.search == layout_search_strategy::cyclic)
+                    pos = (pos + k + 1) % candidates.size();
+                else
+                    pos = 0;
+                unimproved = 0;
             }
-            std::swap(it->second, ti->second);
         }
     }
+
+    for (std::size_t q = 0; q < chunks.num_qubits(); q++) {
+        init[chunks.qubit(q)] = placement[q];
+    }
 }
 
 /** \brief Applies the Steiner mapper to an AST given a physical device */
-void steiner_mapping(Device& device, ast::Program& prog) {
-    SteinerMapper mapper(device);
+inline void steiner_mapping(Device& device, ast::Program& prog,
+                            const SteinerMapper::config& params = {}) {
+    SteinerMapper mapper(device, params);
     prog.accept(mapper);
 }
 } // namespace mapping
@@ -32,10 +32,13 @@
 #pragma once
 
 #include "qasmtools/ast/replacer.hpp"
+#include "qasmtools/ast/traversal.hpp"
 #include "transformations/substitution.hpp"
 #include "mapping/device.hpp"
 
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 // TODO: figure out what to do with if statements
 
@@ -67,6 +70,13 @@ class SwapMapper final : public ast::Replacer {
         }
     }
 
+    /**
+     * \brief Starts from a given qubit permutation
+     * \param permutation The current physical qubit of each initial one
+     */
+    SwapMapper(Device& device, const std::map<int, int>& permutation)
+        : Replacer(), device_(device), permutation_(permutation) {}
+
     std::map<int, int> run(ast::Program& prog) {
         prog.accept(*this);
         return permutation_;
@@ -196,8 +206,154 @@ class SwapMapper final : public ast::Replacer {
     }
 };
 
+/**
+ * \class staq::mapping::SwapDry
+ * \brief Swap mapper dry run
+ * \note Utility class for optimizing over initial layouts
+ *
+ * Collects the CNOT gates, U gates and measurements of a program once, then
+ * replays the swap mapper on them under a given placement without touching
+ * the AST. Logical qubits are numbered in the iteration order of the layout
+ * given at construction.
+ */
+class SwapDry final : public ast::Traverse {
+  public:
+    SwapDry(Device& device, ast::Program& prog, const layout& l)
+        : Traverse(), device_(device) {
+        int n = 0;
+        for (auto& [va, idx] : l) {
+            index_[va] = n++;
+        }
+        prog.accept(*this);
+    }
+
+    /**
+     * \brief Dry-runs the swap mapper
+     * \param placement The physical qubit of each logical qubit
+     * \return The number of CNOT gates in the mapped circuit
+     */
+    int get_cnot_count(const std::vector<int>& placement) {
+        return replay(placement, nullptr);
+    }
+
+    /**
+     * \brief Dry-runs the swap mapper, reporting the mapped circuit
+     * \param placement The physical qubit of each logical qubit
+     * \param sink Receives the gates of the mapped circuit, in order
+     */
+    void replay(const std::vector<int>& placement, GateSink& sink) {
+        replay(placement, &sink);
+    }
+
+    void visit(ast::GateDecl&) override {}
+    void visit(ast::OracleDecl&) override {}
+
+    void visit(ast::CNOTGate& gate) override {
+        gates_.push_back({gate_kind::cnot, index(gate.ctrl()),
+                          index(gate.tgt())});
+    }
+    void visit(ast::UGate& gate) override {
+        gates_.push_back({gate_kind::u, index(gate.arg()), -1});
+    }
+    void visit(ast::MeasureStmt& stmt) override {
+        gates_.push_back({gate_kind::measure, index(stmt.q_arg()), -1});
+    }
+
+  private:
+    enum class gate_kind { cnot, u, measure };
+    struct gate {
+        gate_kind kind;
+        int q1, q2;
+    };
+
+    Device device_;
+    std::unordered_map<ast::VarAccess, int> index_;
+    std::vector<gate> gates_;
+
+    int index(const ast::VarAccess& va) const {
+        auto it = index_.find(va);
+        if (it == index_.end()) {
+            throw std::logic_error("Qubit missing from layout!");
+        }
+        return it->second;
+    }
+
+    // Follows SwapMapper, gate for gate if sink is non-null
+    int replay(const std::vector<int>& placement, GateSink* sink) {
+        auto position = placement;
+        std::vector<int> occupant(device_.qubits_, -1);
+        for (std::size_t q = 0; q < position.size(); q++) {
+            occupant[position[q]] = static_cast<int>(q);
+        }
+
+        // A CNOT, reversed with Hadamard gates if not coupled that way
+        auto cnot = [this, sink](int i, int j) {
+            if (!sink)
+                return;
+            if (device_.coupled(i, j)) {
+                sink->cnot(i, j);
+            } else {
+                sink->u(i);
+                sink->u(j);
+                sink->cnot(j, i);
+                sink->u(i);
+                sink->u(j);
+            }
+        };
+
+        int ret = 0;
+        for (auto& [kind, q1, q2] : gates_) {
+            if (kind == gate_kind::u) {
+                if (sink)
+                    sink->u(position[q1]);
+                continue;
+            } else if (kind == gate_kind::measure) {
+                if (sink)
+                    sink->measure(position[q1]);
+                continue;
+            }
+
+            auto i = position[q1];
+            auto j = position[q2];
+            path cnot_chain = device_.shortest_path(i, j);
+            if (cnot_chain.back() != j) {
+                throw std::logic_error("No path between physical qubits");
+            }
+
+            // Move the control next to the target
+            for (auto k : cnot_chain) {
+                if (k == j) {
+                    cnot(i, j);
+                    ret += 1;
+                    break;
+                } else if (k != i) {
+                    auto swap_i = i;
+                    auto swap_j = k;
+                    if (!device_.coupled(i, k))
+                        std::swap(swap_i, swap_j);
+                    if (sink) {
+                        sink->cnot(swap_i, swap_j);
+                        cnot(swap_j, swap_i);
+                        sink->cnot(swap_i, swap_j);
+                    }
+
+                    std::swap(occupant[i], occupant[k]);
+                    if (occupant[i] != -1)
+                        position[occupant[i]] = i;
+                    if (occupant[k] != -1)
+                        position[occupant[k]] = k;
+                    ret += 3;
+                }
+                i = k;
+            }
+        }
+        return ret;
+    }
+};
+
 /** \brief Applies the swap mapper to an AST given a physical device */
-std::map<int, int> map_onto_device(Device& device, ast::Program& prog) {
+inline std::map<int, int> map_onto_device(Device& device,
+                                          ast::Program& prog) {
     SwapMapper mapper(device);
     return mapper.run(prog);
 }
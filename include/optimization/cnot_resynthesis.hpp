@@ -48,10 +48,19 @@ using namespace qasmtools;
 /**
  * \class staq::optimization::CNOTResynthesizer
  * \brief CNOT optimization algorithm based on arXiv:1712.01859
+ *
+ * With config.partial_flush, a gate other than a CNOT or a z-axis rotation
+ * only re-synthesizes the part of the current cnot-dihedral chunk its qubits
+ * depend on, rather than the whole chunk.
  */
 class CNOTOptimizer final : public ast::Replacer {
   public:
-    struct config {};
+    struct config {
+        bool partial_flush = false; ///< Flush only the qubits a gate depends on
+        /// Synthesis of the linear part of each chunk
+        synthesis::linear_synthesizer linear_synthesis =
+            synthesis::linear_synthesizer::gauss_jordan;
+    };
 
     CNOTOptimizer() = default;
     CNOTOptimizer(const config& params) : Replacer(), config_(params) {}
@@ -65,13 +74,13 @@ class CNOTOptimizer final : public ast::Replacer {
     /* Statements */
     std::optional<std::list<ast::ptr<ast::Stmt>>>
     replace(ast::MeasureStmt& stmt) override {
-        auto tmp = flush<ast::Stmt>();
+        auto tmp = flush<ast::Stmt>({stmt.q_arg()});
         tmp.emplace_back(ast::object::clone(stmt));
         return std::move(tmp);
     }
     std::optional<std::list<ast::ptr<ast::Stmt>>>
     replace(ast::ResetStmt& stmt) override {
-        auto tmp = flush<ast::Stmt>();
+        auto tmp = flush<ast::Stmt>({stmt.arg()});
         tmp.emplace_back(ast::object::clone(stmt));
         return std::move(tmp);
     }
@@ -95,7 +104,7 @@ class CNOTOptimizer final : public ast::Replacer {
             // Delete the gate
             return std::list<ast::ptr<ast::Gate>>();
         } else {
-            auto tmp = flush<ast::Gate>();
+            auto tmp = flush<ast::Gate>({gate.arg()});
             tmp.emplace_back(ast::object::clone(gate));
             return std::move(tmp);
         }
@@ -113,7 +122,7 @@ class CNOTOptimizer final : public ast::Replacer {
     }
     std::optional<std::list<ast::ptr<ast::Gate>>>
     replace(ast::BarrierGate& gate) override {
-        auto tmp = flush<ast::Gate>();
+        auto tmp = flush<ast::Gate>(gate.args());
         tmp.emplace_back(ast::object::clone(gate));
         return std::move(tmp);
     }
@@ -162,7 +171,7 @@ class CNOTOptimizer final : public ast::Replacer {
                       ast::angle_to_expr(-utils::angles::pi_quarter));
             return std::list<ast::ptr<ast::Gate>>();
         } else {
-            auto tmp = flush<ast::Gate>();
+            auto tmp = flush<ast::Gate>(gate.qargs());
             tmp.emplace_back(ast::object::clone(gate));
             return std::move(tmp);
         }
@@ -251,15 +260,14 @@ class CNOTOptimizer final : public ast::Replacer {
         phases_.push_back(std::make_pair(parity, std::move(e)));
     }
 
-    // Flushes a cnot-dihedral operator (i.e. phases + permutation) to the
-    // circuit before the given node
+    // Synthesizes a cnot-dihedral operator (i.e. phases + permutation)
     template <typename T>
-    std::list<ast::ptr<T>> flush() {
+    std::list<ast::ptr<T>> synthesize(std::list<synthesis::phase_term>& phases,
+                                      synthesis::linear_op<bool>& permutation) {
         std::list<ast::ptr<T>> ret;
-        parser::Position pos;
 
-        // Synthesize circuit
-        for (auto& gate : synthesis::gray_synth(phases_, permutation_)) {
+        for (auto& gate : synthesis::gray_synth(phases, permutation,
+                                                config_.linear_synthesis)) {
             std::visit(
                 utils::overloaded{
                     [&ret, this](std::pair<int, int>& cx) {
@@ -272,6 +280,15 @@ class CNOTOptimizer final : public ast::Replacer {
                 gate);
         }
 
+        return ret;
+    }
+
+    // Flushes a cnot-dihedral operator (i.e. phases + permutation) to the
+    // circuit before the given node
+    template <typename T>
+    std::list<ast::ptr<T>> flush() {
+        auto ret = synthesize<T>(phases_, permutation_);
+
         // Reset the cnot-dihedral circuit
         phases_.clear();
         for (std::size_t i = 0; i < qubit_map_.size(); i++) {
@@ -283,6 +300,27 @@ class CNOTOptimizer final : public ast::Replacer {
         return ret;
     }
 
+    // Flushes the part of the cnot-dihedral operator the given qubits depend
+    // on, or all of it if partial flushing is disabled or some argument is
+    // not a known qubit (e.g. a whole register)
+    template <typename T>
+    std::list<ast::ptr<T>> flush(const std::vector<ast::VarAccess>& args) {
+        if (!config_.partial_flush)
+            return flush<T>();
+
+        std::vector<int> wires;
+        for (auto& arg : args) {
+            auto it = qubit_map_.find(arg);
+            if (it == qubit_map_.end())
+                return flush<T>();
+            wires.push_back(it->second);
+        }
+
+        auto [phases, permutation] =
+            synthesis::split_dependent(phases_, permutation_, wires);
+        return synthesize<T>(phases, permutation);
+    }
+
     bool is_zero(ast::Expr& expr) {
         auto val = expr.constant_eval();
         return val && (*val == 0);
@@ -62,8 +62,7 @@ class RotationOptimizer final : public ast::Visitor {
     RotationOptimizer(const config& params) : Visitor(), config_(params) {}
     ~RotationOptimizer() = default;
 
-    std::unordered_map<int, std::list<ast::ptr<ast::Gate>>>
-    run(ast::ASTNode& node) {
+    ast::gate_splices run(ast::ASTNode& node) {
         reset();
         node.accept(*this);
         return std::move(replacement_list_);
@@ -79,6 +78,7 @@ class RotationOptimizer final : public ast::Visitor {
     void visit(ast::IntExpr&) {}
     void visit(ast::RealExpr&) {}
     void visit(ast::VarExpr&) {}
+    void visit(ast::SharedExpr&) {}
 
     /* Statements */
     void visit(ast::MeasureStmt& stmt) {
@@ -131,13 +131,13 @@ class RotationOptimizer final : public ast::Visitor {
             else if (name == "t") {
                 auto rot = Gatelib::Rotation::t(gate.qarg(0));
                 rotation_info info{gate.uid(), rotation_info::axis::z,
-                                   gate.qarg(0)};
+                                   gate.qarg(0), current_};
                 accum_.push_back(
                     std::make_pair(info, rot.commute_left(current_clifford_)));
             } else if (name == "tdg") {
                 auto rot = Gatelib::Rotation::tdg(gate.qarg(0));
                 rotation_info info{gate.uid(), rotation_info::axis::z,
-                                   gate.qarg(0)};
+                                   gate.qarg(0), current_};
                 accum_.push_back(
                     std::make_pair(info, rot.commute_left(current_clifford_)));
             } else if (name == "rz") {
@@ -147,7 +147,7 @@ class RotationOptimizer final : public ast::Visitor {
                     auto rot = Gatelib::Rotation::rz(utils::Angle(*angle),
                                                      gate.qarg(0));
                     rotation_info info{gate.uid(), rotation_info::axis::z,
-                                       gate.qarg(0)};
+                                       gate.qarg(0), current_};
                     accum_.push_back(std::make_pair(
                         info, rot.commute_left(current_clifford_)));
                 } else {
@@ -160,7 +160,7 @@ class RotationOptimizer final : public ast::Visitor {
                     auto rot = Gatelib::Rotation::rx(utils::Angle(*angle),
                                                      gate.qarg(0));
                     rotation_info info{gate.uid(), rotation_info::axis::x,
-                                       gate.qarg(0)};
+                                       gate.qarg(0), current_};
                     accum_.push_back(std::make_pair(
                         info, rot.commute_left(current_clifford_)));
                 } else {
@@ -173,7 +173,7 @@ class RotationOptimizer final : public ast::Visitor {
                     auto rot = Gatelib::Rotation::ry(utils::Angle(*angle),
                                                      gate.qarg(0));
                     rotation_info info{gate.uid(), rotation_info::axis::y,
-                                       gate.qarg(0)};
+                                       gate.qarg(0), current_};
                     accum_.push_back(std::make_pair(
                         info, rot.commute_left(current_clifford_)));
                 } else {
@@ -195,7 +195,10 @@ class RotationOptimizer final : public ast::Visitor {
         std::swap(current_clifford_, local_clifford);
 
         // Process gate body
-        decl.foreach_stmt([this](auto& stmt) { stmt.accept(*this); });
+        for (auto it = decl.body().begin(); it != decl.body().end(); it++) {
+            current_ = ast::GateHandle(decl.body(), it);
+            (**it).accept(*this);
+        }
         accum_.push_back(current_clifford_);
 
         // Fold the gate body
@@ -211,7 +214,10 @@ class RotationOptimizer final : public ast::Visitor {
 
     /* Program */
     void visit(ast::Program& prog) {
-        prog.foreach_stmt([this](auto& stmt) { stmt.accept(*this); });
+        for (auto it = prog.body().begin(); it != prog.body().end(); it++) {
+            current_ = ast::GateHandle(prog.body(), it);
+            (**it).accept(*this);
+        }
         accum_.push_back(current_clifford_);
 
         fold(accum_, config_.correct_global_phase);
@@ -226,6 +232,7 @@ class RotationOptimizer final : public ast::Visitor {
         int uid;
         axis rotation_axis;
         ast::VarAccess arg;
+        ast::GateHandle handle;
     };
 
     using circuit_callback =
@@ -233,7 +240,8 @@ class RotationOptimizer final : public ast::Visitor {
                                std::pair<rotation_info, Gatelib::Rotation>>>;
 
     config config_;
-    std::unordered_map<int, std::list<ast::ptr<ast::Gate>>> replacement_list_;
+    ast::gate_splices replacement_list_;
+    ast::GateHandle current_; ///< Position of the statement being visited
 
     /* Algorithm state */
     circuit_callback
@@ -255,6 +263,7 @@ class RotationOptimizer final : public ast::Visitor {
         accum_.clear();
         mergeable_ = true;
         current_clifford_ = Gatelib::Clifford();
+        current_ = ast::GateHandle();
     }
 
     /* Phase two of the algorithm */
@@ -282,7 +291,8 @@ class RotationOptimizer final : public ast::Visitor {
                             alloc_rot(tmp->first, new_R.rotation_angle());
                         if (rot)
                             subst.emplace_back(rot);
-                        replacement_list_[tmp->first.uid] = std::move(subst);
+                        replacement_list_[tmp->first.uid] =
+                            std::make_pair(tmp->first.handle, std::move(subst));
 
                         // WARNING: this is a massive hack so that the global
                         // phase correction can be performed by the replacement
@@ -292,7 +302,7 @@ class RotationOptimizer final : public ast::Visitor {
                         // correction on, we select the qubit on which the
                         // rotation itself was applied.
                         tgt = &(tmp->first.arg);
-                        subst_ref = &(replacement_list_[tmp->first.uid]);
+                        subst_ref = &(replacement_list_[tmp->first.uid].second);
                     }
                 } else
                     break;
@@ -384,8 +394,8 @@ class RotationOptimizer final : public ast::Visitor {
                         R = new_R;
 
                         // Delete R in circuit & the node
-                        replacement_list_[P.first.uid] =
-                            std::move(std::list<ast::ptr<ast::Gate>>());
+                        replacement_list_[P.first.uid] = std::make_pair(
+                            P.first.handle, std::list<ast::ptr<ast::Gate>>());
 
                         auto it_next = std::next(it);
                         if (it_next != circuit.rend())
@@ -511,7 +521,7 @@ inline void fold_rotations(ast::ASTNode& node) {
     RotationOptimizer optimizer;
 
     auto res = optimizer.run(node);
-    replace_gates(node, std::move(res));
+    splice_gates(node, std::move(res));
 }
 
 /** \brief Performs the rotation folding optimization with configuration */
@@ -520,7 +530,7 @@ inline void fold_rotations(ast::ASTNode& node,
     RotationOptimizer optimizer(params);
 
     auto res = optimizer.run(node);
-    replace_gates(node, std::move(res));
+    splice_gates(node, std::move(res));
 }
 
 } // namespace optimization
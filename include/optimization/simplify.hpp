@@ -44,7 +44,8 @@ namespace ast = qasmtools::ast;
 /**
  * \brief Basic adjacent gate cancellation algorithm
  *
- *  Returns a replacement list giving the nodes to the be erased
+ *  Returns a replacement list giving the nodes to the be erased, with their
+ *  positions so that they are spliced out without another traversal
  */
 
 // TODO: add option for global phase correction
@@ -60,7 +61,7 @@ class Simplifier final : public ast::Visitor {
 
     void run(ast::ASTNode& node) {
         do {
-            replace_gates(node, std::move(erasures_));
+            splice_gates(node, std::move(erasures_));
             reset();
             node.accept(*this);
         } while (!erasures_.empty());
@@ -76,13 +77,14 @@ class Simplifier final : public ast::Visitor {
     void visit(ast::IntExpr&) {}
     void visit(ast::RealExpr&) {}
     void visit(ast::VarExpr&) {}
+    void visit(ast::SharedExpr&) {}
 
     /* Statements */
     void visit(ast::MeasureStmt& stmt) {
-        last_[stmt.q_arg()] = {"measure", {stmt.q_arg()}, stmt.uid()};
+        last_[stmt.q_arg()] = {"measure", {stmt.q_arg()}, stmt.uid(), current_};
     }
     void visit(ast::ResetStmt& stmt) {
-        last_[stmt.arg()] = {"reset", {stmt.arg()}, stmt.uid()};
+        last_[stmt.arg()] = {"reset", {stmt.arg()}, stmt.uid(), current_};
     }
     void visit(ast::IfStmt& stmt) {
         mergeable_ = false;
@@ -96,25 +98,24 @@ class Simplifier final : public ast::Visitor {
         auto phi = gate.phi().constant_eval();
         auto lambda = gate.lambda().constant_eval();
         if (theta && phi && lambda && (*theta == 0) && (*phi + *lambda == 0)) {
-            erasures_[gate.uid()] = std::move(std::list<ast::ptr<ast::Gate>>());
+            erase(gate.uid(), current_);
             return;
         }
 
-        last_[gate.arg()] = {"U", {gate.arg()}, gate.uid()};
+        last_[gate.arg()] = {"U", {gate.arg()}, gate.uid(), current_};
     }
     void visit(ast::CNOTGate& gate) {
         auto ctrl = gate.ctrl();
         auto tgt = gate.tgt();
 
         if (mergeable_) {
-            auto [name1, args1, uid1] = last_[ctrl];
-            auto [name2, args2, uid2] = last_[tgt];
+            auto [name1, args1, uid1, pos1] = last_[ctrl];
+            auto [name2, args2, uid2, pos2] = last_[tgt];
 
             if (uid1 == uid2 && name1 == "cx" &&
                 args1 == std::vector<ast::VarAccess>({ctrl, tgt})) {
-                erasures_[uid1] = std::move(std::list<ast::ptr<ast::Gate>>());
-                erasures_[gate.uid()] =
-                    std::move(std::list<ast::ptr<ast::Gate>>());
+                erase(uid1, pos1);
+                erase(gate.uid(), current_);
 
                 last_.erase(ctrl);
                 last_.erase(tgt);
@@ -123,12 +124,12 @@ class Simplifier final : public ast::Visitor {
             }
         }
 
-        last_[ctrl] = {"cx", {ctrl, tgt}, gate.uid()};
-        last_[tgt] = {"cx", {ctrl, tgt}, gate.uid()};
+        last_[ctrl] = {"cx", {ctrl, tgt}, gate.uid(), current_};
+        last_[tgt] = {"cx", {ctrl, tgt}, gate.uid(), current_};
     }
     void visit(ast::BarrierGate& gate) {
         gate.foreach_arg([this, &gate](auto& arg) {
-            last_[arg] = {"barrier", gate.args(), gate.uid()};
+            last_[arg] = {"barrier", gate.args(), gate.uid(), current_};
         });
     }
     void visit(ast::DeclaredGate& gate) {
@@ -140,20 +141,18 @@ class Simplifier final : public ast::Visitor {
             auto lambda = gate.carg(2).constant_eval();
             if (theta && phi && lambda && (*theta == 0) &&
                 (*phi + *lambda == 0)) {
-                erasures_[gate.uid()] =
-                    std::move(std::list<ast::ptr<ast::Gate>>());
+                erase(gate.uid(), current_);
                 return;
             }
         } else if (name == "u1" || name == "rx" || name == "ry" ||
                    name == "rz" || name == "crz" || name == "cu1") {
             auto lambda = gate.carg(0).constant_eval();
             if (lambda && (*lambda == 0)) {
-                erasures_[gate.uid()] =
-                    std::move(std::list<ast::ptr<ast::Gate>>());
+                erase(gate.uid(), current_);
                 return;
             }
         } else if (name == "id" || name == "u0") {
-            erasures_[gate.uid()] = std::move(std::list<ast::ptr<ast::Gate>>());
+            erase(gate.uid(), current_);
             return;
         } else if (name == "cu3") {
             auto theta = gate.carg(0).constant_eval();
@@ -161,8 +160,7 @@ class Simplifier final : public ast::Visitor {
             auto lambda = gate.carg(2).constant_eval();
             if (theta && phi && lambda && (*theta == 0) && (*phi == 0) &&
                 (*lambda == 0)) {
-                erasures_[gate.uid()] =
-                    std::move(std::list<ast::ptr<ast::Gate>>());
+                erase(gate.uid(), current_);
                 return;
             }
         }
@@ -171,15 +169,13 @@ class Simplifier final : public ast::Visitor {
             if (name == "cx") {
                 auto ctrl = gate.qarg(0);
                 auto tgt = gate.qarg(1);
-                auto [name1, args1, uid1] = last_[ctrl];
-                auto [name2, args2, uid2] = last_[tgt];
+                auto [name1, args1, uid1, pos1] = last_[ctrl];
+                auto [name2, args2, uid2, pos2] = last_[tgt];
 
                 if (uid1 == uid2 && name1 == "cx" &&
                     args1 == std::vector<ast::VarAccess>({ctrl, tgt})) {
-                    erasures_[uid1] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid1, pos1);
+                    erase(gate.uid(), current_);
 
                     last_.erase(ctrl);
                     last_.erase(tgt);
@@ -190,16 +186,14 @@ class Simplifier final : public ast::Visitor {
                 auto ctrl1 = gate.qarg(0);
                 auto ctrl2 = gate.qarg(1);
                 auto tgt = gate.qarg(2);
-                auto [name1, args1, uid1] = last_[ctrl1];
-                auto [name2, args2, uid2] = last_[ctrl2];
-                auto [name3, args3, uid3] = last_[tgt];
+                auto [name1, args1, uid1, pos1] = last_[ctrl1];
+                auto [name2, args2, uid2, pos2] = last_[ctrl2];
+                auto [name3, args3, uid3, pos3] = last_[tgt];
 
                 if (uid1 == uid2 && uid1 == uid3 && name1 == "ccx" &&
                     args1 == std::vector<ast::VarAccess>({ctrl1, ctrl2, tgt})) {
-                    erasures_[uid1] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid1, pos1);
+                    erase(gate.uid(), current_);
 
                     last_.erase(ctrl1);
                     last_.erase(ctrl2);
@@ -209,13 +203,11 @@ class Simplifier final : public ast::Visitor {
                 }
             } else if (name == "h") {
                 auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
+                auto [name, args, uid, pos] = last_[arg];
 
                 if (name == "h" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid, pos);
+                    erase(gate.uid(), current_);
 
                     last_.erase(arg);
 
@@ -223,13 +215,11 @@ class Simplifier final : public ast::Visitor {
                 }
             } else if (name == "x") {
                 auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
+                auto [name, args, uid, pos] = last_[arg];
 
                 if (name == "x" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid, pos);
+                    erase(gate.uid(), current_);
 
                     last_.erase(arg);
 
@@ -237,13 +227,11 @@ class Simplifier final : public ast::Visitor {
                 }
             } else if (name == "y") {
                 auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
+                auto [name, args, uid, pos] = last_[arg];
 
                 if (name == "y" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid, pos);
+                    erase(gate.uid(), current_);
 
                     last_.erase(arg);
 
@@ -251,13 +239,11 @@ class Simplifier final : public ast::Visitor {
                 }
             } else if (name == "z") {
                 auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
+                auto [name, args, uid, pos] = last_[arg];
 
                 if (name == "z" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid, pos);
+                    erase(gate.uid(), current_);
 
                     last_.erase(arg);
 
@@ -265,14 +251,12 @@ class Simplifier final : public ast::Visitor {
                 }
             } else if (name == "s") {
                 auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
+                auto [name, args, uid, pos] = last_[arg];
 
                 if (name == "sdg" &&
                     args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid, pos);
+                    erase(gate.uid(), current_);
 
                     last_.erase(arg);
 
@@ -280,13 +264,11 @@ class Simplifier final : public ast::Visitor {
                 }
             } else if (name == "sdg") {
                 auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
+                auto [name, args, uid, pos] = last_[arg];
 
                 if (name == "s" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid, pos);
+                    erase(gate.uid(), current_);
 
                     last_.erase(arg);
 
@@ -294,14 +276,12 @@ class Simplifier final : public ast::Visitor {
                 }
             } else if (name == "t") {
                 auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
+                auto [name, args, uid, pos] = last_[arg];
 
                 if (name == "tdg" &&
                     args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid, pos);
+                    erase(gate.uid(), current_);
 
                     last_.erase(arg);
 
@@ -309,13 +289,11 @@ class Simplifier final : public ast::Visitor {
                 }
             } else if (name == "tdg") {
                 auto arg = gate.qarg(0);
-                auto [name, args, uid] = last_[arg];
+                auto [name, args, uid, pos] = last_[arg];
 
                 if (name == "t" && args == std::vector<ast::VarAccess>({arg})) {
-                    erasures_[uid] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
-                    erasures_[gate.uid()] =
-                        std::move(std::list<ast::ptr<ast::Gate>>());
+                    erase(uid, pos);
+                    erase(gate.uid(), current_);
 
                     last_.erase(arg);
 
@@ -325,21 +303,21 @@ class Simplifier final : public ast::Visitor {
         }
 
         gate.foreach_qarg([this, &gate, &name](auto& arg) {
-            last_[arg] = {name, gate.qargs(), gate.uid()};
+            last_[arg] = {name, gate.qargs(), gate.uid(), current_};
         });
     }
 
     /* Declarations */
     void visit(ast::GateDecl& decl) {
         // Initialize a new local state
-        std::unordered_map<
-            ast::VarAccess,
-            std::tuple<std::string, std::vector<ast::VarAccess>, int>>
-            local_state;
+        std::unordered_map<ast::VarAccess, gate_info> local_state;
         std::swap(last_, local_state);
 
         // Process gate body
-        decl.foreach_stmt([this](auto& stmt) { stmt.accept(*this); });
+        for (auto it = decl.body().begin(); it != decl.body().end(); it++) {
+            current_ = ast::GateHandle(decl.body(), it);
+            (**it).accept(*this);
+        }
 
         // Reset the state
         std::swap(last_, local_state);
@@ -350,22 +328,34 @@ class Simplifier final : public ast::Visitor {
 
     /* Program */
     void visit(ast::Program& prog) {
-        prog.foreach_stmt([this](auto& stmt) { stmt.accept(*this); });
+        for (auto it = prog.body().begin(); it != prog.body().end(); it++) {
+            current_ = ast::GateHandle(prog.body(), it);
+            (**it).accept(*this);
+        }
     }
 
   private:
+    // Name, arguments, UID and position of the last gate on a qubit
+    using gate_info = std::tuple<std::string, std::vector<ast::VarAccess>,
+                                 int, ast::GateHandle>;
+
     config config_;
     bool mergeable_;
-    std::unordered_map<int, std::list<ast::ptr<ast::Gate>>> erasures_;
-    std::unordered_map<
-        ast::VarAccess,
-        std::tuple<std::string, std::vector<ast::VarAccess>, int>>
-        last_;
+    ast::gate_splices erasures_;
+    std::unordered_map<ast::VarAccess, gate_info> last_;
+    ast::GateHandle current_; ///< Position of the statement being visited
+
+    // Erases a gate at the next splice
+    void erase(int uid, const ast::GateHandle& pos) {
+        erasures_[uid] =
+            std::make_pair(pos, std::list<ast::ptr<ast::Gate>>());
+    }
 
     void reset() {
         erasures_.clear();
         last_.clear();
         mergeable_ = true;
+        current_ = ast::GateHandle();
     }
 };
 
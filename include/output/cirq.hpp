@@ -32,6 +32,7 @@
 #pragma once
 
 #include "qasmtools/ast/ast.hpp"
+#include "qasmtools/utils/emitter.hpp"
 
 #include <typeinfo>
 
@@ -70,6 +71,7 @@ class CirqOutputter final : public ast::Visitor {
         prefix_self_ = false;
 
         prog.accept(*this);
+        os_.flush();
     }
 
     // Variables
@@ -124,6 +126,8 @@ class CirqOutputter final : public ast::Visitor {
         os_ << sanitize(expr.var());
     }
 
+    void visit(ast::SharedExpr& expr) { expr.accept_target(*this); }
+
     // Statements
     void visit(ast::MeasureStmt& stmt) {
         os_ << prefix_ << "cirq.measure(" << stmt.q_arg() << ", key=\""
@@ -358,7 +362,7 @@ class CirqOutputter final : public ast::Visitor {
     }
 
   private:
-    std::ostream& os_;
+    qasmtools::utils::Emitter os_;
     config config_;
 
     std::string prefix_ = "";
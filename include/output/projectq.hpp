@@ -32,6 +32,7 @@
 #pragma once
 
 #include "qasmtools/ast/ast.hpp"
+#include "qasmtools/utils/emitter.hpp"
 
 #include <typeinfo>
 
@@ -72,6 +73,7 @@ class ProjectQOutputter final : public ast::Visitor {
         prefix_self_ = false;
 
         prog.accept(*this);
+        os_.flush();
     }
 
     // Variables
@@ -126,6 +128,8 @@ class ProjectQOutputter final : public ast::Visitor {
         os_ << sanitize(expr.var());
     }
 
+    void visit(ast::SharedExpr& expr) { expr.accept_target(*this); }
+
     // Statements
     void visit(ast::MeasureStmt& stmt) {
         os_ << prefix_ << "ops.Measure | " << stmt.q_arg() << "\n";
@@ -412,7 +416,7 @@ class ProjectQOutputter final : public ast::Visitor {
     }
 
   private:
-    std::ostream& os_;
+    qasmtools::utils::Emitter os_;
     config config_;
 
     std::string prefix_ = "";
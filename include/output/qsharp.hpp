@@ -32,6 +32,7 @@
 #pragma once
 
 #include "qasmtools/ast/ast.hpp"
+#include "qasmtools/utils/emitter.hpp"
 
 #include <iomanip>
 #include <typeinfo>
@@ -86,6 +87,7 @@ class QSharpOutputter final : public ast::Visitor {
         locals_.clear();
 
         prog.accept(*this);
+        os_.flush();
     }
 
     // Variables
@@ -178,6 +180,8 @@ class QSharpOutputter final : public ast::Visitor {
 
     void visit(ast::VarExpr& expr) { os_ << expr.var(); }
 
+    void visit(ast::SharedExpr& expr) { expr.accept_target(*this); }
+
     // Statements
     void visit(ast::MeasureStmt& stmt) {
         // Arrays are immutable in Q#
@@ -363,7 +367,7 @@ class QSharpOutputter final : public ast::Visitor {
     }
 
   private:
-    std::ostream& os_;
+    qasmtools::utils::Emitter os_;
     config config_;
 
     std::string prefix_ = "";
@@ -32,6 +32,7 @@
 #pragma once
 
 #include "qasmtools/ast/ast.hpp"
+#include "qasmtools/utils/emitter.hpp"
 
 namespace staq {
 namespace output {
@@ -70,6 +71,7 @@ class QuilOutputter final : public ast::Visitor {
         globals_.clear();
 
         prog.accept(*this);
+        os_.flush();
     }
 
     // Variables
@@ -141,6 +143,8 @@ class QuilOutputter final : public ast::Visitor {
 
     void visit(ast::VarExpr& expr) { os_ << "%" << expr.var(); }
 
+    void visit(ast::SharedExpr& expr) { expr.accept_target(*this); }
+
     // Statements
     void visit(ast::MeasureStmt& stmt) {
         os_ << "MEASURE ";
@@ -329,7 +333,7 @@ class QuilOutputter final : public ast::Visitor {
     }
 
   private:
-    std::ostream& os_;
+    qasmtools::utils::Emitter os_;
     config config_;
 
     bool circuit_local_ = false;
@@ -152,11 +152,88 @@ split(std::list<phase_term>& terms, int i) {
     return std::make_pair(std::move(zeros), std::move(ones));
 }
 
+/**
+ * \brief Splits off the part of a cnot-dihedral operator some wires depend on
+ *
+ * Collects the given wires and every wire connected to them through the
+ * linear part A or a common phase term, then moves the phase terms and rows
+ * of the collected wires out of f and A, leaving the identity on them. The
+ * two parts act on disjoint wires, so they commute and the part left behind
+ * can be synthesized later, e.g. after a gate on the given wires.
+ *
+ * \return The phase terms and linear part on the collected wires, the latter
+ * extended with the identity
+ */
+static std::pair<std::list<phase_term>, linear_op<bool>>
+split_dependent(std::list<phase_term>& f, linear_op<bool>& A,
+                const std::vector<int>& wires) {
+    auto n = A.size();
+    std::vector<bool> in_part(n, false);
+    std::vector<std::size_t> pending;
+    for (auto i : wires) {
+        if (!in_part[i]) {
+            in_part[i] = true;
+            pending.push_back(static_cast<std::size_t>(i));
+        }
+    }
+
+    std::list<phase_term> terms;
+    while (!pending.empty()) {
+        // Close the set under the linear part
+        while (!pending.empty()) {
+            auto i = pending.back();
+            pending.pop_back();
+            for (std::size_t j = 0; j < n; j++) {
+                if (!in_part[j] && (A[i][j] || A[j][i])) {
+                    in_part[j] = true;
+                    pending.push_back(j);
+                }
+            }
+        }
+
+        // Move the phase terms touching the set, along with their wires
+        for (auto it = f.begin(); it != f.end();) {
+            auto& vec = it->first;
+            bool touches = false;
+            for (std::size_t j = 0; j < n && !touches; j++)
+                touches = vec[j] && in_part[j];
+            if (!touches) {
+                it++;
+                continue;
+            }
+
+            for (std::size_t j = 0; j < n; j++) {
+                if (vec[j] && !in_part[j]) {
+                    in_part[j] = true;
+                    pending.push_back(j);
+                }
+            }
+            terms.splice(terms.end(), f, it++);
+        }
+    }
+
+    linear_op<bool> part(n, std::vector<bool>(n, false));
+    for (std::size_t i = 0; i < n; i++) {
+        if (in_part[i]) {
+            std::swap(part[i], A[i]);
+            A[i].assign(n, false);
+            A[i][i] = true;
+        } else {
+            part[i][i] = true;
+        }
+    }
+
+    return std::make_pair(std::move(terms), std::move(part));
+}
+
 /**
  * \brief The gray-synth algorith of arXiv:1712.01859
+ *
+ * The overall linear transformation is synthesized with alg
  */
-static std::list<cx_dihedral> gray_synth(std::list<phase_term>& f,
-                                         linear_op<bool> A) {
+static std::list<cx_dihedral>
+gray_synth(std::list<phase_term>& f, linear_op<bool> A,
+           linear_synthesizer alg = linear_synthesizer::gauss_jordan) {
     // Initialize
     std::list<cx_dihedral> ret;
     std::list<partition> stack;
@@ -218,7 +295,7 @@ static std::list<cx_dihedral> gray_synth(std::list<phase_term>& f,
     }
 
     // Synthesize the overall linear transformation
-    auto linear_trans = gauss_jordan(A);
+    auto linear_trans = synthesize_linear(std::move(A), alg);
     for (auto gate : linear_trans)
         ret.emplace_back(gate);
 
@@ -233,6 +310,7 @@ static std::list<cx_dihedral> gray_steiner(std::list<phase_term>& f,
     // Initialize
     std::list<cx_dihedral> ret;
     std::list<partition> stack;
+    steiner_workspace ws; // Reused by every Steiner tree
 
     std::set<int> indices;
     for (std::size_t i = 0; i < A.size(); i++)
@@ -258,7 +336,7 @@ static std::list<cx_dihedral> gray_steiner(std::list<phase_term>& f,
                     terminals.push_back(static_cast<int>(ctrl));
             }
 
-            auto s_tree = d.steiner(terminals, tgt);
+            auto s_tree = d.steiner(terminals, tgt, ws);
 
             // Fill each steiner point with a one
             for (auto it = s_tree.begin(); it != s_tree.end(); it++) {
@@ -33,7 +33,10 @@
 
 #include "mapping/device.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <list>
 #include <vector>
 
@@ -158,6 +161,178 @@ static std::list<std::pair<int, int>> gaussian_elim(linear_op<bool> mat) {
     return ret;
 }
 
+/**
+ * \brief Linear operator with each row packed 64 columns to a word
+ */
+using packed_op = std::vector<std::vector<std::uint64_t>>;
+
+inline packed_op pack(const linear_op<bool>& mat) {
+    std::size_t n = mat.size();
+    packed_op ret;
+    ret.reserve(n);
+    for (std::size_t i = 0; i < n; i++)
+        ret.emplace_back((n + 63) / 64, 0);
+    for (std::size_t i = 0; i < n; i++) {
+        for (std::size_t j = 0; j < n; j++) {
+            if (mat[i][j])
+                ret[i][j / 64] |= std::uint64_t(1) << (j % 64);
+        }
+    }
+    return ret;
+}
+
+inline void transpose(packed_op& mat) {
+    auto n = mat.size();
+    for (std::size_t i = 0; i < n; i++) {
+        for (std::size_t j = i + 1; j < n; j++) {
+            auto ij = (mat[i][j / 64] >> (j % 64)) & 1;
+            auto ji = (mat[j][i / 64] >> (i % 64)) & 1;
+            if (ij != ji) {
+                mat[i][j / 64] ^= std::uint64_t(1) << (j % 64);
+                mat[j][i / 64] ^= std::uint64_t(1) << (i % 64);
+            }
+        }
+    }
+}
+
+/**
+ * \brief Lower triangular part of Patel-Markov-Hayes synthesis
+ *
+ * Clears the entries below the diagonal of mat, one section of section_size
+ * columns at a time: rows with the same pattern in the section are first
+ * added together, so that Gaussian elimination on the section only has to
+ * deal with distinct patterns.
+ *
+ * \return The row additions, as (ctrl, tgt) pairs in the order applied
+ */
+inline std::list<std::pair<int, int>> pmh_lower(packed_op& mat,
+                                                std::size_t section_size,
+                                                bool& invertible) {
+    std::list<std::pair<int, int>> ret;
+    auto n = mat.size();
+    auto words = n == 0 ? 0 : mat[0].size();
+
+    auto entry = [&mat](std::size_t i, std::size_t j) {
+        return ((mat[i][j / 64] >> (j % 64)) & 1) == 1;
+    };
+    // Rows from the current section on are zero left of it
+    std::size_t from = 0;
+    auto add = [&mat, &ret, &from, words](std::size_t ctrl, std::size_t tgt) {
+        for (auto w = from; w < words; w++)
+            mat[tgt][w] ^= mat[ctrl][w];
+        ret.emplace_back(static_cast<int>(ctrl), static_cast<int>(tgt));
+    };
+
+    std::vector<int> first(std::size_t(1) << section_size);
+    for (std::size_t lo = 0; lo < n; lo += section_size) {
+        auto hi = std::min(lo + section_size, n);
+        from = lo / 64;
+
+        // Remove duplicate patterns in the section
+        std::fill(first.begin(), first.end(), -1);
+        for (auto i = lo; i < n; i++) {
+            std::size_t pattern = 0;
+            for (auto j = lo; j < hi; j++) {
+                if (entry(i, j))
+                    pattern |= std::size_t(1) << (j - lo);
+            }
+            if (pattern == 0)
+                continue;
+            else if (first[pattern] == -1)
+                first[pattern] = static_cast<int>(i);
+            else
+                add(static_cast<std::size_t>(first[pattern]), i);
+        }
+
+        // Gaussian elimination below the diagonal of the section
+        for (auto j = lo; j < hi; j++) {
+            bool pivot = entry(j, j);
+            for (auto i = j + 1; i < n; i++) {
+                if (entry(i, j)) {
+                    if (!pivot) {
+                        add(i, j);
+                        pivot = true;
+                    }
+                    add(j, i);
+                }
+            }
+            if (!pivot) {
+                invertible = false;
+                return ret;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * \brief Largest section size of pmh
+ */
+constexpr std::size_t pmh_max_section_size = 16;
+
+/**
+ * \brief Linear reversible synthesis from the Patel-Markov-Hayes algorithm
+ *
+ * Asymptotically optimal synthesis with O(n^2/log n) CNOT gates (see
+ * quant-ph/0302002). The matrix is reduced to upper triangular form one
+ * section of columns at a time, then its transpose likewise to the identity.
+ *
+ * \param section_size Columns per section, or 0 for about half the log of
+ * the number of qubits, which gave the fewest gates on random operators; at
+ * most pmh_max_section_size and the number of qubits
+ */
+inline std::list<std::pair<int, int>> pmh(const linear_op<bool>& mat,
+                                          int section_size = 0) {
+    std::list<std::pair<int, int>> ret;
+
+    auto n = mat.size();
+    if (n == 0)
+        return ret;
+
+    std::size_t size = section_size;
+    if (section_size <= 0)
+        size = std::max(
+            1, static_cast<int>(std::round((std::log2(n) + 1) / 2)));
+    // Each section tabulates its 2^size row patterns
+    size = std::min({size, n, pmh_max_section_size});
+
+    bool invertible = true;
+    auto packed = pack(mat);
+    auto lower = pmh_lower(packed, size, invertible);
+    transpose(packed);
+    auto upper = invertible ? pmh_lower(packed, size, invertible)
+                            : std::list<std::pair<int, int>>();
+    if (!invertible) {
+        std::cerr << "Error: linear operator is not invertible\n";
+        return ret;
+    }
+
+    // Row additions on the transpose are column additions, in reverse
+    for (auto [ctrl, tgt] : upper)
+        ret.emplace_back(tgt, ctrl);
+    for (auto it = lower.rbegin(); it != lower.rend(); it++)
+        ret.push_back(*it);
+
+    return ret;
+}
+
+/**
+ * \brief Algorithms for linear reversible synthesis on all-to-all devices
+ */
+enum class linear_synthesizer { gauss_jordan, pmh };
+
+/**
+ * \brief Linear reversible synthesis with the given algorithm
+ */
+inline std::list<std::pair<int, int>>
+synthesize_linear(linear_op<bool> mat, linear_synthesizer alg) {
+    if (alg == linear_synthesizer::pmh)
+        return pmh(mat);
+    else
+        return gauss_jordan(std::move(mat));
+}
+
 /**
  * \brief Steiner tree based device constrained CNOT synthesis
  *
@@ -192,6 +367,7 @@ static std::list<std::pair<int, int>> gaussian_elim(linear_op<bool> mat) {
 static std::list<std::pair<int, int>> steiner_gauss(linear_op<bool> mat,
                                                     mapping::Device& d) {
     std::list<std::pair<int, int>> ret;
+    mapping::steiner_workspace ws; // Reused by every Steiner tree
 
     // Whether or not a row has a dependence on a row above the diagonal
     std::vector<bool> above_diagonal_dep(mat.size(), false);
@@ -278,7 +454,7 @@ static std::list<std::pair<int, int>> steiner_gauss(linear_op<bool> mat,
             if (j != i && mat[j][i] == true)
                 pivots.push_back(static_cast<int>(j));
         }
-        auto s_tree = d.steiner(pivots, pivot);
+        auto s_tree = d.steiner(pivots, pivot, ws);
 
         std::list<std::pair<int, int>> compute;
         // Phase 4: Propagate 1's to column i for each Steiner point
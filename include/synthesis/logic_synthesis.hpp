@@ -40,12 +40,21 @@
 #include <caterpillar/synthesis/strategies/bennett_mapping_strategy.hpp>
 #include <caterpillar/synthesis/strategies/eager_mapping_strategy.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <unordered_map>
 
 #include "qasmtools/parser/position.hpp"
 #include "qasmtools/ast/stmt.hpp"
+#include "qasmtools/ast/decl.hpp"
+#include "qasmtools/ast/semantic.hpp"
 #include "qasmtools/utils/angle.hpp"
+#include "tools/thread_pool.hpp"
 
 namespace staq {
 namespace synthesis {
@@ -61,7 +70,7 @@ enum class Format {
     verilog,
 };
 
-std::unordered_map<std::string, Format> ext_to_format({
+inline const std::unordered_map<std::string, Format> ext_to_format({
     {"aig", Format::binary_aiger},
     {"aag", Format::ascii_aiger},
     {"bench", Format::bench},
@@ -73,7 +82,7 @@ std::unordered_map<std::string, Format> ext_to_format({
 /**
  * \brief Read in a classical logic network
  */
-mockturtle::mig_network read_network(const std::string& fname) {
+inline mockturtle::mig_network read_network(const std::string& fname) {
     mockturtle::mig_network mig;
 
     std::ifstream ifs;
@@ -113,180 +122,120 @@ mockturtle::mig_network read_network(const std::string& fname) {
     return mig;
 }
 
-/** \brief Wrapper around ast::angle_to_expr to convert tweedledum angles to
- * ours */
-ast::ptr<ast::Expr> angle_to_expr(parser::Position pos,
-                                  tweedledum::angle angle) {
+/** \brief Converts tweedledum angles to ours */
+inline utils::Angle to_angle(tweedledum::angle angle) {
     if (angle.is_numerically_defined())
-        return ast::angle_to_expr(utils::Angle(angle.numeric_value()));
+        return utils::Angle(angle.numeric_value());
     else
-        return ast::angle_to_expr(utils::Angle(*(angle.symbolic_value())));
+        return utils::Angle(*(angle.symbolic_value()));
+}
+
+/** \brief Wrapper around ast::angle_to_expr to convert tweedledum angles to
+ * ours */
+inline ast::ptr<ast::Expr> angle_to_expr(parser::Position pos,
+                                         tweedledum::angle angle) {
+    return ast::angle_to_expr(to_angle(angle));
 }
 
 /**
- * \brief LUT-based hierarchical logic synthesis (arXiv:1706.02721)
- * \note Based on an example given in the caterpillar synthesis library
+ * \brief A synthesized oracle, independent of the names of its parameters
+ *
+ * Qubits 0 to num_inputs - 1 stand for the oracle's parameters, in order,
+ * and the remaining ones for local ancillas.
  */
-template <typename T>
-std::list<ast::ptr<ast::Gate>>
-synthesize_net(parser::Position pos, T& l_net,
-               const std::vector<ast::symbol>& params,
-               std::string anc = "anc") {
-    std::list<ast::ptr<ast::Gate>> ret;
-
-    // Map network into lut with "cut size" 4
-    mockturtle::mapping_view<T, true> mapped_network{l_net};
-    mockturtle::lut_mapping_params ps;
-    ps.cut_enumeration_ps.cut_size = 3;
-    mockturtle::lut_mapping<mockturtle::mapping_view<T, true>, true>(
-        mapped_network, ps);
-
-    // Collapse network into a klut network
-    auto lutn = mockturtle::collapse_mapped_network<mockturtle::klut_network>(
-        mapped_network);
-    tweedledum::gg_network<tweedledum::mcmt_gate> q_net;
-    if (!lutn) {
-        std::cerr << "Could not map network into klut network" << std::endl;
-        return std::move(ret);
-    }
-
-    // Synthesize a gate graph network with 1, 2, and 3 qubit gates using
-    // hierarchical synthesis and spectral analysis for klut synthesis.
-    // Mapping strategy is eager.
-
-    auto strategy =
-        caterpillar::eager_mapping_strategy<mockturtle::klut_network>();
-    caterpillar::logic_network_synthesis_params p;
-    caterpillar::logic_network_synthesis_stats stats;
-    caterpillar::logic_network_synthesis(
-        q_net, *lutn, strategy, tweedledum::stg_from_pkrm(), p, &stats);
-
-    // Decompose Toffolis in terms of at most 3-control Toffolis
-    q_net = tweedledum::barenco_decomposition(q_net, {3});
-    // Decompose further into Clifford + T
-    q_net = tweedledum::dt_decomposition(q_net);
-
-    /* AST building */
-
-    // Allocate ancillas
-    int num_qubits = q_net.num_qubits();
-    int num_inputs =
-        static_cast<int>(stats.i_indexes.size() + stats.o_indexes.size());
-
-    if (num_qubits - num_inputs > 0)
-        ret.emplace_back(std::make_unique<ast::AncillaDecl>(
-            ast::AncillaDecl(pos, anc, false, num_qubits - num_inputs)));
-
-    // Create a mapping from qubits to variable accesses
-    auto inputs = stats.i_indexes;
-    inputs.insert(inputs.end(), stats.o_indexes.begin(), stats.o_indexes.end());
-    if (params.size() != inputs.size()) {
-        std::cerr << "Error: expected .v file with " << params.size()
-                  << " inputs, got " << inputs.size() << "\n";
-        throw ast::SemanticError();
-    }
-
-    std::vector<ast::VarAccess> id_refs(num_qubits, ast::VarAccess(pos, anc));
+struct oracle_circuit {
+    struct gate {
+        std::string name;                  ///< Standard library gate name
+        std::optional<utils::Angle> angle; ///< Angle of rotation gates
+        std::vector<int> qubits;
+    };
+
+    int num_inputs = 0;
+    int num_qubits = 0;
+    std::vector<gate> gates;
+};
 
-    // Map each input to the correct parameter
-    for (int i = 0; i < num_inputs; i++) {
-        id_refs[inputs[i]] = ast::VarAccess(pos, params[i]);
+/**
+ * \brief Converts a Clifford+T gate graph network into an oracle circuit
+ * \param inputs The qubits of the oracle's parameters, in order
+ */
+template <typename Network>
+oracle_circuit oracle_from_network(const Network& q_net,
+                                   const std::vector<uint32_t>& inputs) {
+    oracle_circuit ret;
+    ret.num_qubits = q_net.num_qubits();
+
+    // Number the inputs first, then the ancillas
+    ret.num_inputs = static_cast<int>(inputs.size());
+
+    std::vector<int> index(ret.num_qubits);
+    for (int i = 0; i < ret.num_inputs; i++) {
+        index[inputs[i]] = i;
     }
-
-    // Map each non-input to an ancilla
-    for (int i = 0, cur_anc = 0; i < num_qubits; i++) {
+    for (int i = 0, cur_anc = ret.num_inputs; i < ret.num_qubits; i++) {
         if (std::find(inputs.begin(), inputs.end(), i) == inputs.end())
-            id_refs[i] = ast::VarAccess(pos, anc, cur_anc++);
+            index[i] = cur_anc++;
     }
 
-    // Convert each gate to an ast::Gate
-    q_net.foreach_gate([&ret, &id_refs, &pos](auto const& node) {
+    auto add = [&ret](std::string name, std::vector<int> qubits,
+                      std::optional<utils::Angle> angle = std::nullopt) {
+        ret.gates.push_back({std::move(name), angle, std::move(qubits)});
+    };
+    // Convert each gate
+    q_net.foreach_gate([&add, &index](auto const& node) {
         auto const& gate = node.gate;
+        auto tgt = index[gate.target()];
         switch (gate.operation()) {
             case tweedledum::gate_lib::hadamard:
-                ret.emplace_back(std::make_unique<ast::DeclaredGate>(
-                    ast::DeclaredGate(pos, "h", {}, {id_refs[gate.target()]})));
+                add("h", {tgt});
                 break;
 
-            case tweedledum::gate_lib::rotation_x: {
-                std::vector<ast::ptr<ast::Expr>> args;
-                args.emplace_back(angle_to_expr(pos, gate.rotation_angle()));
-
-                ret.emplace_back(
-                    std::make_unique<ast::DeclaredGate>(ast::DeclaredGate(
-                        pos, "rx", std::move(args), {id_refs[gate.target()]})));
+            case tweedledum::gate_lib::rotation_x:
+                add("rx", {tgt}, to_angle(gate.rotation_angle()));
                 break;
-            }
-
-            case tweedledum::gate_lib::rotation_y: {
-                std::vector<ast::ptr<ast::Expr>> args;
-                args.emplace_back(angle_to_expr(pos, gate.rotation_angle()));
 
-                ret.emplace_back(
-                    std::make_unique<ast::DeclaredGate>(ast::DeclaredGate(
-                        pos, "ry", std::move(args), {id_refs[gate.target()]})));
+            case tweedledum::gate_lib::rotation_y:
+                add("ry", {tgt}, to_angle(gate.rotation_angle()));
                 break;
-            }
-
-            case tweedledum::gate_lib::rotation_z: {
-                std::vector<ast::ptr<ast::Expr>> args;
-                args.emplace_back(angle_to_expr(pos, gate.rotation_angle()));
 
-                ret.emplace_back(
-                    std::make_unique<ast::DeclaredGate>(ast::DeclaredGate(
-                        pos, "rz", std::move(args), {id_refs[gate.target()]})));
+            case tweedledum::gate_lib::rotation_z:
+                add("rz", {tgt}, to_angle(gate.rotation_angle()));
                 break;
-            }
 
             case tweedledum::gate_lib::pauli_x:
-                ret.emplace_back(std::make_unique<ast::DeclaredGate>(
-                    ast::DeclaredGate(pos, "x", {}, {id_refs[gate.target()]})));
+                add("x", {tgt});
                 break;
 
             case tweedledum::gate_lib::pauli_y:
-                ret.emplace_back(std::make_unique<ast::DeclaredGate>(
-                    ast::DeclaredGate(pos, "y", {}, {id_refs[gate.target()]})));
+                add("y", {tgt});
                 break;
 
             case tweedledum::gate_lib::t:
-                ret.emplace_back(std::make_unique<ast::DeclaredGate>(
-                    ast::DeclaredGate(pos, "t", {}, {id_refs[gate.target()]})));
+                add("t", {tgt});
                 break;
 
             case tweedledum::gate_lib::phase:
-                ret.emplace_back(std::make_unique<ast::DeclaredGate>(
-                    ast::DeclaredGate(pos, "s", {}, {id_refs[gate.target()]})));
+                add("s", {tgt});
                 break;
 
             case tweedledum::gate_lib::pauli_z:
-                ret.emplace_back(std::make_unique<ast::DeclaredGate>(
-                    ast::DeclaredGate(pos, "z", {}, {id_refs[gate.target()]})));
+                add("z", {tgt});
                 break;
 
             case tweedledum::gate_lib::phase_dagger:
-                ret.emplace_back(
-                    std::make_unique<ast::DeclaredGate>(ast::DeclaredGate(
-                        pos, "sdg", {}, {id_refs[gate.target()]})));
+                add("sdg", {tgt});
                 break;
 
             case tweedledum::gate_lib::t_dagger:
-                ret.emplace_back(
-                    std::make_unique<ast::DeclaredGate>(ast::DeclaredGate(
-                        pos, "tdg", {}, {id_refs[gate.target()]})));
+                add("tdg", {tgt});
                 break;
 
             case tweedledum::gate_lib::cx:
-                ret.emplace_back(
-                    std::make_unique<ast::DeclaredGate>(ast::DeclaredGate(
-                        pos, "cx", {},
-                        {id_refs[gate.control()], id_refs[gate.target()]})));
+                add("cx", {index[gate.control()], tgt});
                 break;
 
             case tweedledum::gate_lib::cz:
-                ret.emplace_back(
-                    std::make_unique<ast::DeclaredGate>(ast::DeclaredGate(
-                        pos, "cz", {},
-                        {id_refs[gate.control()], id_refs[gate.target()]})));
+                add("cz", {index[gate.control()], tgt});
                 break;
 
             case tweedledum::gate_lib::mcx: {
@@ -297,12 +246,12 @@ synthesize_net(parser::Position pos, T& l_net,
                     break;
                 }
 
-                std::vector<ast::VarAccess> tmp;
-                gate.foreach_control([&tmp, &id_refs](auto const& qubit) {
-                    tmp.push_back(id_refs[qubit]);
+                std::vector<int> tmp;
+                gate.foreach_control([&tmp, &index](auto const& qubit) {
+                    tmp.push_back(index[qubit]);
                 });
-                ret.emplace_back(std::make_unique<ast::DeclaredGate>(
-                    ast::DeclaredGate(pos, "ccx", {}, std::move(tmp))));
+                tmp.push_back(tgt);
+                add("ccx", std::move(tmp));
                 break;
             }
 
@@ -315,7 +264,348 @@ synthesize_net(parser::Position pos, T& l_net,
         }
     });
 
-    return std::move(ret);
+    return ret;
+}
+
+/** \brief Reversible mapping strategies of the hierarchical synthesis */
+enum class lhrs_strategy { bennett, eager };
+
+/** \brief Single-target gate synthesis methods */
+enum class stg_method { pkrm, pprm, spectrum };
+
+/** \brief Costs of a synthesized oracle */
+enum class oracle_metric { t_count, qubits, cnots };
+
+/** \brief Number of non-Clifford gates of an oracle */
+inline int t_count(const oracle_circuit& circuit) {
+    int ret = 0;
+    for (auto& gate : circuit.gates) {
+        if (gate.name == "t" || gate.name == "tdg") {
+            ret++;
+        } else if (gate.angle) {
+            auto frac = gate.angle->symbolic_value();
+            if (!frac || 2 % frac->second != 0)
+                ret++;
+        }
+    }
+    return ret;
+}
+
+/** \brief Number of two-qubit gates of an oracle */
+inline int cnot_count(const oracle_circuit& circuit) {
+    int ret = 0;
+    for (auto& gate : circuit.gates) {
+        if (gate.qubits.size() == 2)
+            ret++;
+    }
+    return ret;
+}
+
+/**
+ * \class staq::synthesis::LogicSynthesizer
+ * \brief LUT-based hierarchical logic synthesis (arXiv:1706.02721)
+ * \note Based on an example given in the caterpillar synthesis library
+ *
+ * Maps the network into LUTs of config.cut_size inputs, synthesizes the LUT
+ * network with caterpillar using the chosen mapping strategy and single-target
+ * gate synthesis, breaks Toffoli gates down to at most config.max_controls
+ * controls with the Barenco decomposition and finally into Clifford+T.
+ *
+ * In portfolio mode, the configured settings and a set of variations on them
+ * (see candidates()) are tried concurrently, and the result that is best
+ * under config.metric is returned. Candidates not started within the time
+ * budget are skipped; the configured settings are always tried. Pebbling
+ * strategies are not available, as they need a SAT solver that is not
+ * bundled.
+ */
+class LogicSynthesizer {
+  public:
+    /**
+     * \class staq::synthesis::LogicSynthesizer::config
+     * \brief Holds configuration options
+     */
+    struct config {
+        int cut_size = 3;                              ///< Inputs per LUT
+        lhrs_strategy strategy = lhrs_strategy::eager; ///< Mapping strategy
+        stg_method stg = stg_method::pkrm;             ///< Single-target gates
+        int max_controls = 3;                          ///< Max controls (2-4)
+        bool t_par = false;                            ///< T-par Toffolis
+        bool portfolio = false;                        ///< Try several settings
+        oracle_metric metric = oracle_metric::t_count; ///< Portfolio objective
+        int num_threads = 0;                           ///< Workers, 0 for all
+        int time_budget_ms = 0;                        ///< Budget, 0 for none
+    };
+
+    LogicSynthesizer() = default;
+    LogicSynthesizer(const config& params) : config_(params) {}
+
+    /**
+     * \brief Synthesizes a logic network
+     * \return The synthesized circuit, or nothing if the network could not
+     * be mapped
+     */
+    template <typename T>
+    std::optional<oracle_circuit> run(T& l_net) {
+        complete_ = true;
+        if (!config_.portfolio)
+            return synthesize(l_net, config_);
+
+        // The networks share their storage, which mapping modifies, so
+        // each candidate gets its own copy
+        auto settings = candidates();
+        std::vector<T> copies;
+        for (std::size_t k = 1; k < settings.size(); k++) {
+            copies.push_back(mockturtle::cleanup_dangling(l_net));
+        }
+
+        using clock = std::chrono::steady_clock;
+        auto deadline =
+            clock::now() + std::chrono::milliseconds(config_.time_budget_ms);
+        std::vector<std::optional<oracle_circuit>> results(settings.size());
+        tools::ThreadPool pool(config_.num_threads);
+        std::atomic<bool> complete{true};
+        pool.run(settings.size(), [&](std::size_t k, int) {
+            if (k > 0 && config_.time_budget_ms > 0 &&
+                clock::now() > deadline) {
+                complete = false;
+                return;
+            }
+            results[k] = synthesize(k == 0 ? l_net : copies[k - 1],
+                                    settings[k]);
+        });
+        complete_ = complete;
+
+        std::optional<oracle_circuit> ret;
+        for (auto& result : results) {
+            if (result && (!ret || cost(*result) < cost(*ret)))
+                ret = std::move(result);
+        }
+        return ret;
+    }
+
+    /**
+     * \brief Whether the last run tried every candidate
+     *
+     * Only a portfolio cut short by its time budget is incomplete, and its
+     * result depends on the timing of the run.
+     */
+    bool complete() const { return complete_; }
+
+    /**
+     * \brief The settings tried in portfolio mode
+     *
+     * The configured settings first, then every combination of cut sizes 3,
+     * 4 and 6, both mapping strategies and PKRM or PPRM single-target gate
+     * synthesis. Spectral synthesis leaves arbitrary rotations rather than
+     * Clifford+T, so it is only tried when configured.
+     */
+    std::vector<config> candidates() const {
+        std::vector<config> ret{config_};
+        for (auto cut_size : {3, 4, 6}) {
+            for (auto strategy :
+                 {lhrs_strategy::eager, lhrs_strategy::bennett}) {
+                for (auto stg : {stg_method::pkrm, stg_method::pprm}) {
+                    auto params = config_;
+                    params.cut_size = cut_size;
+                    params.strategy = strategy;
+                    params.stg = stg;
+                    if (params.cut_size != config_.cut_size ||
+                        params.strategy != config_.strategy ||
+                        params.stg != config_.stg)
+                        ret.push_back(params);
+                }
+            }
+        }
+        return ret;
+    }
+
+    /**
+     * \brief Short description of the settings
+     *
+     * Two configurations with the same description produce the same
+     * circuits in complete runs (see complete()). The worker count and time
+     * budget are left out, as they only decide which candidates of a
+     * portfolio are tried in time.
+     */
+    std::string signature() const {
+        std::ostringstream ss;
+        ss << "lut" << config_.cut_size;
+        if (config_.strategy == lhrs_strategy::eager)
+            ss << " eager";
+        else
+            ss << " bennett";
+        switch (config_.stg) {
+            case stg_method::pkrm:
+                ss << " pkrm";
+                break;
+            case stg_method::pprm:
+                ss << " pprm";
+                break;
+            case stg_method::spectrum:
+                ss << " spectrum";
+                break;
+        }
+        ss << " barenco" << config_.max_controls;
+        ss << (config_.t_par ? " dt-tpar" : " dt");
+        if (config_.portfolio)
+            ss << " portfolio-" << static_cast<int>(config_.metric);
+        return ss.str();
+    }
+
+  private:
+    config config_;
+    bool complete_ = true;
+
+    // Lexicographic cost, config_.metric first
+    std::array<int, 5> cost(const oracle_circuit& circuit) const {
+        std::array<int, 3> costs{t_count(circuit), circuit.num_qubits,
+                                 cnot_count(circuit)};
+        auto first = static_cast<std::size_t>(config_.metric);
+        return {costs[first], costs[0], costs[1], costs[2],
+                static_cast<int>(circuit.gates.size())};
+    }
+
+    template <typename T>
+    static std::optional<oracle_circuit> synthesize(T& l_net,
+                                                    const config& params) {
+        if (params.max_controls < 2 || params.max_controls > 4)
+            throw std::logic_error("Barenco decomposition must leave 2 to 4 "
+                                   "controls");
+
+        // Map network into luts
+        mockturtle::mapping_view<T, true> mapped_network{l_net};
+        mockturtle::lut_mapping_params ps;
+        ps.cut_enumeration_ps.cut_size = params.cut_size;
+        mockturtle::lut_mapping<mockturtle::mapping_view<T, true>, true>(
+            mapped_network, ps);
+
+        // Collapse network into a klut network
+        auto lutn =
+            mockturtle::collapse_mapped_network<mockturtle::klut_network>(
+                mapped_network);
+        tweedledum::gg_network<tweedledum::mcmt_gate> q_net;
+        if (!lutn) {
+            std::cerr << "Could not map network into klut network"
+                      << std::endl;
+            return std::nullopt;
+        }
+
+        // Synthesize a gate graph network with multiple-controlled Toffoli
+        // gates using hierarchical synthesis
+        using klut = mockturtle::klut_network;
+        std::unique_ptr<caterpillar::mapping_strategy<klut>> strategy;
+        if (params.strategy == lhrs_strategy::eager)
+            strategy =
+                std::make_unique<caterpillar::eager_mapping_strategy<klut>>();
+        else
+            strategy =
+                std::make_unique<caterpillar::bennett_mapping_strategy<klut>>();
+
+        caterpillar::logic_network_synthesis_params p;
+        caterpillar::logic_network_synthesis_stats stats;
+        switch (params.stg) {
+            case stg_method::pkrm:
+                caterpillar::logic_network_synthesis(
+                    q_net, *lutn, *strategy, tweedledum::stg_from_pkrm(), p,
+                    &stats);
+                break;
+            case stg_method::pprm:
+                caterpillar::logic_network_synthesis(
+                    q_net, *lutn, *strategy, tweedledum::stg_from_pprm(), p,
+                    &stats);
+                break;
+            case stg_method::spectrum:
+                caterpillar::logic_network_synthesis(
+                    q_net, *lutn, *strategy, tweedledum::stg_from_spectrum(),
+                    p, &stats);
+                break;
+        }
+
+        // Decompose Toffolis in terms of Toffolis with fewer controls
+        q_net = tweedledum::barenco_decomposition(
+            q_net, {static_cast<uint32_t>(params.max_controls)});
+        // Decompose further into Clifford + T
+        q_net = tweedledum::dt_decomposition(q_net, {params.t_par});
+
+        auto inputs = stats.i_indexes;
+        inputs.insert(inputs.end(), stats.o_indexes.begin(),
+                      stats.o_indexes.end());
+        return oracle_from_network(q_net, inputs);
+    }
+};
+
+/**
+ * \brief LUT-based hierarchical logic synthesis (arXiv:1706.02721)
+ * \return The synthesized circuit, or nothing if the network could not be
+ * mapped
+ */
+template <typename T>
+std::optional<oracle_circuit>
+synthesize_circuit(T& l_net, const LogicSynthesizer::config& params = {}) {
+    LogicSynthesizer alg(params);
+    return alg.run(l_net);
+}
+
+/**
+ * \brief Builds the body of a gate declaration from a synthesized oracle
+ */
+inline std::list<ast::ptr<ast::Gate>>
+oracle_body(parser::Position pos, const oracle_circuit& circuit,
+            const std::vector<ast::symbol>& params, std::string anc = "anc") {
+    std::list<ast::ptr<ast::Gate>> ret;
+
+    // Allocate ancillas
+    if (circuit.num_qubits - circuit.num_inputs > 0)
+        ret.emplace_back(std::make_unique<ast::AncillaDecl>(ast::AncillaDecl(
+            pos, anc, false, circuit.num_qubits - circuit.num_inputs)));
+
+    if (params.size() != static_cast<std::size_t>(circuit.num_inputs)) {
+        std::cerr << "Error: expected .v file with " << params.size()
+                  << " inputs, got " << circuit.num_inputs << "\n";
+        throw ast::SemanticError();
+    }
+
+    // Map each input to the correct parameter, and each non-input to an
+    // ancilla
+    std::vector<ast::VarAccess> id_refs;
+    for (int i = 0; i < circuit.num_qubits; i++) {
+        if (i < circuit.num_inputs)
+            id_refs.emplace_back(pos, params[i]);
+        else
+            id_refs.emplace_back(pos, anc, i - circuit.num_inputs);
+    }
+
+    for (auto& gate : circuit.gates) {
+        std::vector<ast::ptr<ast::Expr>> args;
+        if (gate.angle)
+            args.emplace_back(ast::angle_to_expr(*gate.angle));
+
+        std::vector<ast::VarAccess> qargs;
+        for (auto i : gate.qubits)
+            qargs.push_back(id_refs[i]);
+
+        ret.emplace_back(std::make_unique<ast::DeclaredGate>(ast::DeclaredGate(
+            pos, gate.name, std::move(args), std::move(qargs))));
+    }
+
+    return ret;
+}
+
+/**
+ * \brief LUT-based hierarchical logic synthesis (arXiv:1706.02721)
+ * \return The body of a gate declaration with the given parameters
+ */
+template <typename T>
+std::list<ast::ptr<ast::Gate>>
+synthesize_net(parser::Position pos, T& l_net,
+               const std::vector<ast::symbol>& params,
+               std::string anc = "anc",
+               const LogicSynthesizer::config& settings = {}) {
+    auto circuit = synthesize_circuit(l_net, settings);
+    if (!circuit)
+        return {};
+
+    return oracle_body(pos, *circuit, params, anc);
 }
 
 } // namespace synthesis
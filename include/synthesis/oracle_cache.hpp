@@ -0,0 +1,287 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file synthesis/oracle_cache.hpp
+ * \brief Caching of synthesized oracles
+ */
+
+#pragma once
+
+#include "synthesis/logic_synthesis.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+namespace staq {
+namespace synthesis {
+
+/**
+ * \brief Version of the synthesis pipeline and of the cache format
+ *
+ * Part of every cache key, so that changing either retires old entries.
+ */
+inline const std::string oracle_cache_version = "staq-oracle 3";
+
+/**
+ * \brief Cache key of a logic file
+ *
+ * Entries are looked up by hash, and a hit only counts if the check and the
+ * size match too, so that a collision of the hashes is a miss rather than a
+ * wrong oracle.
+ */
+struct oracle_cache_key {
+    std::uint64_t hash;  ///< 64-bit FNV-1a of the version, settings and file
+    std::uint64_t check; ///< An independent multiplicative hash of the same
+    std::uint64_t size;  ///< Size of the file's contents
+
+    bool operator==(const oracle_cache_key& other) const {
+        return hash == other.hash && check == other.check &&
+               size == other.size;
+    }
+    bool operator!=(const oracle_cache_key& other) const {
+        return !(*this == other);
+    }
+};
+
+/**
+ * \brief Cache key of a logic file
+ *
+ * Hashes the cache version, the synthesis settings, the file's format and
+ * its contents.
+ *
+ * \return The key, or nothing if the file can't be read
+ */
+inline std::optional<oracle_cache_key>
+oracle_key(const std::string& fname,
+           const LogicSynthesizer::config& params = {}) {
+    std::ifstream ifs(fname, std::ios::binary);
+    if (!ifs.good())
+        return std::nullopt;
+    std::stringstream contents;
+    contents << ifs.rdbuf();
+
+    auto ext = fname.substr(fname.find_last_of('.') + 1);
+    oracle_cache_key ret{0xcbf29ce484222325ull, 0, contents.str().size()};
+    auto mix = [&ret](unsigned c) {
+        ret.hash ^= c;
+        ret.hash *= 0x100000001b3ull;
+        ret.check = (ret.check + c + 1) * 0x9e3779b97f4a7c15ull;
+        ret.check ^= ret.check >> 29;
+    };
+    auto settings = LogicSynthesizer(params).signature();
+    for (auto& part : {oracle_cache_version, settings, ext, contents.str()}) {
+        for (unsigned char c : part)
+            mix(c);
+        mix(0xff);
+    }
+    return ret;
+}
+
+/**
+ * \brief Writes a synthesized oracle in the cache's text format
+ *
+ * A header line, a line with the number of inputs, qubits and gates, then
+ * one line per gate with its name, angle (- for none, pi a b for a*pi/b, or
+ * a hexadecimal float) and qubits.
+ */
+inline void write_oracle(std::ostream& os, const oracle_circuit& circuit) {
+    os << oracle_cache_version << "\n";
+    os << circuit.num_inputs << " " << circuit.num_qubits << " "
+       << circuit.gates.size() << "\n";
+    for (auto& gate : circuit.gates) {
+        os << gate.name;
+        if (!gate.angle) {
+            os << " -";
+        } else if (gate.angle->is_symbolic()) {
+            auto [a, b] = *(gate.angle->symbolic_value());
+            os << " pi " << a << " " << b;
+        } else {
+            os << " " << std::hexfloat << gate.angle->numeric_value()
+               << std::defaultfloat;
+        }
+        os << " " << gate.qubits.size();
+        for (auto i : gate.qubits)
+            os << " " << i;
+        os << "\n";
+    }
+}
+
+/**
+ * \brief Reads a synthesized oracle written by write_oracle
+ * \return The oracle, or nothing if the input is malformed
+ */
+inline std::optional<oracle_circuit> read_oracle(std::istream& is) {
+    std::string version;
+    std::getline(is, version);
+    if (version != oracle_cache_version)
+        return std::nullopt;
+
+    oracle_circuit ret;
+    std::size_t num_gates;
+    if (!(is >> ret.num_inputs >> ret.num_qubits >> num_gates))
+        return std::nullopt;
+
+    for (std::size_t k = 0; k < num_gates; k++) {
+        oracle_circuit::gate gate;
+        std::string angle;
+        std::size_t num_qubits;
+        if (!(is >> gate.name >> angle))
+            return std::nullopt;
+
+        if (angle == "pi") {
+            int a, b;
+            if (!(is >> a >> b))
+                return std::nullopt;
+            gate.angle = utils::Angle(a, b);
+        } else if (angle != "-") {
+            // Streams don't reliably read hexadecimal floats
+            char* end;
+            auto value = std::strtod(angle.c_str(), &end);
+            if (*end != '\0')
+                return std::nullopt;
+            gate.angle = utils::Angle(value);
+        }
+
+        if (!(is >> num_qubits))
+            return std::nullopt;
+        gate.qubits.resize(num_qubits);
+        for (auto& i : gate.qubits) {
+            if (!(is >> i) || i < 0 || i >= ret.num_qubits)
+                return std::nullopt;
+        }
+        ret.gates.push_back(std::move(gate));
+    }
+
+    return ret;
+}
+
+/**
+ * \class staq::synthesis::OracleCache
+ * \brief Cache of synthesized oracles, in memory and optionally on disk
+ *
+ * In-memory entries are shared by every cache of the process. Given a
+ * directory, entries are also kept there as one HASH.oracle file each,
+ * holding the check and size of the key before the oracle, so that later
+ * compiles skip synthesizing unchanged logic files. Unreadable, stale or
+ * colliding entries count as misses, and failures to write are ignored.
+ */
+class OracleCache {
+  public:
+    OracleCache() = default;
+    OracleCache(std::string dir) : dir_(std::move(dir)) {}
+
+    /** \brief Looks up an oracle, in memory first */
+    std::optional<oracle_circuit> find(const oracle_cache_key& key) {
+        {
+            std::lock_guard<std::mutex> lock(memory_mutex());
+            auto it = memory().find(key.hash);
+            if (it != memory().end()) {
+                if (it->second.first != key)
+                    return std::nullopt;
+                return it->second.second;
+            }
+        }
+
+        if (dir_.empty())
+            return std::nullopt;
+        std::ifstream ifs(path(key));
+        std::uint64_t check, size;
+        if (!(ifs >> check >> size) || check != key.check || size != key.size)
+            return std::nullopt;
+        ifs.ignore(1);
+        auto ret = read_oracle(ifs);
+        if (ret) {
+            std::lock_guard<std::mutex> lock(memory_mutex());
+            memory().emplace(key.hash, std::make_pair(key, *ret));
+        }
+        return ret;
+    }
+
+    /** \brief Adds an oracle to the cache */
+    void insert(const oracle_cache_key& key, const oracle_circuit& circuit) {
+        {
+            std::lock_guard<std::mutex> lock(memory_mutex());
+            memory()[key.hash] = std::make_pair(key, circuit);
+        }
+
+        if (dir_.empty())
+            return;
+
+        // Write to a temporary file first so that concurrent compiles never
+        // see a partial entry
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::create_directories(dir_, ec);
+        auto tmp = path(key) + "." + std::to_string(std::random_device{}());
+        {
+            std::ofstream ofs(tmp);
+            ofs << key.check << " " << key.size << "\n";
+            write_oracle(ofs, circuit);
+            if (!ofs)
+                return;
+        }
+        fs::rename(tmp, path(key), ec);
+        if (ec)
+            fs::remove(tmp, ec);
+    }
+
+    /** \brief Drops the in-memory entries of every cache of the process */
+    static void clear_memory() {
+        std::lock_guard<std::mutex> lock(memory_mutex());
+        memory().clear();
+    }
+
+    /** \brief The file of an entry in the on-disk cache */
+    std::string path(const oracle_cache_key& key) const {
+        std::ostringstream ss;
+        ss << std::hex << std::setw(16) << std::setfill('0') << key.hash;
+        return (std::filesystem::path(dir_) / (ss.str() + ".oracle")).string();
+    }
+
+  private:
+    std::string dir_;
+
+    static std::mutex& memory_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+    using entry = std::pair<oracle_cache_key, oracle_circuit>;
+    static std::unordered_map<std::uint64_t, entry>& memory() {
+        static std::unordered_map<std::uint64_t, entry> entries;
+        return entries;
+    }
+};
+
+} // namespace synthesis
+} // namespace staq
@@ -57,6 +57,7 @@ class QubitEstimator final : public ast::Visitor {
     void visit(ast::IntExpr&) {}
     void visit(ast::RealExpr&) {}
     void visit(ast::VarExpr&) {}
+    void visit(ast::SharedExpr&) {}
 
     /* Statements */
     void visit(ast::MeasureStmt& stmt) {}
@@ -31,11 +31,14 @@
 
 #pragma once
 
-// TODO: account for compound gates, i.e. qreg q[n]; reset q;
-
 #include "qasmtools/ast/ast.hpp"
+#include "qasmtools/utils/emitter.hpp"
+#include "transformations/registers.hpp"
 
 #include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <vector>
 
 namespace staq {
 namespace tools {
@@ -44,7 +47,7 @@ namespace ast = qasmtools::ast;
 
 using resource_count = std::unordered_map<std::string, int>;
 
-void add_counts(resource_count& A, const resource_count& B) {
+inline void add_counts(resource_count& A, const resource_count& B) {
     for (auto& [gate, num] : B)
         A[gate] += num;
 }
@@ -65,6 +68,7 @@ class ResourceEstimator final : public ast::Visitor {
         reset();
 
         node.accept(*this);
+        flush_barriers();
 
         // Unboxing the running estimate
         auto& [counts, depths] = running_estimate_;
@@ -91,77 +95,88 @@ class ResourceEstimator final : public ast::Visitor {
     void visit(ast::IntExpr&) {}
     void visit(ast::RealExpr&) {}
     void visit(ast::VarExpr&) {}
+    void visit(ast::SharedExpr&) {}
 
     /* Statements */
     void visit(ast::MeasureStmt& stmt) {
+        flush_barriers();
         auto& [counts, depths] = running_estimate_;
+        arg_list args{stmt.c_arg(), stmt.q_arg()};
+        auto num = registers_.repeats(args);
 
         // Gate count
-        counts["measurement"] += 1;
+        counts["measurement"] += num.value_or(1);
 
         // Depth
-        int in_depth = std::max(depths[stmt.c_arg()], depths[stmt.q_arg()]);
-        depths[stmt.c_arg()] = in_depth + 1;
-        depths[stmt.q_arg()] = in_depth + 1;
+        advance(args, num, 1);
     }
     void visit(ast::ResetStmt& stmt) {
+        flush_barriers();
         auto& [counts, depths] = running_estimate_;
+        arg_list args{stmt.arg()};
+        auto num = registers_.repeats(args);
 
         // Gate count
-        counts["reset"] += 1;
+        counts["reset"] += num.value_or(1);
 
         // Depth
-        depths[stmt.arg()] += 1;
+        advance(args, num, 1);
     }
     void visit(ast::IfStmt& stmt) { stmt.then().accept(*this); }
 
     /* Gates */
     void visit(ast::UGate& gate) {
+        flush_barriers();
         auto& [counts, depths] = running_estimate_;
+        arg_list args{gate.arg()};
+        auto num = registers_.repeats(args);
 
         // Gate count
-        std::stringstream ss;
+        name_.clear();
         auto theta = gate.theta().constant_eval();
         auto phi = gate.phi().constant_eval();
         auto lambda = gate.lambda().constant_eval();
 
         if (theta && phi && lambda)
-            ss << "U(" << *theta << "," << *phi << "," << *lambda << ")";
+            name_ << "U(" << *theta << "," << *phi << "," << *lambda << ")";
         else
-            ss << "U";
+            name_ << "U";
 
-        counts[ss.str()] += 1;
+        counts[std::string(name_.str())] += num.value_or(1);
 
         // Depth
-        depths[gate.arg()] += 1;
+        advance(args, num, 1);
     }
     void visit(ast::CNOTGate& gate) {
+        flush_barriers();
         auto& [counts, depths] = running_estimate_;
+        arg_list args{gate.ctrl(), gate.tgt()};
+        auto num = registers_.repeats(args);
 
         // Gate count
-        counts["CX"] += 1;
+        counts["CX"] += num.value_or(1);
 
         // Depth
-        int in_depth = std::max(depths[gate.ctrl()], depths[gate.tgt()]);
-        depths[gate.ctrl()] = in_depth + 1;
-        depths[gate.tgt()] = in_depth + 1;
+        advance(args, num, 1);
     }
     void visit(ast::BarrierGate& gate) {
-        auto& [counts, depths] = running_estimate_;
-
-        // Gate count
-        counts["barrier"] += 1;
-
-        // Depth
-        int in_depth = -1;
-        gate.foreach_arg([&in_depth, this](auto& arg) {
-            in_depth = std::max(in_depth, running_estimate_.second[arg]);
-        });
-        gate.foreach_arg([in_depth, this](auto& arg) {
-            running_estimate_.second[arg] = in_depth + 1;
+        // Counted once the run of adjacent barriers ends, see flush_barriers
+        if (registers_.repeats(gate.args()))
+            barrier_registers_ = true;
+
+        // A barrier on a register is a single barrier on all its bits
+        auto& args = barriers_.emplace_back();
+        gate.foreach_arg([&args, this](auto& arg) {
+            if (auto size = registers_.size(arg)) {
+                for (int i = 0; i < *size; i++)
+                    args.emplace_back(registers_.expand(arg, i));
+            } else {
+                args.emplace_back(arg);
+            }
         });
     }
     void visit(ast::DeclaredGate& gate) {
+        flush_barriers();
         auto& [counts, depths] = running_estimate_;
 
         // Gate prefix, appropriately stripped of daggers
@@ -170,40 +185,37 @@ class ResourceEstimator final : public ast::Visitor {
             strip_dagger(tmp);
 
         // Gate sufix. Only included if the parameters are constants
-        std::stringstream ss;
+        name_.clear();
         bool all_constant = true;
         if (gate.num_cargs() > 0) {
             bool flag = true;
-            ss << "(";
-            gate.foreach_carg([&ss, &flag, &all_constant](auto& arg) {
+            name_ << "(";
+            gate.foreach_carg([this, &flag, &all_constant](auto& arg) {
                 auto val = arg.constant_eval();
 
                 // Correct commas
                 if (flag)
                     flag = false;
                 else
-                    ss << ",";
+                    name_ << ",";
 
                 if (val)
-                    ss << *val;
+                    name_ << *val;
                 else
                     all_constant = false;
             });
-            ss << ")";
+            name_ << ")";
         }
 
         // Gate name
         std::string name;
         if (all_constant)
-            name = tmp + ss.str();
+            name = tmp + std::string(name_.str());
         else
             name = tmp;
 
-        // Get the longest critical path into the gate
-        int in_depth = -1;
-        gate.foreach_qarg([&in_depth, this](auto& arg) {
-            in_depth = std::max(in_depth, running_estimate_.second[arg]);
-        });
+        // Number of gates, if applied to whole registers
+        auto num = registers_.repeats(gate.qargs());
 
         // Get the pre-computed resource counts
         auto& [gate_counts, depth_counts] = resource_map_[name];
@@ -211,31 +223,34 @@ class ResourceEstimator final : public ast::Visitor {
         if (config_.unbox &&
             (config_.overrides.find(name) == config_.overrides.end()) &&
             (gate.num_cargs() == 0)) {
-            add_counts(counts, gate_counts);
+            for (int i = 0; i < num.value_or(1); i++)
+                add_counts(counts, gate_counts);
 
             // Note that this gives the depth as if there were a barrier on
             // all involved gates before and after the sub-circuit. Not
             // super ideal
-            int gate_depth = gate_counts["depth"];
-            gate.foreach_qarg([in_depth, this, gate_depth](auto& arg) {
-                running_estimate_.second[arg] = in_depth + gate_depth;
-            });
+            advance(gate.qargs(), num, gate_counts["depth"]);
         } else {
-            counts[name] += 1;
+            counts[name] += num.value_or(1);
 
-            gate.foreach_qarg([in_depth, this](auto& arg) {
-                running_estimate_.second[arg] = in_depth + 1;
-            });
+            advance(gate.qargs(), num, 1);
         }
     }
 
     /* Declarations */
     void visit(ast::GateDecl& decl) {
+        flush_barriers();
+
         // Initialize a new resource count
         auto& local_state = resource_map_[decl.id()];
         std::swap(running_estimate_, local_state);
 
+        registers_.push_scope();
+        for (auto& param : decl.q_params())
+            registers_.declare(param, std::nullopt);
         decl.foreach_stmt([this](auto& gate) { gate.accept(*this); });
+        flush_barriers();
+        registers_.pop_scope();
 
         // Get maximum critical path length
         auto& [counts, depths] = running_estimate_;
@@ -253,6 +268,7 @@ class ResourceEstimator final : public ast::Visitor {
     void visit(ast::OracleDecl&) {}
     void visit(ast::RegisterDecl& decl) {
         auto& [counts, depths] = running_estimate_;
+        registers_.declare(decl.id(), decl.size());
 
         if (decl.is_quantum()) {
             counts["qubits"] += decl.size();
@@ -262,6 +278,7 @@ class ResourceEstimator final : public ast::Visitor {
     }
     void visit(ast::AncillaDecl& decl) {
         auto& [counts, depths] = running_estimate_;
+        registers_.declare(decl.id(), decl.size());
 
         if (!decl.is_dirty())
             counts["ancillas"] += decl.size();
@@ -279,12 +296,74 @@ class ResourceEstimator final : public ast::Visitor {
     config config_;
     std::unordered_map<std::string_view, resource_state> resource_map_;
 
+    using arg_list =
+        std::initializer_list<std::reference_wrapper<const ast::VarAccess>>;
+
     resource_state running_estimate_;
+    transformations::RegisterTable registers_;
+    qasmtools::utils::Emitter name_; ///< Buffer for gate names
+
+    std::vector<std::vector<ast::VarAccess>> barriers_; ///< Pending run
+    bool barrier_registers_ = false; ///< Whether the run spans a register
 
     void reset() {
         resource_map_.clear();
         running_estimate_.first.clear();
         running_estimate_.second.clear();
+        registers_ = transformations::RegisterTable();
+        registers_.push_scope();
+        barriers_.clear();
+        barrier_registers_ = false;
+    }
+
+    // Counts the pending run of adjacent barriers. Eagerly desugaring and
+    // merging barriers (transformations::BarrierMerger) turns a run which
+    // contains a barrier on a whole register into a single barrier on all
+    // the bits, so such a run is counted as one. Other runs were already
+    // merged, if at all, and each barrier counts
+    void flush_barriers() {
+        if (barriers_.empty())
+            return;
+
+        auto& counts = running_estimate_.first;
+        if (barrier_registers_) {
+            std::vector<ast::VarAccess> args;
+            for (auto& barrier : barriers_)
+                args.insert(args.end(), barrier.begin(), barrier.end());
+            counts["barrier"] += 1;
+            advance(args, std::nullopt, 1);
+        } else {
+            for (auto& barrier : barriers_) {
+                counts["barrier"] += 1;
+                advance(barrier, std::nullopt, 1);
+            }
+        }
+
+        barriers_.clear();
+        barrier_registers_ = false;
+    }
+
+    // Moves the critical path through a gate of a given depth on the
+    // arguments, or through each gate of the batch if num is set
+    template <typename Args>
+    void advance(const Args& args, std::optional<int> num, int gate_depth) {
+        auto& depths = running_estimate_.second;
+        if (!num) {
+            int in_depth = 0;
+            for (const ast::VarAccess& arg : args)
+                in_depth = std::max(in_depth, depths[arg]);
+            for (const ast::VarAccess& arg : args)
+                depths[arg] = in_depth + gate_depth;
+            return;
+        }
+
+        std::vector<ast::VarAccess> instance;
+        for (int i = 0; i < *num; i++) {
+            instance.clear();
+            for (const ast::VarAccess& arg : args)
+                instance.emplace_back(registers_.expand(arg, i));
+            advance(instance, std::nullopt, gate_depth);
+        }
     }
 
     void strip_dagger(std::string& str) {
@@ -296,13 +375,14 @@ class ResourceEstimator final : public ast::Visitor {
     }
 };
 
-resource_count estimate_resources(ast::ASTNode& node) {
+inline resource_count estimate_resources(ast::ASTNode& node) {
     ResourceEstimator estimator;
     return estimator.run(node);
 }
 
-resource_count estimate_resources(ast::ASTNode& node,
-                                  const ResourceEstimator::config& params) {
+inline resource_count
+estimate_resources(ast::ASTNode& node,
+                   const ResourceEstimator::config& params) {
     ResourceEstimator estimator(params);
     return estimator.run(node);
 }
@@ -0,0 +1,180 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file tools/thread_pool.hpp
+ * \brief Fixed-size pool of worker threads
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace staq {
+namespace tools {
+
+/**
+ * \class staq::tools::ThreadPool
+ * \brief Runs batches of independent jobs on a fixed set of threads
+ *
+ * A call to run(count, job) evaluates job(k, worker) for every k in
+ * [0, count) and returns once all of them have finished. The calling thread
+ * takes part as worker 0, so a pool of size 1 spawns no threads at all. The
+ * worker index lets callers keep per-thread state (e.g. scratch visitors) in
+ * a vector indexed by worker. Which worker handles which job is unspecified,
+ * so results should be written to slot k rather than accumulated.
+ *
+ * If a job throws, the remaining jobs of the batch are skipped and the
+ * exception is rethrown from run().
+ */
+class ThreadPool {
+  public:
+    /**
+     * \brief Creates a pool
+     * \param num_threads Number of workers, or 0 for the hardware concurrency
+     */
+    explicit ThreadPool(int num_threads = 0) {
+        if (num_threads <= 0) {
+            auto hw = static_cast<int>(std::thread::hardware_concurrency());
+            num_threads = std::max(1, hw);
+        }
+        for (int i = 1; i < num_threads; i++) {
+            threads_.emplace_back([this, i]() { loop(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    /** \brief The number of workers, including the calling thread */
+    int size() const { return static_cast<int>(threads_.size()) + 1; }
+
+    /**
+     * \brief Runs job(k, worker) for k = 0, ..., count - 1 and waits
+     * \param count The number of jobs
+     * \param job The job, called with the job and worker indices
+     */
+    void run(std::size_t count,
+             const std::function<void(std::size_t, int)>& job) {
+        if (threads_.empty()) {
+            for (std::size_t k = 0; k < count; k++) {
+                job(k, 0);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            count_ = count;
+            next_ = 0;
+            busy_ = threads_.size();
+            generation_++;
+        }
+        wake_.notify_all();
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return busy_ == 0; });
+        job_ = nullptr;
+        if (error_) {
+            auto error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+  private:
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+
+    // Current batch, guarded by mutex_ except for the job counter
+    const std::function<void(std::size_t, int)>* job_ = nullptr;
+    std::size_t count_ = 0;
+    std::atomic<std::size_t> next_{0};
+    std::size_t busy_ = 0;
+    std::size_t generation_ = 0;
+    std::exception_ptr error_ = nullptr;
+    bool stop_ = false;
+
+    void loop(int worker) {
+        std::size_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this, seen]() {
+                    return stop_ || generation_ != seen;
+                });
+                if (stop_)
+                    return;
+                seen = generation_;
+            }
+
+            work(worker);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--busy_ == 0)
+                done_.notify_one();
+        }
+    }
+
+    void work(int worker) {
+        for (std::size_t k; (k = next_++) < count_;) {
+            try {
+                (*job_)(k, worker);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_)
+                    error_ = std::current_exception();
+                next_ = count_;
+            }
+        }
+    }
+};
+
+} // namespace tools
+} // namespace staq
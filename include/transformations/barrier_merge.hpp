@@ -47,7 +47,12 @@ namespace parser = qasmtools::parser;
 /**
  * \brief Merges adjacent barriers
  *
- * Traverses an AST and merges all adjacent barriers.
+ * Traverses an AST and merges all adjacent barriers on single qubits.
+ * Barriers with whole register arguments are left as they are, since
+ * desugaring expands their arguments in lockstep: merging `barrier q;` with
+ * `barrier p;` would give `barrier q,p;`, which expands differently (or not at
+ * all if the sizes differ). Merging before and after desugaring thus gives
+ * the same barriers as merging after only.
  */
 
 /* Implementation */
@@ -56,10 +61,26 @@ class BarrierMerger final : public ast::Traverse {
     BarrierMerger() = default;
     ~BarrierMerger() = default;
 
-    std::unordered_map<int, std::list<ast::ptr<ast::Gate>>>
-    run(ast::ASTNode& node) {
+    ast::gate_splices run(ast::ASTNode& node) {
         reset();
         node.accept(*this);
+        return finish();
+    }
+
+    /**
+     * \brief Visits a statement at a known position
+     *
+     * For passes which walk a program themselves and merge barriers as they
+     * go. Statements are visited in program order, then finish() returns the
+     * merges to splice.
+     */
+    void visit_at(const ast::GateHandle& pos, ast::Stmt& stmt) {
+        current_ = pos;
+        stmt.accept(*this);
+    }
+
+    /** \brief Merges the pending barriers and returns all merges */
+    ast::gate_splices finish() {
         clear_barrier();
         return std::move(replacement_list_);
     }
@@ -75,17 +96,41 @@ class BarrierMerger final : public ast::Traverse {
     void visit(ast::DeclaredGate& gate) { clear_barrier(); }
 
     void visit(ast::BarrierGate& gate) {
-        uids_.push_back(gate.uid());
+        auto whole_register = [](const ast::VarAccess& arg) {
+            return !arg.offset();
+        };
+        if (std::any_of(gate.args().begin(), gate.args().end(),
+                        whole_register)) {
+            clear_barrier();
+            return;
+        }
+
+        uids_.push_back({gate.uid(), current_});
         for (auto it = gate.args().begin(); it != gate.args().end(); it++) {
             if (std::find(args_.begin(), args_.end(), *it) == args_.end())
                 args_.push_back(*it);
         }
     }
 
+    /* Bodies */
+    void visit(ast::GateDecl& decl) override {
+        for (auto it = decl.body().begin(); it != decl.body().end(); it++) {
+            current_ = ast::GateHandle(decl.body(), it);
+            (**it).accept(*this);
+        }
+    }
+    void visit(ast::Program& prog) override {
+        for (auto it = prog.body().begin(); it != prog.body().end(); it++) {
+            current_ = ast::GateHandle(prog.body(), it);
+            (**it).accept(*this);
+        }
+    }
+
   private:
-    std::unordered_map<int, std::list<ast::ptr<ast::Gate>>> replacement_list_;
-    std::list<int> uids_;
+    ast::gate_splices replacement_list_;
+    std::list<std::pair<int, ast::GateHandle>> uids_; ///< Pending barriers
     std::vector<ast::VarAccess> args_;
+    ast::GateHandle current_; ///< Position of the statement being visited
 
     void clear_barrier() {
         for (auto it = uids_.begin(); it != uids_.end(); it++) {
@@ -94,11 +139,12 @@ class BarrierMerger final : public ast::Traverse {
                 std::list<ast::ptr<ast::Gate>> tmp;
                 tmp.emplace_back(
                     new ast::BarrierGate(parser::Position(), std::move(args_)));
-                replacement_list_[*it] = std::move(tmp);
+                replacement_list_[it->first] =
+                    std::make_pair(it->second, std::move(tmp));
             } else {
                 // Erase the barrier
-                replacement_list_[*it] =
-                    std::move(std::list<ast::ptr<ast::Gate>>());
+                replacement_list_[it->first] = std::make_pair(
+                    it->second, std::list<ast::ptr<ast::Gate>>());
             }
         }
 
@@ -110,6 +156,7 @@ class BarrierMerger final : public ast::Traverse {
         replacement_list_.clear();
         uids_.clear();
         args_.clear();
+        current_ = ast::GateHandle();
     }
 };
 
@@ -117,7 +164,7 @@ static void merge_barriers(ast::ASTNode& node) {
     BarrierMerger alg;
 
     auto res = alg.run(node);
-    replace_gates(node, std::move(res));
+    splice_gates(node, std::move(res));
 }
 
 } // namespace transformations
@@ -32,10 +32,9 @@
 #pragma once
 
 #include "qasmtools/ast/replacer.hpp"
+#include "transformations/registers.hpp"
 
 #include <list>
-#include <unordered_map>
-#include <variant>
 
 namespace staq {
 namespace transformations {
@@ -49,10 +48,10 @@ namespace ast = qasmtools::ast;
  * applied to a register or registers of qubits at once --
  * with a sequence of individual gate applications
  */
-void desugar(ast::ASTNode& node);
+inline void desugar(ast::ASTNode& node);
 
 /* Implementation */
-class DesugarImpl final : public ast::Replacer {
+class DesugarImpl : public ast::Replacer {
   public:
     DesugarImpl() = default;
     ~DesugarImpl() = default;
@@ -70,7 +69,7 @@ class DesugarImpl final : public ast::Replacer {
     void visit(ast::GateDecl& decl) override {
         push_scope();
         for (auto& param : decl.q_params())
-            set_var(param, {});
+            set_var(param, std::nullopt);
 
         ast::Replacer::visit(decl);
 
@@ -80,13 +79,13 @@ class DesugarImpl final : public ast::Replacer {
     /* Overrides */
     std::optional<std::list<ast::ptr<ast::Stmt>>>
     replace(ast::RegisterDecl& decl) override {
-        set_var(decl.id(), {decl.size()});
+        set_var(decl.id(), decl.size());
         return std::nullopt;
     }
 
     std::optional<std::list<ast::ptr<ast::Gate>>>
     replace(ast::AncillaDecl& decl) override {
-        set_var(decl.id(), {decl.size()});
+        set_var(decl.id(), decl.size());
         return std::nullopt;
     }
 
@@ -222,72 +221,28 @@ class DesugarImpl final : public ast::Replacer {
         }
     }
 
-  private:
-    using type_info = std::variant<std::monostate, int>;
-    std::list<std::unordered_map<std::string, type_info>> symbol_table;
-
-    void push_scope() { symbol_table.push_front({}); }
+  protected:
+    void push_scope() { registers_.push_scope(); }
 
-    void pop_scope() { symbol_table.pop_front(); }
+    void pop_scope() { registers_.pop_scope(); }
 
-    void set_var(std::string x, type_info t) { symbol_table.front()[x] = t; }
-
-    std::optional<type_info> lookup(std::string x) {
-        for (auto& table : symbol_table) {
-            if (auto it = table.find(x); it != table.end()) {
-                return std::make_optional(it->second);
-            }
-        }
+  private:
+    RegisterTable registers_;
 
-        return std::nullopt;
+    void set_var(const std::string& x, std::optional<int> size) {
+        registers_.declare(x, size);
     }
 
-    // Compute the number of repeats with different offsets for a given list of
-    // arguments
     std::optional<int> repeats(const std::vector<ast::VarAccess>& args) {
-        std::optional<int> ret = std::nullopt;
-
-        for (auto& arg : args) {
-            auto ty = lookup(arg.var());
-            if (std::holds_alternative<int>(*ty) && !arg.offset()) {
-                auto size = std::get<int>(*ty);
-                if (!ret) {
-                    ret = size;
-                } else if (size != *ret) {
-                    std::cerr << "Warning: gate or measurement applied to "
-                                 "different size registers\n";
-                }
-            }
-        }
-
-        return ret;
+        return registers_.repeats(args);
     }
 
-    // Expand an argument with a given offset if register typed, otherwise copy
-    // it
     ast::VarAccess expand(const ast::VarAccess& arg, int offset) {
-        auto ty = lookup(arg.var());
-
-        if (std::holds_alternative<int>(*ty) && !arg.offset())
-            return ast::VarAccess(arg.pos(), arg.var(), offset);
-        else
-            return ast::VarAccess(arg);
-    }
-
-    // Debugging
-    void print_current_scope() {
-        for (auto& [x, ty] : symbol_table.front()) {
-            if (std::holds_alternative<int>(ty)) {
-                std::cout << x << ": Register(" << std::get<int>(ty) << "), ";
-            } else {
-                std::cout << x << ": Bit, ";
-            }
-        }
-        std::cout << "\n";
+        return registers_.expand(arg, offset);
     }
 };
 
-void desugar(ast::ASTNode& node) {
+inline void desugar(ast::ASTNode& node) {
     DesugarImpl alg;
     alg.run(node);
 }
@@ -35,6 +35,12 @@
 #include "qasmtools/utils/angle.hpp"
 
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
 #include <variant>
 #include <optional>
 
@@ -79,15 +85,23 @@ namespace ast = qasmtools::ast;
  */
 
 class ExprSimplifier final : public ast::Visitor {
-    /* Rational numbers */
+    /* Rational numbers
+     *
+     * Numerators and denominators are 64-bit, and every operation is checked:
+     * a result which does not fit throws std::overflow_error, and the caller
+     * evaluates the expression in floating point instead. Operands which fit
+     * in 32 bits cannot overflow and take the plain path; larger ones are
+     * reduced by their common factors before multiplying so that
+     * intermediate products stay small.
+     */
     class Rational {
-        int n_; // numerator
-        int d_; // denominator
+        std::int64_t n_; // numerator
+        std::int64_t d_; // denominator
 
       public:
         Rational() : n_(0), d_(1) {}
-        Rational(int n) : n_(n), d_(1) {}
-        Rational(int n, int d) : n_(n), d_(d) {
+        Rational(std::int64_t n) : n_(n), d_(1) {}
+        Rational(std::int64_t n, std::int64_t d) : n_(n), d_(d) {
             if (d == 0)
                 throw std::invalid_argument(
                     "Trying to construct rational with denominator 0");
@@ -95,15 +109,39 @@ class ExprSimplifier final : public ast::Visitor {
         }
 
         bool is_zero() const { return n_ == 0; }
-        int numerator() const { return n_; }
-        int denominator() const { return d_; }
+        std::int64_t numerator() const { return n_; }
+        std::int64_t denominator() const { return d_; }
         double value() const { return (double) n_ / (double) d_; }
 
-        Rational operator-() const { return Rational(-n_, d_); }
+        // whether the numerator and denominator fit in an ast::IntExpr
+        bool fits_int() const {
+            return n_ <= std::numeric_limits<int>::max() &&
+                   -n_ <= std::numeric_limits<int>::max() &&
+                   d_ <= std::numeric_limits<int>::max();
+        }
+
+        Rational operator-() const {
+            // already in lowest form
+            Rational tmp;
+            tmp.n_ = -n_;
+            tmp.d_ = d_;
+            return tmp;
+        }
 
         Rational& operator+=(const Rational& rhs) {
-            int new_n = n_ * rhs.d_ + d_ * rhs.n_;
-            d_ *= rhs.d_;
+            if (rhs.n_ == 0)
+                return *this;
+            if (small() && rhs.small()) {
+                // cannot overflow
+                n_ = n_ * rhs.d_ + d_ * rhs.n_;
+                d_ *= rhs.d_;
+                reduce();
+                return *this;
+            }
+            auto g = gcd(d_, rhs.d_);
+            auto new_n = checked_add(checked_mul(n_, rhs.d_ / g),
+                                     checked_mul(rhs.n_, d_ / g));
+            d_ = checked_mul(d_, rhs.d_ / g);
             n_ = new_n;
             reduce();
             return *this;
@@ -113,15 +151,22 @@ class ExprSimplifier final : public ast::Visitor {
             return *this;
         }
         Rational& operator*=(const Rational& rhs) {
-            n_ *= rhs.n_;
-            d_ *= rhs.d_;
+            if (small() && rhs.small()) {
+                n_ *= rhs.n_;
+                d_ *= rhs.d_;
+                reduce();
+                return *this;
+            }
+            auto g1 = gcd(n_, rhs.d_);
+            auto g2 = gcd(rhs.n_, d_);
+            auto new_n = checked_mul(n_ / g1, rhs.n_ / g2);
+            d_ = checked_mul(d_ / g2, rhs.d_ / g1);
+            n_ = new_n;
             reduce();
             return *this;
         }
         Rational& operator/=(const Rational& rhs) {
-            n_ *= rhs.d_;
-            d_ *= rhs.n_;
-            reduce();
+            *this *= Rational(rhs.d_, rhs.n_);
             return *this;
         }
         friend Rational operator+(const Rational& lhs, const Rational& rhs) {
@@ -144,7 +189,11 @@ class ExprSimplifier final : public ast::Visitor {
         }
 
         ast::ptr<ast::Expr> to_ast() const {
-            ast::ptr<ast::Expr> tmp = ast::IntExpr::create({}, std::abs(n_));
+            if (!fits_int()) {
+                return ast::RealExpr::create({}, value());
+            }
+            ast::ptr<ast::Expr> tmp =
+                ast::IntExpr::create({}, static_cast<int>(std::abs(n_)));
             if (n_ < 0) {
                 // unary minus
                 tmp = ast::UExpr::create({}, ast::UnaryOp::Neg, std::move(tmp));
@@ -155,16 +204,47 @@ class ExprSimplifier final : public ast::Visitor {
             }
             // expression has a demonimator
             return ast::BExpr::create({}, std::move(tmp), ast::BinaryOp::Divide,
-                                      ast::IntExpr::create({}, d_));
+                                      ast::IntExpr::create({}, (int) d_));
         }
 
       private:
+        // The range is kept symmetric so that negation never overflows
+        static constexpr std::int64_t max_ =
+            std::numeric_limits<std::int64_t>::max();
+
+        // whether both parts fit in 32 bits
+        bool small() const {
+            return n_ == (std::int32_t) n_ && d_ == (std::int32_t) d_;
+        }
+
+        static std::int64_t checked_add(std::int64_t a, std::int64_t b) {
+            if ((b > 0 && a > max_ - b) || (b < 0 && a < -max_ - b))
+                throw std::overflow_error("Rational addition overflows");
+            return a + b;
+        }
+
+        static std::int64_t checked_mul(std::int64_t a, std::int64_t b) {
+            // products of 32-bit values always fit
+            if (a == (std::int32_t) a && b == (std::int32_t) b)
+                return a * b;
+            if (a != 0 && std::abs(b) > max_ / std::abs(a))
+                throw std::overflow_error("Rational multiplication overflows");
+            return a * b;
+        }
+
+        static std::int64_t gcd(std::int64_t a, std::int64_t b) {
+            // 32-bit division is considerably faster
+            if (a == (std::int32_t) a && b == (std::int32_t) b)
+                return std::gcd((std::int32_t) a, (std::int32_t) b);
+            return std::gcd(a, b);
+        }
+
         void reduce() {
             if (n_ == 0) {
                 d_ = 1;
             } else {
                 // bring into lowest form
-                auto tmp = std::gcd(n_, d_);
+                auto tmp = gcd(n_, d_);
                 n_ = n_ / tmp;
                 d_ = d_ / tmp;
 
@@ -276,9 +356,13 @@ class ExprSimplifier final : public ast::Visitor {
                 // no 'pi' term
                 return constant_.to_ast();
             }
+            if (!coefficient_.fits_int() || !constant_.fits_int()) {
+                // not expressible with integer literals
+                return ast::RealExpr::create({}, value());
+            }
             ast::ptr<ast::Expr> tmp = ast::PiExpr::create({});
             // numerator
-            int a = coefficient_.numerator();
+            int a = (int) coefficient_.numerator();
             if (a == 1) {
             } // multiplication by 1 is omitted
             else if (a == -1) {
@@ -297,7 +381,7 @@ class ExprSimplifier final : public ast::Visitor {
                                          ast::BinaryOp::Times, std::move(tmp));
             }
             // denominator
-            int b = coefficient_.denominator();
+            int b = (int) coefficient_.denominator();
             if (b != 1) {
                 // a*pi/b
                 tmp = ast::BExpr::create({}, std::move(tmp),
@@ -329,9 +413,17 @@ class ExprSimplifier final : public ast::Visitor {
 
     using Expression = std::variant<std::monostate, double, LinearPiExpr>;
 
+    /* The simplification of a shared expression */
+    struct shared_result {
+        std::shared_ptr<const ast::Expr> expr; ///< Keeps the key alive
+        Expression value;
+        std::shared_ptr<const ast::Expr> simplified;
+    };
+
     Expression temp_value;
     std::optional<ast::ptr<ast::Expr>> replacement_expr;
     bool evaluate_all;
+    std::unordered_map<const ast::Expr*, shared_result> shared_;
 
   public:
     ExprSimplifier(bool evaluate_all = false) : evaluate_all(evaluate_all) {}
@@ -361,32 +453,38 @@ class ExprSimplifier final : public ast::Visitor {
         std::visit(
             qasmtools::utils::overloaded{
                 [this, &expr](LinearPiExpr& lpe1, LinearPiExpr& lpe2) {
-                    switch (expr.op()) {
-                        case ast::BinaryOp::Plus:
-                            temp_value = lpe1 + lpe2;
-                            break;
-                        case ast::BinaryOp::Minus:
-                            temp_value = lpe1 - lpe2;
-                            break;
-                        case ast::BinaryOp::Times: {
-                            auto prod = lpe1 * lpe2;
-                            if (prod)
-                                temp_value = *prod;
-                            else
-                                temp_value = lpe1.value() * lpe2.value();
-                            break;
-                        }
-                        case ast::BinaryOp::Divide: {
-                            auto quot = lpe1 / lpe2;
-                            if (quot)
-                                temp_value = *quot;
-                            else
-                                temp_value = lpe1.value() / lpe2.value();
-                            break;
+                    try {
+                        switch (expr.op()) {
+                            case ast::BinaryOp::Plus:
+                                temp_value = lpe1 + lpe2;
+                                break;
+                            case ast::BinaryOp::Minus:
+                                temp_value = lpe1 - lpe2;
+                                break;
+                            case ast::BinaryOp::Times: {
+                                auto prod = lpe1 * lpe2;
+                                if (prod)
+                                    temp_value = *prod;
+                                else
+                                    temp_value = lpe1.value() * lpe2.value();
+                                break;
+                            }
+                            case ast::BinaryOp::Divide: {
+                                auto quot = lpe1 / lpe2;
+                                if (quot)
+                                    temp_value = *quot;
+                                else
+                                    temp_value = lpe1.value() / lpe2.value();
+                                break;
+                            }
+                            case ast::BinaryOp::Pow:
+                                temp_value = pow(lpe1.value(), lpe2.value());
+                                break;
                         }
-                        case ast::BinaryOp::Pow:
-                            temp_value = pow(lpe1.value(), lpe2.value());
-                            break;
+                    } catch (const std::overflow_error&) {
+                        // too large for exact rationals
+                        temp_value = evaluate_double_bexpr(
+                            lpe1.value(), expr.op(), lpe2.value());
                     }
                 },
                 [this, &expr](LinearPiExpr& lpe1, double real2) {
@@ -562,6 +660,32 @@ class ExprSimplifier final : public ast::Visitor {
 
     void visit(ast::VarExpr&) { temp_value = std::monostate(); }
 
+    // Shared expressions are immutable, so each one is simplified once, on
+    // a copy of its top node, into a new shared expression
+    void visit(ast::SharedExpr& expr) {
+        auto it = shared_.find(&expr.target());
+        if (it == shared_.end()) {
+            auto tmp = ast::object::clone(expr.target());
+            tmp->accept(*this);
+            if (replacement_expr) {
+                tmp = std::move(*replacement_expr);
+                replacement_expr = std::nullopt;
+            } else if (std::holds_alternative<LinearPiExpr>(temp_value)) {
+                tmp = std::get<LinearPiExpr>(temp_value).to_ast();
+            } else if (std::holds_alternative<double>(temp_value)) {
+                tmp = ast::RealExpr::create({}, std::get<double>(temp_value));
+            }
+            it = shared_
+                     .emplace(&expr.target(),
+                              shared_result{expr.shared_target(), temp_value,
+                                            std::move(tmp)})
+                     .first;
+        }
+        temp_value = it->second.value;
+        replacement_expr =
+            ast::SharedExpr::create(expr.pos(), it->second.simplified);
+    }
+
     // Statements
     void visit(ast::MeasureStmt&) {}
     void visit(ast::ResetStmt&) {}
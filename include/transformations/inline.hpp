@@ -31,9 +31,13 @@
 
 #pragma once
 
+#include "qasmtools/ast/expr_pool.hpp"
 #include "qasmtools/ast/replacer.hpp"
+#include "qasmtools/ast/traversal.hpp"
 #include "substitution.hpp"
 
+#include <algorithm>
+#include <limits>
 #include <set>
 #include <unordered_map>
 
@@ -48,6 +52,25 @@ namespace ast = qasmtools::ast;
  * Traverses an AST and inlines all gate calls. By default qelib calls are NOT
  * inlined, but optionally can be. Local ancillas are hoisted to the global
  * level and reused
+ *
+ * Each gate declaration is compiled once into a template of its body, in
+ * which every qubit argument refers to a slot (a parameter, a local ancilla,
+ * or nothing) and every expression is marked if it uses a classical
+ * parameter. A call then fills the slots and copies the body in one pass,
+ * with the same result as substituting into a clone of the body.
+ *
+ * Since inlining is post-order, compiled bodies are fully flattened, so a
+ * call costs the size of its flattened body regardless of the nesting depth.
+ * To bound the memory this takes, calls inside a declaration are only inlined
+ * while the gates they add to it stay within config.max_flat_size.
+ * Calls above the cap are left in the declaration and expanded on the fly
+ * wherever it is used, with the same result.
+ *
+ * With config.share_expressions, the parameters of inlined gates are interned
+ * in an ast::ExprPool and referenced by ast::SharedExpr nodes. Equal
+ * parameters are then stored once, a parameter which does not use the
+ * arguments of the call is copied by reference, and one which does is built
+ * from the interned arguments.
  */
 
 /* \brief Default overrides */
@@ -62,6 +85,8 @@ class Inliner final : public ast::Replacer {
         bool keep_declarations = true;
         std::set<std::string_view> overrides = default_overrides;
         std::string ancilla_name = "anc";
+        std::size_t max_flat_size = 1 << 16; ///< Gates per flattened body
+        bool share_expressions = false; ///< Intern the inlined parameters
     };
 
     Inliner() = default;
@@ -84,6 +109,13 @@ class Inliner final : public ast::Replacer {
         prog.accept(cleaner_);
     }
 
+    void visit(ast::GateDecl& decl) override {
+        in_decl_ = true;
+        flat_size_ = 0;
+        ast::Replacer::visit(decl);
+        in_decl_ = false;
+    }
+
     std::optional<std::list<ast::ptr<ast::Stmt>>>
     replace(ast::GateDecl& decl) override {
         // Replacement is post-order, so body should already be inlined
@@ -96,9 +128,8 @@ class Inliner final : public ast::Replacer {
             auto& tmp = gate_decls_[decl.id()];
             tmp.c_params = decl.c_params();
             tmp.q_params = decl.q_params();
-            decl.foreach_stmt(
-                [this, &tmp](auto& gate) { tmp.body.push_back(&gate); });
             tmp.ancillas.swap(current_ancillas);
+            compile(decl, tmp);
 
             return std::nullopt;
         }
@@ -125,87 +156,29 @@ class Inliner final : public ast::Replacer {
         }
 
         if (auto it = gate_decls_.find(gate.name()); it != gate_decls_.end()) {
-            // Substitute classical arguments
-            std::unordered_map<std::string_view, ast::Expr*> c_subst;
-            for (auto i = 0; i < gate.num_cargs(); i++) {
-                c_subst[it->second.c_params[i]] = &gate.carg(i);
-            }
-            SubstVar var_subst(c_subst);
-
-            // Substitute quantum arguments
-            std::unordered_map<ast::VarAccess, ast::VarAccess> q_subst;
-            for (auto i = 0; i < gate.num_qargs(); i++) {
-                q_subst.insert(
-                    {ast::VarAccess(gate.pos(), it->second.q_params[i]),
-                     gate.qarg(i)});
-            }
-
-            // For local ancillas
-            auto anc_offset = 0;
-            auto reg = registers_.begin();
-            auto reg_offset = 0;
-            for (auto& anc : it->second.ancillas) {
-                if (anc.dirty) {
-                    // Try to find an unused qubit to use as a dirty ancilla
-                    auto i = 0;
-
-                    while (i < anc.size) {
-                        if (reg == registers_.end()) {
-                            // Switch to clean ancillas
-                            q_subst.insert(
-                                {ast::VarAccess(gate.pos(), anc.name, i++),
-                                 ast::VarAccess(gate.pos(),
-                                                config_.ancilla_name,
-                                                anc_offset++)});
-
-                        } else if (reg_offset >= reg->second) {
-                            // Move to the next register
-                            reg++;
-                            reg_offset = 0;
-
-                        } else {
-                            // Check whether this qubit is used in the gate
-                            bool used = false;
-                            gate.foreach_qarg(
-                                [&used, &reg, &reg_offset](auto& arg) {
-                                    used = used || (arg.var() == reg->first &&
-                                                    arg.offset() == reg_offset);
-                                });
-
-                            if (!used) {
-                                q_subst.insert(
-                                    {ast::VarAccess(gate.pos(), anc.name, i++),
-                                     ast::VarAccess(gate.pos(), reg->first,
-                                                    reg_offset)});
-                            }
-
-                            reg_offset++;
-                        }
-                    }
-                } else {
-                    q_subst.insert(
-                        {ast::VarAccess(gate.pos(), anc.name),
-                         ast::VarAccess(gate.pos(), config_.ancilla_name,
-                                        anc_offset)});
-                    anc_offset += anc.size;
+            auto& info = it->second;
+            auto slots = fill_slots(gate, info);
+
+            // Keep calls above the cap to expand with the declaration
+            if (in_decl_) {
+                if (info.flat_size > config_.max_flat_size - flat_size_) {
+                    nested_slots_[&gate] = std::move(slots);
+                    return std::nullopt;
                 }
+                flat_size_ += info.flat_size;
             }
-            SubstAP ap_subst(q_subst);
 
-            // Adjust the number of ancillas used
-            if (anc_offset > max_ancilla_) {
-                max_ancilla_ = anc_offset;
+            // Classical arguments
+            c_subst_map c_subst;
+            for (auto i = 0; i < gate.num_cargs(); i++) {
+                if (config_.share_expressions)
+                    gate.set_carg(i, pool_.share(gate.carg(i)));
+                c_subst[info.c_params[i]] = &gate.carg(i);
             }
 
-            // Clone & substitute the gate body
+            // Instantiate the gate body
             std::list<ast::ptr<ast::Gate>> body;
-
-            for (auto gate : it->second.body) {
-                auto new_gate = ast::object::clone(*gate);
-                new_gate->accept(var_subst);
-                new_gate->accept(ap_subst);
-                body.emplace_back(std::move(new_gate));
-            }
+            expand(info, c_subst, slots, body);
 
             return std::move(body);
         } else {
@@ -245,21 +218,70 @@ class Inliner final : public ast::Replacer {
         }
     };
 
+    /* Helper class checking whether an expression uses any of some variables */
+    class UsesVar final : public ast::Traverse {
+        const std::vector<ast::symbol>& vars_;
+
+      public:
+        bool found = false;
+
+        UsesVar(const std::vector<ast::symbol>& vars) : vars_(vars) {}
+        void visit(ast::VarExpr& expr) override {
+            for (auto& var : vars_) {
+                found = found || expr.var() == var;
+            }
+        }
+    };
+
     struct ancilla_info {
         ast::symbol name;
         int size;
         bool dirty;
     };
 
+    /* Where a qubit argument of a gate body comes from */
+    struct qubit_slot {
+        int slot = -1;      ///< Slot of the access, or -1 to copy it as is
+        bool whole = false; ///< Whether the slot stands for a whole register
+    };
+
+    struct gate_info;
+
+    /* A statement of a compiled gate body */
+    struct gate_template {
+        enum kind_t { U, CX, Barrier, Declared, Nested, Other };
+
+        ast::Gate* gate;
+        kind_t kind;
+        std::vector<bool> c_dependent; ///< Expressions using c_params
+
+        // For calls above the cap, the callee and its slots in terms of the
+        // declaration
+        const gate_info* callee = nullptr;
+        std::vector<ast::VarAccess> slots{};
+
+        std::vector<ast::ExprPool::node> shared{}; ///< Interned expressions
+    };
+
     struct gate_info {
         std::vector<ast::symbol> c_params;
         std::vector<ast::symbol> q_params;
-        std::list<ast::Gate*> body;
         std::list<ancilla_info> ancillas;
+
+        // The compiled body. Slots are numbered as the parameters, then one
+        // per dirty ancilla qubit and one per clean ancilla register
+        std::vector<gate_template> body;
+        std::vector<qubit_slot> qubits; ///< In order of appearance
+        std::unordered_map<ast::VarAccess, int> slot_of;
+        int num_slots = 0;
+        std::size_t flat_size = 0; ///< Gates in the fully flattened body
     };
 
+    using c_subst_map = std::unordered_map<std::string_view, ast::Expr*>;
+
     config config_;
     std::unordered_map<std::string_view, gate_info> gate_decls_;
+    ast::ExprPool pool_;
     Cleaner cleaner_;
     int max_ancilla_ = 0;
     std::list<std::pair<ast::symbol, int>> registers_;
@@ -267,6 +289,327 @@ class Inliner final : public ast::Replacer {
     // Gate-local accumulating values
     std::list<ancilla_info> current_ancillas;
     int num_ancilla = 0;
+    bool in_decl_ = false;
+    std::size_t flat_size_ = 0; ///< Gates inlined into the declaration
+    std::unordered_map<ast::DeclaredGate*, std::vector<ast::VarAccess>>
+        nested_slots_; ///< Slots of the calls left in the declaration
+
+    // Fills the slots of a call: the arguments, then the local ancillas
+    std::vector<ast::VarAccess> fill_slots(ast::DeclaredGate& gate,
+                                           const gate_info& info) {
+        std::vector<ast::VarAccess> slots;
+        slots.reserve(info.num_slots);
+        for (auto i = 0; i < gate.num_qargs(); i++) {
+            slots.push_back(gate.qarg(i));
+        }
+
+        // For local ancillas
+        auto anc_offset = 0;
+        auto reg = registers_.begin();
+        auto reg_offset = 0;
+        for (auto& anc : info.ancillas) {
+            if (anc.dirty) {
+                // Try to find an unused qubit to use as a dirty ancilla
+                auto i = 0;
+
+                while (i < anc.size) {
+                    if (reg == registers_.end()) {
+                        // Switch to clean ancillas
+                        slots.emplace_back(gate.pos(), config_.ancilla_name,
+                                           anc_offset++);
+                        i++;
+
+                    } else if (reg_offset >= reg->second) {
+                        // Move to the next register
+                        reg++;
+                        reg_offset = 0;
+
+                    } else {
+                        // Check whether this qubit is used in the gate
+                        bool used = false;
+                        gate.foreach_qarg(
+                            [&used, &reg, &reg_offset](auto& arg) {
+                                used = used || (arg.var() == reg->first &&
+                                                arg.offset() == reg_offset);
+                            });
+
+                        if (!used) {
+                            slots.emplace_back(gate.pos(), reg->first,
+                                               reg_offset);
+                            i++;
+                        }
+
+                        reg_offset++;
+                    }
+                }
+            } else {
+                slots.emplace_back(gate.pos(), config_.ancilla_name,
+                                   anc_offset);
+                anc_offset += anc.size;
+            }
+        }
+
+        // Adjust the number of ancillas used
+        if (anc_offset > max_ancilla_) {
+            max_ancilla_ = anc_offset;
+        }
+
+        return slots;
+    }
+
+    // Compiles the body of a gate declaration
+    void compile(ast::GateDecl& decl, gate_info& info) {
+        // The accesses each slot replaces. Later duplicates are shadowed
+        auto add_slot = [&info](ast::VarAccess va) {
+            info.slot_of.insert({std::move(va), info.num_slots++});
+        };
+        for (auto& param : info.q_params) {
+            add_slot(ast::VarAccess(decl.pos(), param));
+        }
+        for (auto& anc : info.ancillas) {
+            if (anc.dirty) {
+                for (auto i = 0; i < anc.size; i++) {
+                    add_slot(ast::VarAccess(decl.pos(), anc.name, i));
+                }
+            } else {
+                add_slot(ast::VarAccess(decl.pos(), anc.name));
+            }
+        }
+
+        auto slot = [&info](ast::VarAccess& va) {
+            info.qubits.push_back(find_slot(info, va));
+        };
+        auto dependent = [&info](ast::Expr& expr) {
+            UsesVar uses(info.c_params);
+            expr.accept(uses);
+            return uses.found;
+        };
+        auto share = [this](gate_template& tmp, ast::Expr& expr) {
+            if (config_.share_expressions)
+                tmp.shared.push_back(pool_.intern(expr));
+        };
+
+        decl.foreach_stmt([this, &info, &slot, &dependent,
+                           &share](ast::Gate& gate) {
+            gate_template tmp{&gate, kind_of(gate), {}};
+            auto size = std::size_t{1};
+            switch (tmp.kind) {
+                case gate_template::U: {
+                    auto& u = static_cast<ast::UGate&>(gate);
+                    tmp.c_dependent = {dependent(u.theta()),
+                                       dependent(u.phi()),
+                                       dependent(u.lambda())};
+                    share(tmp, u.theta());
+                    share(tmp, u.phi());
+                    share(tmp, u.lambda());
+                    slot(u.arg());
+                    break;
+                }
+                case gate_template::CX: {
+                    auto& cx = static_cast<ast::CNOTGate&>(gate);
+                    slot(cx.ctrl());
+                    slot(cx.tgt());
+                    break;
+                }
+                case gate_template::Barrier:
+                    static_cast<ast::BarrierGate&>(gate).foreach_arg(slot);
+                    break;
+                case gate_template::Declared: {
+                    auto& dg = static_cast<ast::DeclaredGate&>(gate);
+                    if (auto it = nested_slots_.find(&dg);
+                        it != nested_slots_.end()) {
+                        tmp.kind = gate_template::Nested;
+                        tmp.callee = &gate_decls_.at(dg.name());
+                        tmp.slots = std::move(it->second);
+                        nested_slots_.erase(it);
+                        size = tmp.callee->flat_size;
+                        break;
+                    }
+                    dg.foreach_carg(
+                        [&tmp, &dependent, &share](ast::Expr& expr) {
+                            tmp.c_dependent.push_back(dependent(expr));
+                            share(tmp, expr);
+                        });
+                    dg.foreach_qarg(slot);
+                    break;
+                }
+                default:
+                    break;
+            }
+            info.body.push_back(std::move(tmp));
+
+            // Saturates, since nesting can double the size at every level
+            info.flat_size =
+                std::min(info.flat_size + size,
+                         std::numeric_limits<std::size_t>::max() / 2);
+        });
+    }
+
+    // Expands a call of a compiled gate, given its slots
+    void expand(const gate_info& info, c_subst_map& c_subst,
+                const std::vector<ast::VarAccess>& slots,
+                std::list<ast::ptr<ast::Gate>>& out) {
+        auto qubit = info.qubits.cbegin();
+        for (auto& tmp : info.body) {
+            if (tmp.kind == gate_template::Nested)
+                expand_nested(info, tmp, c_subst, slots, out);
+            else
+                out.emplace_back(instantiate(tmp, c_subst, slots, qubit));
+        }
+    }
+
+    // Expands a call left in a declaration in terms of the declaration, then
+    // maps the result as if it had been inlined into the declaration
+    void expand_nested(const gate_info& info, const gate_template& tmp,
+                       c_subst_map& c_subst,
+                       const std::vector<ast::VarAccess>& slots,
+                       std::list<ast::ptr<ast::Gate>>& out) {
+        auto& call = static_cast<ast::DeclaredGate&>(*tmp.gate);
+        c_subst_map nested_subst;
+        for (auto i = 0; i < call.num_cargs(); i++) {
+            nested_subst[tmp.callee->c_params[i]] = &call.carg(i);
+        }
+        std::list<ast::ptr<ast::Gate>> nested;
+        expand(*tmp.callee, nested_subst, tmp.slots, nested);
+
+        auto arg = [&info, &slots](const ast::VarAccess& va) {
+            return map_arg(find_slot(info, va), slots, va);
+        };
+        auto expr = [this, &c_subst](ast::Expr& e, std::size_t) {
+            if (config_.share_expressions)
+                return shared(pool_.intern(e), true, c_subst, e);
+            return substitute(c_subst, e);
+        };
+        for (auto& gate : nested) {
+            out.emplace_back(build(*gate, kind_of(*gate), arg, expr));
+        }
+    }
+
+    // Copies a statement of a compiled gate body for a call
+    ast::ptr<ast::Gate>
+    instantiate(const gate_template& tmp, c_subst_map& c_subst,
+                const std::vector<ast::VarAccess>& slots,
+                std::vector<qubit_slot>::const_iterator& qubit) {
+        auto arg = [&slots, &qubit](const ast::VarAccess& va) {
+            return map_arg(*qubit++, slots, va);
+        };
+        auto expr = [this, &tmp, &c_subst](ast::Expr& e, std::size_t i) {
+            if (config_.share_expressions)
+                return shared(tmp.shared[i], tmp.c_dependent[i], c_subst, e);
+            if (tmp.c_dependent[i])
+                return substitute(c_subst, e);
+            return ast::object::clone(e);
+        };
+
+        return build(*tmp.gate, tmp.kind, arg, expr);
+    }
+
+    static gate_template::kind_t kind_of(ast::Gate& gate) {
+        if (dynamic_cast<ast::UGate*>(&gate))
+            return gate_template::U;
+        else if (dynamic_cast<ast::CNOTGate*>(&gate))
+            return gate_template::CX;
+        else if (dynamic_cast<ast::BarrierGate*>(&gate))
+            return gate_template::Barrier;
+        else if (dynamic_cast<ast::DeclaredGate*>(&gate))
+            return gate_template::Declared;
+        else
+            return gate_template::Other;
+    }
+
+    static qubit_slot find_slot(const gate_info& info,
+                                const ast::VarAccess& va) {
+        qubit_slot ret;
+        if (auto it = info.slot_of.find(va); it != info.slot_of.end()) {
+            ret.slot = it->second;
+        } else if (va.offset()) {
+            if (auto it = info.slot_of.find(ast::VarAccess(va.pos(), va.var()));
+                it != info.slot_of.end()) {
+                ret.slot = it->second;
+                ret.whole = true;
+            }
+        }
+        return ret;
+    }
+
+    static ast::VarAccess map_arg(qubit_slot qubit,
+                                  const std::vector<ast::VarAccess>& slots,
+                                  const ast::VarAccess& va) {
+        if (qubit.slot < 0)
+            return va;
+
+        auto& val = slots[qubit.slot];
+        if (!qubit.whole)
+            return ast::VarAccess(va.pos(), val.var(), val.offset());
+        else if (val.offset())
+            return ast::VarAccess(va.pos(), val.var(),
+                                  *va.offset() + *val.offset());
+        else
+            return ast::VarAccess(va.pos(), val.var(), *va.offset());
+    }
+
+    static ast::ptr<ast::Expr> substitute(c_subst_map& c_subst,
+                                          ast::Expr& e) {
+        // A replacer can't replace the node it is applied to
+        if (auto var = dynamic_cast<ast::VarExpr*>(&e)) {
+            if (auto it = c_subst.find(var->var()); it != c_subst.end())
+                return ast::object::clone(*it->second);
+        }
+        auto ret = ast::object::clone(e);
+        if (!c_subst.empty())
+            subst_var_expr(c_subst, *ret);
+        return ret;
+    }
+
+    // Refers to an interned expression, with the arguments substituted
+    ast::ptr<ast::Expr> shared(const ast::ExprPool::node& node, bool dependent,
+                               c_subst_map& c_subst, ast::Expr& e) {
+        return ast::SharedExpr::create(
+            e.pos(), dependent ? pool_.substitute(node, c_subst) : node);
+    }
+
+    // Copies a gate with its arguments and expressions mapped
+    template <typename Arg, typename Expr>
+    static ast::ptr<ast::Gate> build(ast::Gate& g, gate_template::kind_t kind,
+                                     Arg& arg, Expr& expr) {
+        switch (kind) {
+            case gate_template::U: {
+                auto& gate = static_cast<ast::UGate&>(g);
+                return std::make_unique<ast::UGate>(
+                    gate.pos(), expr(gate.theta(), 0), expr(gate.phi(), 1),
+                    expr(gate.lambda(), 2), arg(gate.arg()));
+            }
+            case gate_template::CX: {
+                auto& gate = static_cast<ast::CNOTGate&>(g);
+                auto ctrl = arg(gate.ctrl());
+                return std::make_unique<ast::CNOTGate>(
+                    gate.pos(), std::move(ctrl), arg(gate.tgt()));
+            }
+            case gate_template::Barrier: {
+                auto& gate = static_cast<ast::BarrierGate&>(g);
+                std::vector<ast::VarAccess> args;
+                gate.foreach_arg(
+                    [&args, &arg](auto& va) { args.push_back(arg(va)); });
+                return std::make_unique<ast::BarrierGate>(gate.pos(),
+                                                          std::move(args));
+            }
+            case gate_template::Declared: {
+                auto& gate = static_cast<ast::DeclaredGate&>(g);
+                std::vector<ast::ptr<ast::Expr>> c_args;
+                for (auto i = 0; i < gate.num_cargs(); i++) {
+                    c_args.emplace_back(expr(gate.carg(i), i));
+                }
+                std::vector<ast::VarAccess> q_args;
+                gate.foreach_qarg(
+                    [&q_args, &arg](auto& va) { q_args.push_back(arg(va)); });
+                return std::make_unique<ast::DeclaredGate>(
+                    gate.pos(), gate.name(), std::move(c_args),
+                    std::move(q_args));
+            }
+            default:
+                return ast::object::clone(g);
+        }
+    }
 };
 
 static void inline_ast(ast::ASTNode& node) {
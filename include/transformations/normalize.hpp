@@ -0,0 +1,94 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file transformations/normalize.hpp
+ * \brief Fused pre-processing of a program
+ */
+
+#pragma once
+
+#include "transformations/desugar.hpp"
+#include "transformations/barrier_merge.hpp"
+#include "transformations/expression_simplifier.hpp"
+
+namespace staq {
+namespace transformations {
+
+namespace ast = qasmtools::ast;
+
+/**
+ * \class staq::transformations::Normalizer
+ * \brief Expression rewriting, desugaring and barrier merging in one walk
+ *
+ * Gives the same result as expr_simplify, desugar and merge_barriers applied
+ * in turn, but handles each statement of the program completely before
+ * moving on to the next. Each statement has its expressions simplified, is
+ * desugared in the scope declared so far, and the statements it expands to
+ * are handed to the barrier merger at their final positions, so the program
+ * is walked once instead of three times.
+ */
+class Normalizer final : public DesugarImpl {
+  public:
+    Normalizer(bool evaluate_all = false) : simplifier_(evaluate_all) {}
+
+    void run(ast::Program& prog) { prog.accept(*this); }
+
+    void visit(ast::Program& prog) override {
+        auto& body = prog.body();
+
+        push_scope();
+        for (auto it = body.begin(); it != body.end();) {
+            auto next = std::next(it);
+
+            (**it).accept(simplifier_);
+            if (auto rep = take_replacement(**it)) {
+                body.splice(next, std::move(*rep));
+                it = body.erase(it);
+            }
+
+            for (; it != next; it++) {
+                merger_.visit_at(ast::GateHandle(body, it), **it);
+            }
+        }
+        pop_scope();
+
+        ast::splice_gates(prog, merger_.finish());
+    }
+
+  private:
+    ExprSimplifier simplifier_;
+    BarrierMerger merger_;
+};
+
+/** \brief Rewrites expressions, desugars and merges barriers in one walk */
+inline void normalize(ast::Program& prog, bool evaluate_all = false) {
+    Normalizer alg(evaluate_all);
+    alg.run(prog);
+}
+
+} // namespace transformations
+} // namespace staq
@@ -32,7 +32,14 @@
 #pragma once
 
 #include "qasmtools/ast/replacer.hpp"
+#include "qasmtools/ast/traversal.hpp"
 #include "synthesis/logic_synthesis.hpp"
+#include "synthesis/oracle_cache.hpp"
+#include "tools/thread_pool.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
 
 namespace staq {
 namespace transformations {
@@ -45,30 +52,163 @@ namespace ast = qasmtools::ast;
  * Visits an AST and synthesizes any declared oracles,
  * replacing them with regular gate declarations which may
  * optionally declare local ancillas
+ *
+ * Synthesized oracles are cached by the contents of their logic file (see
+ * synthesis::OracleCache), so that a file referenced by several oracles, or
+ * compiled again with config.cache_dir set, is only synthesized once.
+ *
+ * With run(), the logic files of all oracle declarations are synthesized
+ * up front, concurrently on config.num_threads workers, and the resulting
+ * gate declarations then replace the oracles in source order. Synthesis
+ * portfolios on more than one worker try their candidates serially.
  */
 
 /* Implementation */
 class OracleSynthesizer final : public ast::Replacer {
   public:
+    /**
+     * \class staq::transformations::OracleSynthesizer::config
+     * \brief Holds configuration options
+     */
+    struct config {
+        bool cache = true;     ///< Reuse oracles synthesized in this process
+        std::string cache_dir; ///< Directory of the on-disk cache, if any
+        int num_threads = 0;   ///< Workers, or 0 for the hardware concurrency
+        synthesis::LogicSynthesizer::config synthesis; ///< Synthesis settings
+    };
+
     OracleSynthesizer() = default;
+    OracleSynthesizer(const config& params)
+        : config_(params), cache_(params.cache_dir) {}
     ~OracleSynthesizer() = default;
 
+    /** \brief Synthesizes the oracles of an AST in parallel */
+    void run(ast::ASTNode& node) {
+        struct collector final : public ast::Traverse {
+            std::vector<std::string> fnames;
+            void visit(ast::OracleDecl& decl) override {
+                fnames.push_back(decl.fname());
+            }
+        } decls;
+        node.accept(decls);
+
+        // One job per distinct logic file, or per distinct contents when
+        // caching, so that no two workers synthesize the same circuit
+        std::vector<std::pair<std::string, std::optional<cache_key>>> jobs;
+        std::unordered_map<std::string, std::size_t> job_of;
+        std::unordered_map<std::uint64_t, std::size_t> job_of_key;
+        for (auto& fname : decls.fnames) {
+            if (ready_.find(fname) != ready_.end() ||
+                job_of.find(fname) != job_of.end())
+                continue;
+            auto key = key_of(fname);
+            if (key) {
+                auto [it, fresh] = job_of_key.emplace(key->hash, jobs.size());
+                if (!fresh && jobs[it->second].second == key) {
+                    job_of[fname] = it->second;
+                    continue;
+                }
+            }
+            job_of[fname] = jobs.size();
+            jobs.emplace_back(fname, key);
+        }
+
+        std::vector<std::optional<synthesis::oracle_circuit>> circuits(
+            jobs.size());
+        auto num_threads = config_.num_threads;
+        if (num_threads <= 0)
+            num_threads = static_cast<int>(std::thread::hardware_concurrency());
+        num_threads =
+            std::max(1, std::min(num_threads, static_cast<int>(jobs.size())));
+        // Portfolios already run on one of our workers, so they try their
+        // candidates serially rather than on a pool of their own
+        auto settings = config_.synthesis;
+        if (num_threads > 1)
+            settings.num_threads = 1;
+        tools::ThreadPool pool(num_threads);
+        pool.run(jobs.size(), [&](std::size_t k, int) {
+            auto& [fname, key] = jobs[k];
+            circuits[k] = synthesize(fname, key, settings);
+        });
+        for (auto& [fname, k] : job_of) {
+            ready_.emplace(fname, circuits[k]);
+        }
+
+        node.accept(*this);
+    }
+
     std::optional<std::list<ast::ptr<ast::Stmt>>>
     replace(ast::OracleDecl& decl) {
-        auto l_net = synthesis::read_network(decl.fname());
-        auto body = synthesis::synthesize_net(decl.pos(), l_net, decl.params());
+        auto it = ready_.find(decl.fname());
+        if (it == ready_.end()) {
+            auto circuit = synthesize(decl.fname(), key_of(decl.fname()),
+                                      config_.synthesis);
+            it = ready_.emplace(decl.fname(), std::move(circuit)).first;
+        }
+        auto& circuit = it->second;
+
+        std::list<ast::ptr<ast::Gate>> body;
+        if (circuit)
+            body = synthesis::oracle_body(decl.pos(), *circuit, decl.params());
 
         std::list<ast::ptr<ast::Stmt>> ret;
         ret.emplace_back(std::make_unique<ast::GateDecl>(ast::GateDecl(
             decl.pos(), decl.id(), false, {}, decl.params(), std::move(body))));
         return std::move(ret);
     }
+
+  private:
+    using cache_key = synthesis::oracle_cache_key;
+
+    config config_;
+    synthesis::OracleCache cache_;
+    /// Synthesized circuits, by file name
+    std::unordered_map<std::string, std::optional<synthesis::oracle_circuit>>
+        ready_;
+
+    // The cache key of a logic file, if caching
+    std::optional<cache_key> key_of(const std::string& fname) const {
+        if (!config_.cache)
+            return std::nullopt;
+        return synthesis::oracle_key(fname, config_.synthesis);
+    }
+
+    // Synthesizes a logic file through the cache, given its key. Portfolios
+    // cut short by their time budget are not cached, as they depend on the
+    // timing. Safe to call concurrently
+    std::optional<synthesis::oracle_circuit>
+    synthesize(const std::string& fname, const std::optional<cache_key>& key,
+               const synthesis::LogicSynthesizer::config& settings) {
+        std::optional<synthesis::oracle_circuit> ret;
+        if (key)
+            ret = cache_.find(*key);
+
+        if (!ret) {
+            auto l_net = synthesis::read_network(fname);
+            synthesis::LogicSynthesizer alg(settings);
+            ret = alg.run(l_net);
+            if (ret && key && alg.complete())
+                cache_.insert(*key, *ret);
+        }
+        return ret;
+    }
 };
 
-void synthesize_oracles(ast::ASTNode& node) {
+inline void synthesize_oracles(ast::ASTNode& node) {
     OracleSynthesizer alg;
     node.accept(alg);
 }
 
+/**
+ * \brief Synthesizes all declared oracles with configuration
+ *
+ * The oracles are synthesized concurrently on params.num_threads workers.
+ */
+inline void synthesize_oracles(ast::ASTNode& node,
+                               const OracleSynthesizer::config& params) {
+    OracleSynthesizer alg(params);
+    alg.run(node);
+}
+
 } // namespace transformations
 } // namespace staq
@@ -0,0 +1,126 @@
+/*
+ * This file is part of staq.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file transformations/registers.hpp
+ * \brief Registers in scope
+ */
+
+#pragma once
+
+#include "qasmtools/ast/ast.hpp"
+
+#include <iostream>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace staq {
+namespace transformations {
+
+namespace ast = qasmtools::ast;
+
+/**
+ * \class staq::transformations::RegisterTable
+ * \brief Scoped table of register sizes
+ *
+ * Records the registers declared in a program and the qubit parameters of
+ * gate declarations, which shadow them. A gate or statement with whole
+ * registers as arguments stands for a batch of gates, one per offset;
+ * repeats() gives the size of the batch and expand() the arguments of each
+ * gate in it. Used by desugaring, and by passes which consume such gates as
+ * a batch instead of expanding them.
+ */
+class RegisterTable {
+  public:
+    void push_scope() { scopes_.push_front({}); }
+    void pop_scope() { scopes_.pop_front(); }
+
+    /** \brief Declares a register of a given size, or a single bit */
+    void declare(const std::string& x, std::optional<int> size) {
+        scopes_.front()[x] = size;
+    }
+
+    /**
+     * \brief Size of the register an argument refers to as a whole
+     *
+     * \return std::nullopt if the argument is a single bit
+     */
+    std::optional<int> size(const ast::VarAccess& arg) const {
+        if (arg.offset())
+            return std::nullopt;
+        for (auto& scope : scopes_) {
+            if (auto it = scope.find(arg.var()); it != scope.end())
+                return it->second;
+        }
+
+        return std::nullopt;
+    }
+
+    /**
+     * \brief Number of gates a list of arguments stands for
+     *
+     * Arguments are a range of ast::VarAccess, or of references to them
+     *
+     * \return std::nullopt if all arguments are single bits
+     */
+    template <typename Args>
+    std::optional<int> repeats(const Args& args) const {
+        std::optional<int> ret = std::nullopt;
+
+        for (const ast::VarAccess& arg : args) {
+            if (auto size = this->size(arg)) {
+                if (!ret) {
+                    ret = size;
+                } else if (*size != *ret) {
+                    std::cerr << "Warning: gate or measurement applied to "
+                                 "different size registers\n";
+                }
+            }
+        }
+
+        return ret;
+    }
+
+    /**
+     * \brief Expands an argument with a given offset if it is a whole
+     * register, otherwise copies it
+     */
+    ast::VarAccess expand(const ast::VarAccess& arg, int offset) const {
+        if (size(arg))
+            return ast::VarAccess(arg.pos(), arg.var(), offset);
+        else
+            return ast::VarAccess(arg);
+    }
+
+  private:
+    std::list<std::unordered_map<std::string, std::optional<int>>> scopes_;
+};
+
+} // namespace transformations
+} // namespace staq
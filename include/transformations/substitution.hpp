@@ -114,6 +114,15 @@ class SubstVar final : public ScopedReplacer {
         return std::nullopt;
     }
 
+    std::optional<ast::ptr<ast::Expr>> replace(ast::SharedExpr& expr) override {
+        // Substitutes into a copy, since the shared expression is immutable
+        auto ret = expr.unshare();
+        if (auto var = dynamic_cast<ast::VarExpr*>(ret.get()))
+            return replace(*var);
+        ret->accept(*this);
+        return ret;
+    }
+
   private:
     std::unordered_map<std::string_view, ast::Expr*> subst_; // The substitution
 };
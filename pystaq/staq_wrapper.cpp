@@ -43,8 +43,11 @@
 #include "mapping/layout/basic.hpp"
 #include "mapping/layout/eager.hpp"
 #include "mapping/layout/bestfit.hpp"
+#include "mapping/layout/anneal.hpp"
+#include "mapping/layout/vf2.hpp"
 #include "mapping/mapping/swap.hpp"
 #include "mapping/mapping/steiner.hpp"
+#include "mapping/mapping/sabre.hpp"
 
 #include "tools/resource_estimator.hpp"
 #include "tools/qubit_estimator.hpp"
@@ -103,6 +106,15 @@ class Program {
             physical_layout = mapping::compute_eager_layout(dev, *prog_);
         } else if (layout == "bestfit") {
             physical_layout = mapping::compute_bestfit_layout(dev, *prog_);
+        } else if (layout == "vf2") {
+            physical_layout = mapping::compute_vf2_layout(dev, *prog_);
+        } else if (layout == "anneal") {
+            physical_layout = mapping::compute_bestfit_layout(dev, *prog_);
+            auto cost =
+                mapping::layout_cost(dev, *prog_, physical_layout, mapper,
+                                     mapping::layout_objective::cnot);
+            physical_layout =
+                mapping::compute_annealed_layout(dev, physical_layout, cost);
         } else {
             std::cerr << "Error: invalid layout algorithm\n";
             return;
@@ -114,6 +126,8 @@ class Program {
             mapping::map_onto_device(dev, *prog_);
         } else if (mapper == "steiner") {
             mapping::steiner_mapping(dev, *prog_);
+        } else if (mapper == "sabre") {
+            mapping::sabre_mapping(dev, *prog_);
         } else {
             std::cerr << "Error: invalid mapping algorithm\n";
             return;
@@ -33,6 +33,7 @@
 #include "base.hpp"
 #include "decl.hpp"
 #include "expr.hpp"
+#include "expr_pool.hpp"
 #include "program.hpp"
 #include "semantic.hpp"
 #include "stmt.hpp"
@@ -32,9 +32,11 @@
 #pragma once
 
 #include "../parser/position.hpp"
+#include "../utils/emitter.hpp"
 #include "cloneable.hpp"
 #include "visitor.hpp"
 
+#include <atomic>
 #include <memory>
 #include <set>
 
@@ -51,10 +53,10 @@ using symbol = std::string;
  * \brief Base class for AST nodes
  */
 class ASTNode : public object::cloneable<ASTNode> {
-    static int& max_uid_() {
-        static int v;
+    static std::atomic<int>& max_uid_() {
+        static std::atomic<int> v;
         return v;
-    } ///< the maximum uid that has been assigned
+    } ///< the maximum uid that has been assigned (thread safe)
 
   protected:
     const int uid_;              ///< the node's unique ID
@@ -86,9 +88,24 @@ class ASTNode : public object::cloneable<ASTNode> {
     /**
      * \brief Print the formatted QASM source code of the node
      *
+     * \param os Output emitter
+     */
+    virtual utils::Emitter& pretty_print(utils::Emitter& os) const = 0;
+
+    /**
+     * \brief Print the formatted QASM source code of the node
+     *
+     * By default, writes through an emitter, with the stream's formatting of
+     * doubles
+     *
      * \param os Output stream
      */
-    virtual std::ostream& pretty_print(std::ostream& os) const = 0;
+    virtual std::ostream& pretty_print(std::ostream& os) const {
+        utils::Emitter emitter(os);
+        pretty_print(emitter);
+        emitter.flush();
+        return os;
+    }
 
     /**
      * \brief Extraction operator override
@@ -101,6 +118,17 @@ class ASTNode : public object::cloneable<ASTNode> {
     friend std::ostream& operator<<(std::ostream& os, const ASTNode& node) {
         return node.pretty_print(os);
     }
+
+    /**
+     * \brief Extraction operator override for emitters
+     *
+     * \param os Output emitter
+     * \param node Node to print
+     */
+    friend utils::Emitter& operator<<(utils::Emitter& os,
+                                      const ASTNode& node) {
+        return node.pretty_print(os);
+    }
 };
 
 } // namespace ast
@@ -180,8 +180,9 @@ class GateDecl final : public Stmt, public Decl {
     std::list<ptr<Gate>>::iterator end() { return body_.end(); }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os,
-                               bool suppress_std) const override {
+    using Stmt::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os,
+                                 bool suppress_std) const override {
         if (suppress_std && is_std_qelib(id_))
             return os;
 
@@ -265,7 +266,8 @@ class OracleDecl final : public Stmt, public Decl {
     const symbol& fname() { return fname_; }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Stmt::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         os << "oracle " << id_ << " ";
         for (auto it = params_.begin(); it != params_.end(); it++) {
             os << (it == params_.begin() ? "" : ",") << *it;
@@ -324,7 +326,8 @@ class RegisterDecl final : public Stmt, public Decl {
     int size() { return size_; }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Stmt::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         os << (quantum_ ? "qreg " : "creg ") << id_ << "[" << size_ << "];\n";
         return os;
     }
@@ -379,7 +382,8 @@ class AncillaDecl final : public Gate, public Decl {
     int size() { return size_; }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Gate::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         if (dirty_)
             os << "dirty ";
         os << "ancilla " << id_ << "[" << size_ << "];\n";
@@ -44,7 +44,8 @@ namespace ast {
  * \brief Enum of binary operators
  */
 enum class BinaryOp { Plus, Minus, Times, Divide, Pow };
-inline std::ostream& operator<<(std::ostream& os, const BinaryOp& bop) {
+template <typename Stream> // std::ostream or utils::Emitter
+Stream& operator<<(Stream& os, const BinaryOp& bop) {
     switch (bop) {
         case BinaryOp::Plus:
             os << "+";
@@ -69,7 +70,8 @@ inline std::ostream& operator<<(std::ostream& os, const BinaryOp& bop) {
  * \brief Enum of unary operators
  */
 enum class UnaryOp { Neg, Sin, Cos, Tan, Ln, Sqrt, Exp };
-inline std::ostream& operator<<(std::ostream& os, const UnaryOp& uop) {
+template <typename Stream> // std::ostream or utils::Emitter
+Stream& operator<<(Stream& os, const UnaryOp& uop) {
     switch (uop) {
         case UnaryOp::Neg:
             os << "-";
@@ -120,10 +122,22 @@ class Expr : public ASTNode {
      *
      * \param ctx Whether the current associative context is ambiguous
      */
-    virtual std::ostream& pretty_print(std::ostream& os, bool ctx) const = 0;
+    virtual utils::Emitter& pretty_print(utils::Emitter& os,
+                                         bool ctx) const = 0;
+    utils::Emitter& pretty_print(utils::Emitter& os) const override {
+        return pretty_print(os, false);
+    }
     std::ostream& pretty_print(std::ostream& os) const override {
         return pretty_print(os, false);
     }
+    virtual std::ostream& pretty_print(std::ostream& os,
+                                       bool ctx) const {
+        utils::Emitter emitter(os);
+        pretty_print(emitter, ctx);
+        emitter.flush();
+        return os;
+    }
+    using ASTNode::pretty_print;
 
   protected:
     virtual Expr* clone() const override = 0;
@@ -173,6 +187,7 @@ class BExpr final : public Expr {
      * \return A reference to the left sub-expression
      */
     Expr& lexp() { return *lexp_; }
+    const Expr& lexp() const { return *lexp_; }
 
     /**
      * \brief Get the right sub-expression
@@ -180,6 +195,7 @@ class BExpr final : public Expr {
      * \return A reference to the right sub-expression
      */
     Expr& rexp() { return *rexp_; }
+    const Expr& rexp() const { return *rexp_; }
 
     /**
      * \brief Set the left sub-expression
@@ -218,7 +234,8 @@ class BExpr final : public Expr {
         }
     }
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool ctx) const override {
+    using Expr::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool ctx) const override {
         if (ctx) {
             os << "(";
             lexp_->pretty_print(os, true);
@@ -281,6 +298,7 @@ class UExpr final : public Expr {
      * \return A reference to the sub-expression
      */
     Expr& subexp() { return *exp_; }
+    const Expr& subexp() const { return *exp_; }
 
     /**
      * \brief Set the sub-expression
@@ -315,7 +333,8 @@ class UExpr final : public Expr {
         }
     }
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool ctx) const override {
+    using Expr::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool ctx) const override {
         (void) ctx;
 
         os << op_;
@@ -360,7 +379,8 @@ class PiExpr final : public Expr {
 
     std::optional<double> constant_eval() const override { return utils::pi; }
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool ctx) const override {
+    using Expr::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool ctx) const override {
         (void) ctx;
 
         os << "pi";
@@ -406,7 +426,8 @@ class IntExpr final : public Expr {
         return (double) value_;
     }
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool ctx) const override {
+    using Expr::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool ctx) const override {
         (void) ctx;
 
         os << value_;
@@ -450,11 +471,13 @@ class RealExpr final : public Expr {
 
     std::optional<double> constant_eval() const override { return value_; }
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool ctx) const override {
+    using Expr::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool ctx) const override {
         (void) ctx;
 
-        std::streamsize ss = os.precision();
-        os << std::setprecision(15) << value_ << std::setprecision(ss);
+        int precision = os.precision(15);
+        os << value_;
+        os.precision(precision);
         return os;
     }
 
@@ -497,7 +520,8 @@ class VarExpr final : public Expr {
         return std::nullopt;
     }
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool ctx) const override {
+    using Expr::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool ctx) const override {
         (void) ctx;
         os << var_;
         return os;
@@ -507,6 +531,97 @@ class VarExpr final : public Expr {
     VarExpr* clone() const override { return new VarExpr(pos_, var_); }
 };
 
+/**
+ * \class qasmtools::ast::SharedExpr
+ * \brief Class for references to shared, immutable expressions
+ * \see qasmtools::ast::Expr
+ * \see qasmtools::ast::ExprPool
+ *
+ * The referenced expression may be referenced from many places at once and
+ * is never modified. Cloning a SharedExpr copies the reference, and passes
+ * rewriting expressions replace the SharedExpr rather than its target
+ */
+class SharedExpr final : public Expr {
+    std::shared_ptr<const Expr> exp_; ///< the shared expression
+
+  public:
+    /**
+     * \brief Construct a shared expression reference
+     *
+     * \param pos The source position
+     * \param exp The shared expression
+     */
+    SharedExpr(parser::Position pos, std::shared_ptr<const Expr> exp)
+        : Expr(pos), exp_(std::move(exp)) {}
+
+    /**
+     * \brief Protected heap-allocated construction
+     */
+    static ptr<SharedExpr> create(parser::Position pos,
+                                  std::shared_ptr<const Expr> exp) {
+        return std::make_unique<SharedExpr>(pos, std::move(exp));
+    }
+
+    /**
+     * \brief Get the shared expression
+     *
+     * \return A const reference to the shared expression
+     */
+    const Expr& target() const { return *exp_; }
+
+    /**
+     * \brief Get the owning pointer to the shared expression
+     *
+     * \return A const reference to the shared pointer
+     */
+    const std::shared_ptr<const Expr>& shared_target() const { return exp_; }
+
+    /**
+     * \brief Visit the shared expression
+     *
+     * For visitors which only read expressions, such as printers and
+     * traversals. The visitor must not modify the expression
+     *
+     * \param visitor The visitor
+     */
+    void accept_target(Visitor& visitor) const {
+        const_cast<Expr&>(*exp_).accept(visitor);
+    }
+
+    /**
+     * \brief Copy the shared expression into an expression owned by the caller
+     *
+     * \return A deep copy of the shared expression, with no SharedExpr nodes
+     */
+    ptr<Expr> unshare() const { return unshare(*exp_); }
+
+    std::optional<double> constant_eval() const override {
+        return exp_->constant_eval();
+    }
+    void accept(Visitor& visitor) override { visitor.visit(*this); }
+    using Expr::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool ctx) const override {
+        return exp_->pretty_print(os, ctx);
+    }
+
+  protected:
+    SharedExpr* clone() const override { return new SharedExpr(pos_, exp_); }
+
+  private:
+    static ptr<Expr> unshare(const Expr& expr) {
+        if (auto shared = dynamic_cast<const SharedExpr*>(&expr)) {
+            return unshare(*shared->exp_);
+        } else if (auto bexpr = dynamic_cast<const BExpr*>(&expr)) {
+            return BExpr::create(bexpr->pos(), unshare(bexpr->lexp()),
+                                 bexpr->op(), unshare(bexpr->rexp()));
+        } else if (auto uexpr = dynamic_cast<const UExpr*>(&expr)) {
+            return UExpr::create(uexpr->pos(), uexpr->op(),
+                                 unshare(uexpr->subexp()));
+        }
+        return object::clone(expr);
+    }
+};
+
 /**
  * \brief Returns an Expr representing the given angle
  *
@@ -0,0 +1,235 @@
+/*
+ * This file is part of qasmtools.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file qasmtools/ast/expr_pool.hpp
+ * \brief Hash-consed expressions
+ */
+
+#pragma once
+
+#include "expr.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace qasmtools {
+namespace ast {
+
+/**
+ * \class qasmtools::ast::ExprPool
+ * \brief Table of hash-consed expressions
+ *
+ * Interns expressions bottom-up, so that structurally equal expressions are
+ * stored once. Interned expressions are immutable and reference counted, and
+ * their sub-expressions are SharedExpr references to other interned
+ * expressions. They stay alive as long as the pool or a SharedExpr refers to
+ * them.
+ *
+ * Literals are compared by value, and real literals by their bits. Source
+ * positions are dropped, except on the SharedExpr returned by share. A pool
+ * is not thread safe.
+ */
+class ExprPool {
+  public:
+    using node = std::shared_ptr<const Expr>;
+    using subst_map = std::unordered_map<std::string_view, Expr*>;
+
+    /**
+     * \brief Intern an expression
+     *
+     * \param expr The expression
+     * \return The interned expression equal to expr
+     */
+    node intern(const Expr& expr) {
+        if (auto shared = dynamic_cast<const SharedExpr*>(&expr)) {
+            if (members_.count(&shared->target()))
+                return shared->shared_target();
+            return intern(shared->target());
+        } else if (auto bexpr = dynamic_cast<const BExpr*>(&expr)) {
+            auto lexp = intern(bexpr->lexp());
+            return binary(std::move(lexp), bexpr->op(),
+                          intern(bexpr->rexp()));
+        } else if (auto uexpr = dynamic_cast<const UExpr*>(&expr)) {
+            return unary(uexpr->op(), intern(uexpr->subexp()));
+        } else if (dynamic_cast<const PiExpr*>(&expr)) {
+            return lookup({kind::pi}, [] { return new PiExpr({}); });
+        } else if (auto iexpr = dynamic_cast<const IntExpr*>(&expr)) {
+            int value = iexpr->value();
+            return lookup({kind::integer, 0, nullptr, nullptr,
+                           static_cast<std::uint64_t>(value)},
+                          [value] { return new IntExpr({}, value); });
+        } else if (auto rexpr = dynamic_cast<const RealExpr*>(&expr)) {
+            double value = rexpr->value();
+            std::uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return lookup({kind::real, 0, nullptr, nullptr, bits},
+                          [value] { return new RealExpr({}, value); });
+        } else if (auto vexpr = dynamic_cast<const VarExpr*>(&expr)) {
+            auto& var = vexpr->var();
+            return lookup({kind::var, 0, nullptr, nullptr, 0, var},
+                          [&var] { return new VarExpr({}, var); });
+        }
+        throw std::logic_error("Unrecognized expression");
+    }
+
+    /**
+     * \brief Intern an expression and refer to it
+     *
+     * \param expr The expression
+     * \return A SharedExpr at the position of expr
+     */
+    ptr<SharedExpr> share(const Expr& expr) {
+        return SharedExpr::create(expr.pos(), intern(expr));
+    }
+
+    /**
+     * \brief Intern a binary expression of interned expressions
+     */
+    node binary(node lexp, BinaryOp op, node rexp) {
+        return lookup(
+            {kind::binary, static_cast<int>(op), lexp.get(), rexp.get()},
+            [&lexp, op, &rexp] {
+                return new BExpr({}, SharedExpr::create({}, lexp), op,
+                                 SharedExpr::create({}, rexp));
+            });
+    }
+
+    /**
+     * \brief Intern a unary expression of an interned expression
+     */
+    node unary(UnaryOp op, node exp) {
+        return lookup({kind::unary, static_cast<int>(op), exp.get()},
+                      [op, &exp] {
+                          return new UExpr({}, op, SharedExpr::create({}, exp));
+                      });
+    }
+
+    /**
+     * \brief Substitute variables in an interned expression
+     *
+     * Rebuilds only the sub-expressions containing a substituted variable,
+     * once each
+     *
+     * \param expr An expression interned in this pool
+     * \param subst The expressions replacing each variable
+     * \return The interned result
+     */
+    node substitute(const node& expr, const subst_map& subst) {
+        if (subst.empty())
+            return expr;
+        std::unordered_map<const Expr*, node> done;
+        return substitute(expr, subst, done);
+    }
+
+    /**
+     * \brief Get the number of interned expressions
+     */
+    std::size_t size() const { return table_.size(); }
+
+  private:
+    enum class kind { binary, unary, pi, integer, real, var };
+
+    struct key {
+        kind type;
+        int op = 0;
+        const Expr* lexp = nullptr;
+        const Expr* rexp = nullptr;
+        std::uint64_t value = 0;
+        symbol var{};
+
+        bool operator==(const key& other) const {
+            return type == other.type && op == other.op &&
+                   lexp == other.lexp && rexp == other.rexp &&
+                   value == other.value && var == other.var;
+        }
+    };
+
+    struct key_hash {
+        std::size_t operator()(const key& k) const {
+            std::size_t h = static_cast<std::size_t>(k.type) * 31 + k.op;
+            h = h * 0x9e3779b97f4a7c15 + std::hash<const Expr*>{}(k.lexp);
+            h = h * 0x9e3779b97f4a7c15 + std::hash<const Expr*>{}(k.rexp);
+            h = h * 0x9e3779b97f4a7c15 + std::hash<std::uint64_t>{}(k.value);
+            if (!k.var.empty())
+                h ^= std::hash<symbol>{}(k.var);
+            return h;
+        }
+    };
+
+    std::unordered_map<key, node, key_hash> table_;
+    std::unordered_set<const Expr*> members_; ///< The interned expressions
+
+    template <typename Make>
+    node lookup(key k, Make make) {
+        auto [it, inserted] = table_.try_emplace(std::move(k));
+        if (inserted) {
+            it->second = node(make());
+            members_.insert(it->second.get());
+        }
+        return it->second;
+    }
+
+    static const node& child(const Expr& expr) {
+        return static_cast<const SharedExpr&>(expr).shared_target();
+    }
+
+    node substitute(const node& expr, const subst_map& subst,
+                    std::unordered_map<const Expr*, node>& done) {
+        if (auto it = done.find(expr.get()); it != done.end())
+            return it->second;
+
+        node ret = expr;
+        if (auto bexpr = dynamic_cast<const BExpr*>(expr.get())) {
+            auto& lexp = child(bexpr->lexp());
+            auto& rexp = child(bexpr->rexp());
+            auto new_lexp = substitute(lexp, subst, done);
+            auto new_rexp = substitute(rexp, subst, done);
+            if (new_lexp != lexp || new_rexp != rexp)
+                ret = binary(std::move(new_lexp), bexpr->op(),
+                             std::move(new_rexp));
+        } else if (auto uexpr = dynamic_cast<const UExpr*>(expr.get())) {
+            auto& exp = child(uexpr->subexp());
+            auto new_exp = substitute(exp, subst, done);
+            if (new_exp != exp)
+                ret = unary(uexpr->op(), std::move(new_exp));
+        } else if (auto vexpr = dynamic_cast<const VarExpr*>(expr.get())) {
+            if (auto it = subst.find(vexpr->var()); it != subst.end())
+                ret = intern(*it->second);
+        }
+
+        done.emplace(expr.get(), ret);
+        return ret;
+    }
+};
+
+} // namespace ast
+} // namespace qasmtools
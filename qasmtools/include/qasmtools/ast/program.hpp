@@ -117,7 +117,8 @@ class Program : public ASTNode {
     std::list<ptr<Stmt>>::iterator end() { return body_.end(); }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os) const override {
+    using ASTNode::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os) const override {
         os << "OPENQASM 2.0;\n";
         if (std_include_)
             os << "include \"qelib1.inc\";\n";
@@ -53,6 +53,10 @@ namespace ast {
  * method does not kill traversal to the node's children. To stop
  * descending into the children of a node, the node's visit overload
  * can be overridden.
+ *
+ * The target of a SharedExpr is immutable and is not descended into. A
+ * replacer rewriting expressions can override replace(SharedExpr&), for
+ * instance to rewrite a copy obtained with SharedExpr::unshare.
  */
 class Replacer : public Visitor {
     std::optional<VarAccess> replacement_var_;
@@ -72,6 +76,9 @@ class Replacer : public Visitor {
     virtual std::optional<ptr<Expr>> replace(IntExpr&) { return std::nullopt; }
     virtual std::optional<ptr<Expr>> replace(RealExpr&) { return std::nullopt; }
     virtual std::optional<ptr<Expr>> replace(VarExpr&) { return std::nullopt; }
+    virtual std::optional<ptr<Expr>> replace(SharedExpr&) {
+        return std::nullopt;
+    }
     // Statements
     virtual std::optional<std::list<ptr<Stmt>>> replace(MeasureStmt&) {
         return std::nullopt;
@@ -142,6 +149,8 @@ class Replacer : public Visitor {
     void visit(IntExpr& expr) override { replacement_expr_ = replace(expr); }
     void visit(RealExpr& expr) override { replacement_expr_ = replace(expr); }
     void visit(VarExpr& expr) override { replacement_expr_ = replace(expr); }
+    // Shared expressions are immutable, so their targets are not visited
+    void visit(SharedExpr& expr) override { replacement_expr_ = replace(expr); }
 
     void visit(MeasureStmt& stmt) override {
         stmt.q_arg().accept(*this);
@@ -321,6 +330,32 @@ class Replacer : public Visitor {
             }
         }
     }
+
+  protected:
+    /**
+     * \brief Visits a single statement and takes its replacement
+     *
+     * For replacers which walk a body themselves, e.g. to do more work
+     * on each statement in the same traversal. Gates replacing the
+     * statement are returned as statements.
+     *
+     * \return The replacement statements, or std::nullopt to keep stmt
+     */
+    std::optional<std::list<ptr<Stmt>>> take_replacement(Stmt& stmt) {
+        stmt.accept(*this);
+        if (replacement_gates_) {
+            std::list<ptr<Stmt>> ret;
+            for (auto& gate : *replacement_gates_) {
+                ret.emplace_back(std::move(gate));
+            }
+            replacement_gates_ = std::nullopt;
+            return std::move(ret);
+        }
+
+        auto ret = std::move(replacement_stmts_);
+        replacement_stmts_ = std::nullopt;
+        return ret;
+    }
 };
 
 /**
@@ -381,5 +416,109 @@ replace_gates(ASTNode& node,
     node.accept(replacer);
 }
 
+/**
+ * \class qasmtools::ast::GateHandle
+ * \brief Position of a gate in the body of a program or gate declaration
+ * \see qasmtools::ast::splice_gates
+ *
+ * Recorded by an analysis pass while it walks a body, so that the gate can
+ * later be replaced without searching the AST for it. A gate in the then
+ * branch of an if statement is located by the if statement.
+ */
+class GateHandle {
+    std::list<ptr<Stmt>>* stmts_ = nullptr;
+    std::list<ptr<Stmt>>::iterator stmt_;
+    std::list<ptr<Gate>>* gates_ = nullptr;
+    std::list<ptr<Gate>>::iterator gate_;
+
+  public:
+    GateHandle() = default;
+
+    /**
+     * \brief Constructs a handle to a statement of a program body
+     *
+     * \param stmts The program body
+     * \param it Iterator to the statement
+     */
+    GateHandle(std::list<ptr<Stmt>>& stmts, std::list<ptr<Stmt>>::iterator it)
+        : stmts_(&stmts), stmt_(it) {}
+
+    /**
+     * \brief Constructs a handle to a gate of a gate declaration body
+     *
+     * \param gates The declaration body
+     * \param it Iterator to the gate
+     */
+    GateHandle(std::list<ptr<Gate>>& gates, std::list<ptr<Gate>>::iterator it)
+        : gates_(&gates), gate_(it) {}
+
+    /**
+     * \brief Replaces the gate with a list of gates
+     *
+     * As for qasmtools::ast::Replacer, a gate under an if statement is
+     * replaced by one copy of the if statement per gate. Invalidates the
+     * handle.
+     *
+     * \param gates The replacement gates
+     */
+    void replace(std::list<ptr<Gate>>&& gates) {
+        if (gates_) {
+            gates_->splice(gate_, std::move(gates));
+            gates_->erase(gate_);
+        } else if (auto stmt = dynamic_cast<IfStmt*>(stmt_->get())) {
+            for (auto& gate : gates) {
+                auto tmp = object::clone(*stmt);
+                tmp->set_then(std::move(gate));
+                stmts_->emplace(stmt_, std::move(tmp));
+            }
+            stmts_->erase(stmt_);
+        } else {
+            for (auto& gate : gates) {
+                stmts_->emplace(stmt_, std::move(gate));
+            }
+            stmts_->erase(stmt_);
+        }
+        stmts_ = nullptr;
+        gates_ = nullptr;
+    }
+
+    /**
+     * \brief Whether the handle points to a gate
+     */
+    explicit operator bool() const { return stmts_ || gates_; }
+};
+
+/**
+ * \brief Hash map from gate UID's to the gate's handle and replacement
+ */
+using gate_splices =
+    std::unordered_map<int, std::pair<GateHandle, std::list<ptr<Gate>>>>;
+
+/**
+ * \brief Replaces gates at recorded positions
+ *
+ * Performs the same replacements as qasmtools::ast::replace_gates, in time
+ * linear in the number of replacements rather than the size of the AST. The
+ * handles must have been recorded after the last modification of the bodies
+ * they point into, other than by the splices themselves. Gates without a
+ * handle are replaced by a traversal of the AST, as by replace_gates.
+ *
+ * \param node Reference to the root of the AST in which replacement will take
+ * place \param splices Hash map from gate UID's to the gate's handle and the
+ * list of gates which should replace it
+ */
+inline void splice_gates(ASTNode& node, gate_splices&& splices) {
+    std::unordered_map<int, std::list<ptr<Gate>>> rest;
+    for (auto& [uid, splice] : splices) {
+        if (splice.first)
+            splice.first.replace(std::move(splice.second));
+        else
+            rest[uid] = std::move(splice.second);
+    }
+
+    if (!rest.empty())
+        replace_gates(node, std::move(rest));
+}
+
 } // namespace ast
 } // namespace qasmtools
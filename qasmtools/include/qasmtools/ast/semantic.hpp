@@ -117,6 +117,7 @@ class SemanticChecker final : public Visitor {
     void visit(PiExpr&) {}
     void visit(IntExpr&) {}
     void visit(RealExpr&) {}
+    void visit(SharedExpr& expr) { expr.accept_target(*this); }
     void visit(VarExpr& expr) {
         auto entry = lookup(expr.var());
 
@@ -56,12 +56,23 @@ class Stmt : public ASTNode {
      *
      * \param suppress_std Whether to suppress output of the standard library
      */
-    virtual std::ostream& pretty_print(std::ostream& os,
-                                       bool suppress_std) const = 0;
+    virtual utils::Emitter& pretty_print(utils::Emitter& os,
+                                         bool suppress_std) const = 0;
 
+    utils::Emitter& pretty_print(utils::Emitter& os) const override {
+        return pretty_print(os, false);
+    }
     std::ostream& pretty_print(std::ostream& os) const override {
         return pretty_print(os, false);
     }
+    virtual std::ostream& pretty_print(std::ostream& os,
+                                       bool suppress_std) const {
+        utils::Emitter emitter(os);
+        pretty_print(emitter, suppress_std);
+        emitter.flush();
+        return os;
+    }
+    using ASTNode::pretty_print;
 
   protected:
     virtual Stmt* clone() const override = 0;
@@ -125,7 +136,8 @@ class MeasureStmt final : public Stmt {
     void set_carg(const VarAccess& arg) { c_arg_ = arg; }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Stmt::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         os << "measure " << q_arg_ << " -> " << c_arg_ << ";\n";
         return os;
     }
@@ -176,7 +188,8 @@ class ResetStmt final : public Stmt {
     void set_arg(const VarAccess& arg) { arg_ = arg; }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Stmt::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         os << "reset " << arg_ << ";\n";
         return os;
     }
@@ -246,7 +259,8 @@ class IfStmt final : public Stmt {
     void set_then(ptr<Stmt> then) { then_ = std::move(then); }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Stmt::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         os << "if (" << var_ << "==" << cond_ << ") " << *then_;
         return os;
     }
@@ -363,7 +377,8 @@ class UGate final : public Gate {
     void set_arg(const VarAccess& arg) { arg_ = arg; }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Gate::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         os << "U(" << *theta_ << "," << *phi_ << "," << *lambda_ << ") " << arg_
            << ";\n";
         return os;
@@ -433,7 +448,8 @@ class CNOTGate final : public Gate {
     void set_tgt(const VarAccess& tgt) { tgt_ = tgt; }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Gate::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         os << "CX " << ctrl_ << "," << tgt_ << ";\n";
         return os;
     }
@@ -511,7 +527,8 @@ class BarrierGate final : public Gate {
     void set_arg(int i, const VarAccess& arg) { args_[i] = arg; }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Gate::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         os << "barrier ";
         for (auto it = args_.begin(); it != args_.end(); it++) {
             os << (it == args_.begin() ? "" : ",") << *it;
@@ -642,7 +659,8 @@ class DeclaredGate final : public Gate {
     void set_qarg(int i, const VarAccess& arg) { q_args_[i] = arg; }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os, bool) const override {
+    using Gate::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
         os << name_;
         if (c_args_.size() > 0) {
             os << "(";
@@ -65,6 +65,7 @@ class Traverse : public Visitor {
     void visit(IntExpr& expr) override {}
     void visit(RealExpr& expr) override {}
     void visit(VarExpr& expr) override {}
+    void visit(SharedExpr& expr) override { expr.accept_target(*this); }
     void visit(MeasureStmt& stmt) override {
         stmt.q_arg().accept(*this);
         stmt.c_arg().accept(*this);
@@ -154,7 +154,8 @@ class VarAccess final : public ASTNode {
     }
 
     void accept(Visitor& visitor) override { visitor.visit(*this); }
-    std::ostream& pretty_print(std::ostream& os) const override {
+    using ASTNode::pretty_print;
+    utils::Emitter& pretty_print(utils::Emitter& os) const override {
         os << var_;
         if (offset_)
             os << "[" << *offset_ << "]";
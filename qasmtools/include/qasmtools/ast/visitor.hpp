@@ -42,6 +42,7 @@ class PiExpr;
 class IntExpr;
 class RealExpr;
 class VarExpr;
+class SharedExpr;
 class MeasureStmt;
 class ResetStmt;
 class IfStmt;
@@ -79,6 +80,7 @@ class Visitor {
     virtual void visit(IntExpr&) = 0;
     virtual void visit(RealExpr&) = 0;
     virtual void visit(VarExpr&) = 0;
+    virtual void visit(SharedExpr&) = 0;
     // Statements
     virtual void visit(MeasureStmt&) = 0;
     virtual void visit(ResetStmt&) = 0;
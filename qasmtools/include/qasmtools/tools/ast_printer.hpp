@@ -84,6 +84,14 @@ class ASTPrinter final : public ast::Visitor {
         os_ << ")\n";
     }
 
+    void visit(ast::SharedExpr& expr) {
+        os_ << prefix_ << "|- Shared\n";
+
+        prefix_ += "  ";
+        expr.accept_target(*this);
+        prefix_.resize(prefix_.length() - 2);
+    }
+
     // Statements
     void visit(ast::MeasureStmt& stmt) {
         os_ << prefix_ << "|- Measure\n";
@@ -35,6 +35,7 @@
 
 #include "templates.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <numeric>
@@ -111,27 +112,46 @@ class Angle {
 
     constexpr Angle operator-() const {
         if (std::holds_alternative<fraction>(value_)) {
-            auto frac = std::get<fraction>(value_);
-            return Angle(2 * frac.second - frac.first, frac.second);
+            // 2d - n is still in lowest form
+            auto ret = *this;
+            auto& [n, d] = std::get<fraction>(ret.value_);
+            if (n != 0)
+                n = 2 * d - n;
+            return ret;
         } else {
             return Angle(-std::get<double>(value_));
         }
     }
 
     bool operator==(const Angle& other) const {
+        // Symbolic angles are in lowest form, hence equal iff identical
+        if (is_symbolic() && other.is_symbolic())
+            return std::get<fraction>(value_) ==
+                   std::get<fraction>(other.value_);
         return numeric_value() == other.numeric_value();
     }
 
-    bool operator!=(const Angle& other) const {
-        return numeric_value() != other.numeric_value();
-    }
+    bool operator!=(const Angle& other) const { return !(*this == other); }
 
     Angle& operator+=(const Angle& rhs) {
         if (is_symbolic() && rhs.is_symbolic()) {
             auto [a, b] = std::get<fraction>(value_);
             auto [c, d] = std::get<fraction>(rhs.value_);
-            value_ = fraction(a * d + c * b, b * d);
-            normalize();
+            if (is_power_of_two(b) && is_power_of_two(d)) {
+                // Multiples of pi/2^k, added as integers modulo 2^(k+1)
+                auto m = std::max(b, d);
+                auto n = static_cast<int>(
+                    ((long long) a * (m / b) + (long long) c * (m / d)) &
+                    (2 * (long long) m - 1));
+                while (n % 2 == 0 && m > 1) {
+                    n /= 2;
+                    m /= 2;
+                }
+                value_ = fraction(n, m);
+            } else {
+                value_ = fraction(a * d + c * b, b * d);
+                normalize();
+            }
         } else {
             auto a = numeric_value();
             auto b = rhs.numeric_value();
@@ -219,6 +239,8 @@ class Angle {
     }
 
   private:
+    static constexpr bool is_power_of_two(int d) { return (d & (d - 1)) == 0; }
+
     constexpr void normalize() {
         if (is_numeric()) {
             return;
@@ -246,7 +268,7 @@ class Angle {
 
             // bring into [0, 2pi) range
             n = n % (2 * d);
-            if (sgn == -1) {
+            if (sgn == -1 && n != 0) {
                 n = (2 * d) - n;
             }
         }
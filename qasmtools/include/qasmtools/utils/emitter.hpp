@@ -0,0 +1,209 @@
+/*
+ * This file is part of qasmtools.
+ *
+ * Copyright (c) 2019 - 2022 softwareQ Inc. All rights reserved.
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file qasmtools/utils/emitter.hpp
+ * \brief Buffered text output
+ */
+
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <ios>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace qasmtools {
+namespace utils {
+
+/**
+ * \class qasmtools::utils::Emitter
+ * \brief Buffered text output
+ *
+ * Appends text to a contiguous buffer, which is written to the underlying
+ * stream with a single write once it holds chunk_size bytes, and when
+ * flushed or destroyed. Without a stream the text stays in the buffer, see
+ * str(). Numbers are formatted with std::to_chars; doubles as an
+ * std::ostream formats them by default, with the same precision. When the
+ * stream has std::fixed, std::scientific, std::showpoint, std::showpos or
+ * std::uppercase set, doubles are formatted with printf instead, as
+ * std::ostream itself does.
+ */
+class Emitter {
+  public:
+    static constexpr std::size_t chunk_size = 1 << 20;
+
+    /** \brief Emits into the buffer only */
+    Emitter() = default;
+
+    /**
+     * \brief Emits to an output stream, with the stream's precision and
+     * formatting of doubles
+     */
+    explicit Emitter(std::ostream& os)
+        : os_(&os), precision_(static_cast<int>(os.precision())),
+          flags_(os.flags() & float_flags) {}
+
+    Emitter(const Emitter&) = delete;
+    Emitter& operator=(const Emitter&) = delete;
+    ~Emitter() { flush(); }
+
+    /** \brief Writes the buffer to the stream, if any */
+    void flush() {
+        if (os_ && !buf_.empty()) {
+            os_->write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+            buf_.clear();
+        }
+    }
+
+    /** \brief Text in the buffer */
+    std::string_view str() const { return buf_; }
+
+    /** \brief Discards the buffer */
+    void clear() { buf_.clear(); }
+
+    /** \brief Precision of doubles */
+    int precision() const { return precision_; }
+
+    /**
+     * \brief Sets the precision of doubles
+     *
+     * \return The previous precision
+     */
+    int precision(int precision) {
+        int ret = precision_;
+        precision_ = precision;
+        return ret;
+    }
+
+    Emitter& operator<<(std::string_view str) {
+        buf_.append(str);
+        return check();
+    }
+    Emitter& operator<<(const char* str) {
+        return *this << std::string_view(str);
+    }
+    Emitter& operator<<(const std::string& str) {
+        return *this << std::string_view(str);
+    }
+    Emitter& operator<<(char c) {
+        buf_.push_back(c);
+        return check();
+    }
+
+    template <typename T>
+    std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char> &&
+                         !std::is_same_v<T, bool>,
+                     Emitter&>
+    operator<<(T value) {
+        char tmp[24];
+        auto res = std::to_chars(tmp, tmp + sizeof(tmp), value);
+        buf_.append(tmp, res.ptr - tmp);
+        return check();
+    }
+
+    Emitter& operator<<(double value) {
+        if (flags_)
+            return print_flagged(value);
+        char tmp[64];
+#if defined(__cpp_lib_to_chars)
+        auto res = std::to_chars(tmp, tmp + sizeof(tmp), value,
+                                 std::chars_format::general, precision_);
+        buf_.append(tmp, res.ptr - tmp);
+#else
+        int len = std::snprintf(tmp, sizeof(tmp), "%.*g", precision_, value);
+        buf_.append(tmp, len);
+#endif
+        return check();
+    }
+
+  private:
+    static constexpr std::ios_base::fmtflags float_flags =
+        std::ios_base::floatfield | std::ios_base::showpoint |
+        std::ios_base::showpos | std::ios_base::uppercase;
+
+    std::ostream* os_ = nullptr;      ///< Stream written to, if any
+    int precision_ = 6;               ///< Precision of doubles
+    std::ios_base::fmtflags flags_{}; ///< Stream flags affecting doubles
+    std::string buf_;
+
+    /**
+     * \brief Formats a double with printf, from a format built out of the
+     * stream flags the same way std::num_put builds it
+     */
+    Emitter& print_flagged(double value) {
+        auto field = flags_ & std::ios_base::floatfield;
+        bool hex = field == std::ios_base::floatfield;
+        bool upper = static_cast<bool>(flags_ & std::ios_base::uppercase);
+
+        char fmt[8];
+        char* ptr = fmt;
+        *ptr++ = '%';
+        if (flags_ & std::ios_base::showpos)
+            *ptr++ = '+';
+        if (flags_ & std::ios_base::showpoint)
+            *ptr++ = '#';
+        if (!hex) {
+            *ptr++ = '.';
+            *ptr++ = '*';
+        }
+        if (field == std::ios_base::fixed)
+            *ptr++ = 'f';
+        else if (field == std::ios_base::scientific)
+            *ptr++ = upper ? 'E' : 'e';
+        else if (hex)
+            *ptr++ = upper ? 'A' : 'a';
+        else
+            *ptr++ = upper ? 'G' : 'g';
+        *ptr = '\0';
+
+        // std::fixed output of large values can be long, so format in place
+        int prec = precision_ < 0 ? 6 : precision_;
+        std::size_t old = buf_.size();
+        int len = hex ? std::snprintf(nullptr, 0, fmt, value)
+                      : std::snprintf(nullptr, 0, fmt, prec, value);
+        buf_.resize(old + len + 1);
+        if (hex)
+            std::snprintf(&buf_[old], len + 1, fmt, value);
+        else
+            std::snprintf(&buf_[old], len + 1, fmt, prec, value);
+        buf_.resize(old + len);
+        return check();
+    }
+
+    Emitter& check() {
+        if (buf_.size() >= chunk_size)
+            flush();
+        return *this;
+    }
+};
+
+} // namespace utils
+} // namespace qasmtools
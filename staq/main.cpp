@@ -31,17 +31,23 @@
 #include "transformations/oracle_synthesizer.hpp"
 #include "transformations/barrier_merge.hpp"
 #include "transformations/expression_simplifier.hpp"
+#include "transformations/normalize.hpp"
 
 #include "optimization/simplify.hpp"
 #include "optimization/rotation_folding.hpp"
 #include "optimization/cnot_resynthesis.hpp"
 
 #include "mapping/device.hpp"
+#include "mapping/fidelity.hpp"
 #include "mapping/layout/basic.hpp"
 #include "mapping/layout/eager.hpp"
 #include "mapping/layout/bestfit.hpp"
+#include "mapping/layout/anneal.hpp"
+#include "mapping/layout/vf2.hpp"
 #include "mapping/mapping/swap.hpp"
 #include "mapping/mapping/steiner.hpp"
+#include "mapping/mapping/sabre.hpp"
+#include "mapping/mapping/sliced.hpp"
 
 #include "tools/resource_estimator.hpp"
 #include "tools/qubit_estimator.hpp"
@@ -51,6 +57,7 @@
 #include "output/quil.hpp"
 #include "output/cirq.hpp"
 
+#include <algorithm>
 #include <sstream>
 #include <CLI/CLI.hpp>
 
@@ -65,7 +72,9 @@ enum class Pass {
     cnotsynth,
     simplify,
     map,
-    rewrite
+    rewrite,
+    normalize,
+    merge
 };
 
 /**
@@ -122,9 +131,25 @@ int main(int argc, char** argv) {
     std::string layout_alg = "bestfit";
     std::string mapper = "steiner";
     bool disable_layout_optimization = false;
+    mapping::layout_search_config layout_search;
+    std::string layout_search_mode = "restart";
+    mapping::LayoutAnnealer::config anneal_config;
+    mapping::VF2Layout::config vf2_config;
+    std::string layout_cost = "cnot";
+    std::string routing_cost = "fidelity";
+    bool partial_flush = false;
+    std::string cnot_synthesis = "gauss-jordan";
+    transformations::OracleSynthesizer::config oracle_config;
+    std::string oracle_strategy = "eager";
+    std::string oracle_stg = "pkrm";
+    std::string oracle_portfolio;
+    mapping::SlicedMapper::config slice_config;
+    slice_config.slice_size = 0;
     bool no_expand_registers = false;
+    bool lazy_registers = false;
     bool no_rewrite_expressions = false;
     bool evaluate_all = false;
+    bool share_expressions = false;
     std::string device_json;
     std::string input_qasm;
 
@@ -143,21 +168,115 @@ int main(int argc, char** argv) {
             {"qasm", "quil", "projectq", "qsharp", "cirq", "resources"}));
     app.add_option("-l,--layout", layout_alg,
                    "Initial device layout algorithm. Default=" + layout_alg)
-        ->check(CLI::IsMember({"linear", "eager", "bestfit"}));
+        ->check(CLI::IsMember({"linear", "eager", "bestfit", "vf2", "anneal"}));
     app.add_option("-M,--mapping-alg", mapper,
-                   "Algorithm to use for mapping CNOT gates. Default=" + mapper)
-        ->check(CLI::IsMember({"swap", "steiner"}));
+                   "Algorithm to use for mapping CNOT gates. sabre only uses "
+                   "the layout given by -l as the starting point of its own "
+                   "forward-backward layout refinement. Default=" + mapper)
+        ->check(CLI::IsMember({"swap", "steiner", "sabre"}));
     app.add_flag(
         "--disable-layout-optimization", disable_layout_optimization,
         "Disables an expensive layout optimization pass when using the "
         "steiner mapper");
+    app.add_option("--layout-threads", layout_search.num_threads,
+                   "Threads used by the layout optimization, 0 for all cores. "
+                   "Default=0");
+    app.add_option("--layout-search", layout_search_mode,
+                   "Take the first improving swap during layout "
+                   "optimization and rescan from the start (restart) or "
+                   "resume the scan (cyclic), or take the best swap of a "
+                   "full scan (best). Default=" +
+                       layout_search_mode)
+        ->check(CLI::IsMember({"restart", "cyclic", "best"}));
+    app.add_option("--layout-iterations", layout_search.max_iterations,
+                   "Maximum number of layout optimization steps (moves per "
+                   "restart for the anneal layout), 0 for no limit. "
+                   "Default=0");
+    app.add_option("--layout-budget-ms", layout_search.time_budget_ms,
+                   "Time budget for the layout optimization in milliseconds, "
+                   "0 for no limit (1000 for the anneal layout). Also caps "
+                   "the vf2 layout search, whose result then depends on the "
+                   "machine load. Default=0");
+    app.add_option("--layout-states", vf2_config.max_states,
+                   "Maximum number of search states of the vf2 layout, 0 for "
+                   "no limit. Reproducible, unlike --layout-budget-ms. "
+                   "Default=" + std::to_string(vf2_config.max_states));
+    app.add_option("--layout-seed", anneal_config.seed,
+                   "Random seed of the anneal layout. Default=0");
+    app.add_option("--layout-restarts", anneal_config.restarts,
+                   "Number of restarts of the anneal layout. Default=1");
+    app.add_option("--layout-cost", layout_cost,
+                   "Cost minimized by the anneal layout. Default=" +
+                       layout_cost)
+        ->check(CLI::IsMember({"cnot", "fidelity", "depth"}));
+    app.add_option("--routing-cost", routing_cost,
+                   "Edge weight of the swap and steiner mappers' paths: CNOT "
+                   "fidelity, coupling count, or estimated swap success "
+                   "including single-qubit and direction reversal errors. "
+                   "Default=" +
+                       routing_cost)
+        ->check(CLI::IsMember({"fidelity", "hops", "success"}));
+    app.add_flag("--partial-flush", partial_flush,
+                 "Re-synthesize only the qubits a blocking gate depends on in "
+                 "the steiner mapper and CNOT resynthesis, rather than the "
+                 "whole cnot-dihedral chunk");
+    app.add_option("--cnot-synthesis", cnot_synthesis,
+                   "Linear reversible synthesis of the CNOT resynthesis pass: "
+                   "Gaussian elimination, or Patel-Markov-Hayes with fewer "
+                   "CNOT gates on large chunks. Default=" +
+                       cnot_synthesis)
+        ->check(CLI::IsMember({"gauss-jordan", "pmh"}));
+    app.add_option("--oracle-cache", oracle_config.cache_dir,
+                   "Directory caching synthesized oracles by the contents of "
+                   "their logic files across compiles");
+    app.add_option("--oracle-threads", oracle_config.num_threads,
+                   "Threads synthesizing oracles, 0 for all cores. Default=0");
+    app.add_option("--oracle-cut-size", oracle_config.synthesis.cut_size,
+                   "LUT size of oracle synthesis. Default=3");
+    app.add_option("--oracle-strategy", oracle_strategy,
+                   "Reversible mapping strategy of oracle synthesis. "
+                   "Default=" +
+                       oracle_strategy)
+        ->check(CLI::IsMember({"eager", "bennett"}));
+    app.add_option("--oracle-stg", oracle_stg,
+                   "Single-target gate synthesis of oracle synthesis: "
+                   "Reed-Muller expressions or Rademacher-Walsh spectrum. "
+                   "Default=" +
+                       oracle_stg)
+        ->check(CLI::IsMember({"pkrm", "pprm", "spectrum"}));
+    app.add_option("--oracle-max-controls",
+                   oracle_config.synthesis.max_controls,
+                   "Controls per Toffoli gate left by the Barenco "
+                   "decomposition of oracles, from 2 to 4. Default=3")
+        ->check(CLI::Range(2, 4));
+    app.add_flag("--oracle-t-par", oracle_config.synthesis.t_par,
+                 "Decompose oracle Toffoli gates with lower T-depth");
+    app.add_option("--oracle-portfolio", oracle_portfolio,
+                   "Synthesize oracles with several settings in parallel and "
+                   "keep the one with the fewest T gates, qubits or CNOTs")
+        ->check(CLI::IsMember({"t-count", "qubits", "cnots"}));
+    app.add_option("--oracle-budget-ms", oracle_config.synthesis.time_budget_ms,
+                   "Time budget of each oracle portfolio in milliseconds, 0 "
+                   "for no limit. Default=0");
+    app.add_option("--mapping-slice-size", slice_config.slice_size,
+                   "Map the swap and steiner mappers' input in parallel time "
+                   "slices of this many statements, 0 to map serially. Not "
+                   "supported by the sabre mapper. Default=0");
+    app.add_option("--mapping-threads", slice_config.num_threads,
+                   "Threads used by sliced mapping, 0 for all cores. "
+                   "Default=0");
     app.add_flag(
         "--no-expand-registers", no_expand_registers,
         "Disables expanding gates applied to registers rather than qubits");
+    app.add_flag("--lazy-registers", lazy_registers,
+                 "Keeps gates applied to registers until a pass or output "
+                 "format needs single qubits, and expands them there");
     app.add_flag("--no-rewrite-expressions", no_rewrite_expressions,
                  "Disables evaluation of parameter expressions");
     app.add_flag("--evaluate-all", evaluate_all,
                  "Evaluate all expressions as real numbers");
+    app.add_flag("--share-expressions", share_expressions,
+                 "Store equal gate parameters once when inlining");
     CLI::Option* device_opt =
         app.add_option("-d,--device", device_json, "Device to map onto (.json)")
             ->check(CLI::ExistingFile);
@@ -166,13 +285,42 @@ int main(int argc, char** argv) {
         ->check(CLI::ExistingFile);
 
     CLI11_PARSE(app, argc, argv);
+    if (mapper == "sabre" && slice_config.slice_size > 0) {
+        std::cerr << "Error: --mapping-slice-size is not supported by the "
+                     "sabre mapper\n";
+        return 1;
+    }
+    if (layout_search_mode == "cyclic")
+        layout_search.search = mapping::layout_search_strategy::cyclic;
+    else if (layout_search_mode == "best")
+        layout_search.search = mapping::layout_search_strategy::best;
+    if (oracle_strategy == "bennett")
+        oracle_config.synthesis.strategy = synthesis::lhrs_strategy::bennett;
+    if (oracle_stg == "pprm")
+        oracle_config.synthesis.stg = synthesis::stg_method::pprm;
+    else if (oracle_stg == "spectrum")
+        oracle_config.synthesis.stg = synthesis::stg_method::spectrum;
+    if (!oracle_portfolio.empty()) {
+        oracle_config.synthesis.portfolio = true;
+        if (oracle_portfolio == "qubits")
+            oracle_config.synthesis.metric = synthesis::oracle_metric::qubits;
+        else if (oracle_portfolio == "cnots")
+            oracle_config.synthesis.metric = synthesis::oracle_metric::cnots;
+    }
+    oracle_config.synthesis.num_threads = oracle_config.num_threads;
 
     /* Passes */
     std::list<Pass> passes;
-    if (!no_rewrite_expressions) {
+    bool lazy = lazy_registers && !no_expand_registers;
+    if (lazy) {
+        if (!no_rewrite_expressions)
+            passes.push_back(Pass::rewrite);
+        passes.push_back(Pass::merge);
+    } else if (!no_rewrite_expressions && !no_expand_registers) {
+        passes.push_back(Pass::normalize);
+    } else if (!no_rewrite_expressions) {
         passes.push_back(Pass::rewrite);
-    }
-    if (!no_expand_registers) {
+    } else if (!no_expand_registers) {
         passes.push_back(Pass::desugar);
     }
     for (auto& x : app.remaining()) {
@@ -220,6 +368,15 @@ int main(int argc, char** argv) {
                 std::cerr << "Unrecognized option \"" << x << "\"\n";
         }
     }
+    if (lazy) {
+        // Resource counts and QASM output work on whole registers, every
+        // other pass and output format expands them first
+        auto it = std::find_if(passes.begin(), passes.end(), [](Pass pass) {
+            return pass != Pass::rewrite && pass != Pass::merge;
+        });
+        if (it != passes.end() || (format != "qasm" && format != "resources"))
+            passes.insert(it, Pass::desugar);
+    }
 
     mapping::layout initial_layout;
     std::optional<std::map<int, int>> output_perm = std::nullopt;
@@ -246,19 +403,28 @@ int main(int argc, char** argv) {
                 transformations::desugar(*prog);
                 transformations::merge_barriers(*prog);
                 break;
-            case Pass::inln:
-                transformations::inline_ast(
-                    *prog, {false, transformations::default_overrides, "anc"});
+            case Pass::inln: {
+                transformations::Inliner::config inline_config{
+                    false, transformations::default_overrides, "anc"};
+                inline_config.share_expressions = share_expressions;
+                transformations::inline_ast(*prog, inline_config);
                 break;
+            }
             case Pass::synth:
-                transformations::synthesize_oracles(*prog);
+                transformations::synthesize_oracles(*prog, oracle_config);
                 break;
             case Pass::rotfold:
                 optimization::fold_rotations(*prog);
                 break;
-            case Pass::cnotsynth:
-                optimization::optimize_CNOT(*prog);
+            case Pass::cnotsynth: {
+                optimization::CNOTOptimizer::config cnot_config;
+                cnot_config.partial_flush = partial_flush;
+                if (cnot_synthesis == "pmh")
+                    cnot_config.linear_synthesis =
+                        synthesis::linear_synthesizer::pmh;
+                optimization::optimize_CNOT(*prog, cnot_config);
                 break;
+            }
             case Pass::simplify:
                 transformations::expr_simplify(*prog);
                 optimization::simplify(*prog);
@@ -267,13 +433,21 @@ int main(int argc, char** argv) {
                 mapped = true;
 
                 /* Inline fully first */
-                transformations::inline_ast(*prog, {false, {}, "anc"});
+                transformations::Inliner::config inline_config{false, {},
+                                                               "anc"};
+                inline_config.share_expressions = share_expressions;
+                transformations::inline_ast(*prog, inline_config);
 
                 /* Device */
                 if (!(*device_opt)) {
                     dev =
                         mapping::fully_connected(tools::estimate_qubits(*prog));
                 }
+                if (routing_cost == "hops") {
+                    dev.set_routing_cost(mapping::hop_cost);
+                } else if (routing_cost == "success") {
+                    dev.set_routing_cost(mapping::swap_cost);
+                }
 
                 /* Generate the layout */
                 if (layout_alg == "linear") {
@@ -283,26 +457,66 @@ int main(int argc, char** argv) {
                 } else if (layout_alg == "bestfit") {
                     initial_layout =
                         mapping::compute_bestfit_layout(dev, *prog);
+                } else if (layout_alg == "vf2") {
+                    vf2_config.time_budget_ms = layout_search.time_budget_ms;
+                    initial_layout =
+                        mapping::compute_vf2_layout(dev, *prog, vf2_config);
+                } else if (layout_alg == "anneal") {
+                    initial_layout =
+                        mapping::compute_bestfit_layout(dev, *prog);
+                    auto objective = mapping::layout_objective::cnot;
+                    if (layout_cost == "fidelity")
+                        objective = mapping::layout_objective::fidelity;
+                    else if (layout_cost == "depth")
+                        objective = mapping::layout_objective::depth;
+                    anneal_config.time_budget_ms = layout_search.time_budget_ms;
+                    anneal_config.iterations = layout_search.max_iterations;
+                    if (anneal_config.time_budget_ms <= 0 &&
+                        anneal_config.iterations <= 0)
+                        anneal_config.time_budget_ms = 1000;
+                    auto cost = mapping::layout_cost(
+                        dev, *prog, initial_layout, mapper, objective);
+                    initial_layout = mapping::compute_annealed_layout(
+                        dev, initial_layout, cost, anneal_config);
                 }
 
                 /* (Optional) optimize the layout */
-                if (mapper == "steiner" && do_lo)
-                    optimize_steiner_layout(dev, initial_layout, *prog);
+                if (mapper == "steiner" && do_lo && layout_alg != "anneal")
+                    optimize_steiner_layout(dev, initial_layout, *prog,
+                                            layout_search);
 
                 /* Apply the layout */
                 mapping::apply_layout(initial_layout, dev, *prog);
 
                 /* Apply the mapping algorithm */
-                if (mapper == "swap") {
+                bool sliced = slice_config.slice_size > 0;
+                if (mapper == "swap" && sliced) {
+                    output_perm =
+                        mapping::sliced_swap_mapping(dev, *prog, slice_config);
+                } else if (mapper == "swap") {
                     output_perm = mapping::map_onto_device(dev, *prog);
+                } else if (mapper == "steiner" && sliced) {
+                    slice_config.steiner.partial_flush = partial_flush;
+                    mapping::sliced_steiner_mapping(dev, *prog, slice_config);
                 } else if (mapper == "steiner") {
-                    mapping::steiner_mapping(dev, *prog);
+                    mapping::SteinerMapper::config steiner_config;
+                    steiner_config.partial_flush = partial_flush;
+                    mapping::steiner_mapping(dev, *prog, steiner_config);
+                } else if (mapper == "sabre") {
+                    output_perm =
+                        mapping::sabre_mapping(dev, *prog, initial_layout);
                 }
                 break;
             }
             case Pass::rewrite:
                 transformations::expr_simplify(*prog, evaluate_all);
                 break;
+            case Pass::normalize:
+                transformations::normalize(*prog, evaluate_all);
+                break;
+            case Pass::merge:
+                transformations::merge_barriers(*prog);
+                break;
         }
 
 
@@ -335,10 +549,18 @@ int main(int argc, char** argv) {
     } else if (format == "resources") {
         auto count = tools::estimate_resources(*prog);
 
+        std::optional<double> log_fidelity;
+        if (mapped)
+            log_fidelity = mapping::estimate_log_fidelity(dev, *prog);
+
         if (ofile == "") {
             std::cout << "Resource estimates for " << input_qasm << ":\n";
             for (auto& [name, num] : count)
                 std::cout << "  " << name << ": " << num << "\n";
+            if (log_fidelity)
+                std::cout << "  estimated fidelity: " << std::exp(*log_fidelity)
+                          << "\n  estimated log fidelity: " << *log_fidelity
+                          << "\n";
         } else {
             std::ofstream os;
             os.open(ofile);
@@ -346,6 +568,9 @@ int main(int argc, char** argv) {
             os << "Resource estimates for " << input_qasm << ":\n";
             for (auto& [name, num] : count)
                 os << "  " << name << ": " << num << "\n";
+            if (log_fidelity)
+                os << "  estimated fidelity: " << std::exp(*log_fidelity)
+                   << "\n  estimated log fidelity: " << *log_fidelity << "\n";
 
             os.close();
         }
@@ -26,15 +26,74 @@
 
 #include "mapping/device.hpp"
 #include <CLI/CLI.hpp>
+#include <algorithm>
+#include <random>
+#include <set>
 #include <tuple>
 
 static double FIDELITY_1 = staq::mapping::FIDELITY_1;
 
-void write_to_stream(const std::vector<std::vector<bool>>& adj,
-                     const std::string& device_name, std::ostream& out) {
-    using Device = staq::mapping::Device;
-    Device dev(device_name, adj.size(), adj);
-    out << dev.to_json() << "\n";
+/**
+ * Undirected coupling graphs, stored as edge lists so that generated devices
+ * can reach 10^4 qubits without the n^2 tables of staq::mapping::Device
+ */
+struct coupling_graph {
+    int n = 0;
+    std::vector<std::pair<int, int>> edges;
+};
+
+/**
+ * Random fidelities: normal distributions truncated to (0, 1], or no
+ * fidelities at all if a mean is not given
+ */
+struct fidelity_model {
+    std::vector<double> sq; // mean and standard deviation
+    std::vector<double> tq;
+    std::mt19937_64 rng;
+
+    double sample(const std::vector<double>& params) {
+        if (params.empty())
+            return FIDELITY_1;
+        std::normal_distribution<double> dist(
+            params[0], params.size() > 1 ? params[1] : 0.0);
+        for (int tries = 0; tries < 1000; tries++) {
+            double x = dist(rng);
+            if (x > 0 && x <= 1)
+                return x;
+        }
+        return std::clamp(params[0], 0.0, 1.0);
+    }
+};
+
+void write_to_stream(const coupling_graph& g, const std::string& device_name,
+                     fidelity_model& fidelities, std::ostream& out) {
+    // Same output as Device::to_json, couplings in order of control and
+    // target, without building the adjacency matrix
+    std::vector<std::vector<std::pair<int, double>>> adj(g.n);
+    for (auto [u, v] : g.edges) {
+        double f = fidelities.sample(fidelities.tq);
+        adj[u].emplace_back(v, f);
+        adj[v].emplace_back(u, f);
+    }
+
+    staq::mapping::json js;
+    js["name"] = device_name;
+    for (int i = 0; i < g.n; i++) {
+        double sq = fidelities.sample(fidelities.sq);
+        js["qubits"].push_back(sq == FIDELITY_1
+                                   ? staq::mapping::json{{"id", i}}
+                                   : staq::mapping::json{{"id", i},
+                                                         {"fidelity", sq}});
+        std::sort(adj[i].begin(), adj[i].end());
+        for (auto [j, f] : adj[i]) {
+            js["couplings"].push_back(
+                f == FIDELITY_1
+                    ? staq::mapping::json{{"control", i}, {"target", j}}
+                    : staq::mapping::json{
+                          {"control", i}, {"target", j}, {"fidelity", f}});
+        }
+    }
+    out << js.dump(2) << "\n";
 }
 
 void add_edge(std::vector<std::vector<bool>>& adj,
@@ -55,6 +114,223 @@ void add_edge(std::vector<std::vector<bool>>& adj,
     }
 }
 
+/** Qubits are arranged as follows:
+ *    0           1        ...     l-1
+ *    l          l+1       ...    2l-1
+ *    .           .                 .
+ *    :           :                 :
+ * l*(w-1)    l*(w-1)+1    ...    l*w-1
+ */
+coupling_graph rectangle(int l, int w) {
+    coupling_graph g{l * w, {}};
+    for (int i = 0; i < l; i++) {
+        for (int j = 0; j < w; j++) {
+            int id = i + j * l;
+            // connect to the left
+            if (i > 0)
+                g.edges.emplace_back(id - 1, id);
+            // connect up
+            if (j > 0)
+                g.edges.emplace_back(id - l, id);
+        }
+    }
+    return g;
+}
+
+coupling_graph circle(int n) {
+    coupling_graph g{n, {}};
+    for (int i = 0; i < n; i++)
+        g.edges.emplace_back(i, (i + 1) % n);
+    return g;
+}
+
+coupling_graph line(int n) {
+    coupling_graph g{n, {}};
+    for (int i = 1; i < n; i++)
+        g.edges.emplace_back(i - 1, i);
+    return g;
+}
+
+/** Two lines of n qubits, 0 ... n-1 and n ... 2n-1, with rungs i -- n+i */
+coupling_graph ladder(int n) {
+    coupling_graph g{2 * n, {}};
+    for (int i = 0; i < n; i++) {
+        if (i > 0) {
+            g.edges.emplace_back(i - 1, i);
+            g.edges.emplace_back(n + i - 1, n + i);
+        }
+        g.edges.emplace_back(i, n + i);
+    }
+    return g;
+}
+
+/**
+ * Heavy-hex lattice of r rows of c hexagons, as on IBM devices: r+1 lines of
+ * 4c+3 qubits, joined by bridge qubits at every fourth qubit, the bridges
+ * of consecutive rows offset by two. Every hexagon has 12 qubits on its
+ * boundary and no qubit has more than 3 neighbours.
+ */
+coupling_graph heavy_hex(int r, int c) {
+    int w = 4 * c + 3;
+    coupling_graph g{0, {}};
+    for (int row = 0; row <= r; row++) {
+        int first = g.n;
+        for (int x = 0; x < w; x++, g.n++) {
+            if (x > 0)
+                g.edges.emplace_back(g.n - 1, g.n);
+        }
+        if (row == r)
+            break;
+        // Bridges down to the next line, which starts after them
+        int next = g.n + c + 1;
+        for (int x = 2 * (row % 2); x < w; x += 4, g.n++) {
+            g.edges.emplace_back(first + x, g.n);
+            g.edges.emplace_back(g.n, next + x);
+        }
+    }
+    return g;
+}
+
+/**
+ * m fully connected modules of k qubits, each linked to the next one (in a
+ * ring if m > 2) by `links` couplings between random qubits
+ */
+coupling_graph modules(int m, int k, int links, std::mt19937_64& rng) {
+    coupling_graph g{m * k, {}};
+    for (int mod = 0; mod < m; mod++) {
+        for (int i = 0; i < k; i++)
+            for (int j = i + 1; j < k; j++)
+                g.edges.emplace_back(mod * k + i, mod * k + j);
+    }
+
+    std::uniform_int_distribution<int> qubit(0, k - 1);
+    for (int mod = 0; mod + 1 < m || (m > 2 && mod < m); mod++) {
+        int next = (mod + 1) % m;
+        std::set<std::pair<int, int>> linked;
+        while (static_cast<int>(linked.size()) < std::min(links, k * k))
+            linked.emplace(mod * k + qubit(rng), next * k + qubit(rng));
+        g.edges.insert(g.edges.end(), linked.begin(), linked.end());
+    }
+    return g;
+}
+
+/** Connected component of each qubit, numbered from 0 in order of qubits */
+std::vector<int> components(const coupling_graph& g) {
+    std::vector<std::vector<int>> adj(g.n);
+    for (auto [u, v] : g.edges) {
+        adj[u].push_back(v);
+        adj[v].push_back(u);
+    }
+
+    std::vector<int> ret(g.n, -1);
+    int count = 0;
+    for (int s = 0; s < g.n; s++) {
+        if (ret[s] >= 0)
+            continue;
+        std::vector<int> stack{s};
+        ret[s] = count;
+        while (!stack.empty()) {
+            int u = stack.back();
+            stack.pop_back();
+            for (int v : adj[u]) {
+                if (ret[v] < 0) {
+                    ret[v] = count;
+                    stack.push_back(v);
+                }
+            }
+        }
+        count++;
+    }
+    return ret;
+}
+
+/**
+ * Connected random d-regular graph on n qubits, by pairing edge endpoints
+ * at random and rejecting self-loops and parallel edges (Steger-Wormald),
+ * restarting when stuck
+ */
+coupling_graph random_regular(int n, int d, std::mt19937_64& rng) {
+    if ((n * d) % 2 != 0 || d >= n)
+        throw std::logic_error("No " + std::to_string(d) +
+                               "-regular graph on " + std::to_string(n) +
+                               " qubits");
+
+    for (int attempt = 0; attempt < 100; attempt++) {
+        coupling_graph g{n, {}};
+        std::set<std::pair<int, int>> edges;
+        std::vector<int> stubs;
+        for (int i = 0; i < n; i++)
+            stubs.insert(stubs.end(), d, i);
+
+        int failures = 0;
+        while (!stubs.empty() && failures < 100 * d) {
+            std::uniform_int_distribution<std::size_t> pick(0,
+                                                            stubs.size() - 1);
+            std::size_t a = pick(rng), b = pick(rng);
+            auto e = std::minmax(stubs[a], stubs[b]);
+            if (a == b || e.first == e.second || edges.count(e)) {
+                failures++;
+                continue;
+            }
+            failures = 0;
+            edges.insert(e);
+            // Remove both stubs, the later one first
+            for (auto i : {std::max(a, b), std::min(a, b)}) {
+                stubs[i] = stubs.back();
+                stubs.pop_back();
+            }
+        }
+
+        g.edges.assign(edges.begin(), edges.end());
+        auto comp = components(g);
+        if (stubs.empty() &&
+            std::all_of(comp.begin(), comp.end(), [](int c) { return c == 0; }))
+            return g;
+    }
+    throw std::logic_error("Could not generate a connected random regular "
+                           "graph");
+}
+
+/**
+ * Removes each qubit and each coupling with probability `rate`, keeps the
+ * largest connected component and renumbers its qubits in order
+ */
+coupling_graph with_defects(const coupling_graph& g, double rate,
+                            std::mt19937_64& rng) {
+    std::bernoulli_distribution defect(rate);
+    std::vector<bool> alive(g.n);
+    for (int i = 0; i < g.n; i++)
+        alive[i] = !defect(rng);
+
+    coupling_graph damaged{g.n, {}};
+    for (auto [u, v] : g.edges) {
+        if (alive[u] && alive[v] && !defect(rng))
+            damaged.edges.emplace_back(u, v);
+    }
+
+    // Dead qubits are isolated, so they are never in the largest component
+    // unless all qubits are dead
+    auto comp = components(damaged);
+    std::vector<int> sizes(g.n);
+    for (int i = 0; i < g.n; i++) {
+        if (alive[i])
+            sizes[comp[i]]++;
+    }
+    int keep = std::max_element(sizes.begin(), sizes.end()) - sizes.begin();
+
+    coupling_graph ret{0, {}};
+    std::vector<int> id(g.n, -1);
+    for (int i = 0; i < g.n; i++) {
+        if (alive[i] && comp[i] == keep)
+            id[i] = ret.n++;
+    }
+    for (auto [u, v] : damaged.edges) {
+        if (id[u] >= 0)
+            ret.edges.emplace_back(id[u], id[v]);
+    }
+    return ret;
+}
+
 int main(int argc, char** argv) {
     if (argc == 1) {
         std::cout << "Usage: staq_device_generator [OPTIONS] [SUBCOMMAND]\n"
@@ -65,6 +341,14 @@ int main(int argc, char** argv) {
     std::vector<int> rectangular; // dimensions for rectangular QPU
     int circular = 0;             // qubit count for circular QPU
     int linear = 0;               // qubit count for linear QPU
+    int ladders = 0;              // rung count for ladder QPU
+    std::vector<int> hexagons;    // hexagon rows and columns for heavy-hex QPU
+    std::vector<int> modular;     // module count, size and links between them
+    std::vector<int> regular;     // qubit count and degree for random QPU
+
+    double defect_rate = 0;    // probability of a dead qubit or coupling
+    fidelity_model fidelities; // random fidelities of generated layouts
+    std::uint64_t seed = 0;    // seed of all random choices
 
     int qubits = 0;                             // qubit count for graph
     std::vector<std::pair<int, double>> fidels; // single qubit fidelities
@@ -75,8 +359,12 @@ int main(int argc, char** argv) {
     std::vector<std::tuple<int, int, double>>
         uf_edges;                       // u-edges with fidelities
     std::string name = "Custom device"; // name of custom device
+    std::string compile;                // JSON device to compile
 
     CLI::App app{"Device JSON generator"};
+    app.footer("Layouts of up to 10^4 qubits can be generated, but staq keeps "
+               "n^2 routing tables per device, which limits mapping to a few "
+               "thousand qubits.");
     app.get_formatter()->column_width(43);
 
     CLI::Option_group* ogroup =
@@ -88,10 +376,53 @@ int main(int argc, char** argv) {
     ogroup->add_option("-c,--circle", circular,
                        "Circular QPU qubit count (>= 3)");
     ogroup->add_option("-l,--line", linear, "Linear QPU qubit count (>= 2)");
+    ogroup->add_option("--ladder", ladders,
+                       "Ladder QPU rung count, 2 qubits per rung (>= 2)");
+    ogroup
+        ->add_option("--heavy-hex", hexagons,
+                     "Heavy-hex QPU hexagon rows and columns (e.g. "
+                     "--heavy-hex 3 4) (>= 1)")
+        ->expected(1, 2);
+    ogroup
+        ->add_option("--modules", modular,
+                     "Fully connected modules: module count (>= 2), qubits "
+                     "per module (>= 2) and links between neighbouring "
+                     "modules (default 1)")
+        ->expected(2, 3);
+    ogroup
+        ->add_option("--random-regular", regular,
+                     "Connected random regular QPU qubit count and degree "
+                     "(e.g. --random-regular 100 3)")
+        ->expected(2);
+    CLI::Option* compile_opt =
+        ogroup
+            ->add_option("--compile", compile,
+                         "Compile a JSON device for faster loading (writes "
+                         "FILE.bin) instead of generating one")
+            ->check(CLI::ExistingFile);
     ogroup->require_option(0, 1);
 
+    app.add_option("--defects", defect_rate,
+                   "Probability that a qubit or coupling of the layout is "
+                   "dead, keeping the largest connected part (< 1)")
+        ->check(CLI::Range(0.0, 1.0))
+        ->excludes(compile_opt);
+    app.add_option("--sq-fidelity", fidelities.sq,
+                   "Mean and standard deviation of random single qubit "
+                   "fidelities of the layout")
+        ->expected(1, 2)
+        ->excludes(compile_opt);
+    app.add_option("--tq-fidelity", fidelities.tq,
+                   "Mean and standard deviation of random coupling "
+                   "fidelities of the layout")
+        ->expected(1, 2)
+        ->excludes(compile_opt);
+    app.add_option("--seed", seed, "Random seed. Default=0")
+        ->excludes(compile_opt);
+
     /* Allow user to specify qubits, couplings, and fidelities */
     CLI::App* graph = app.add_subcommand("graph", "Customized device");
+    graph->excludes(compile_opt);
     graph->get_formatter()->label("REQUIRED", "(REQUIRED)");
     graph->add_option("-n,--qubits", qubits, "Number of qubits")->required();
     graph->add_option("--name", name, "Device name");
@@ -110,7 +441,14 @@ int main(int argc, char** argv) {
 
     CLI11_PARSE(app, argc, argv);
 
-    if (*graph) {
+    if (!compile.empty()) {
+        try {
+            std::cout << staq::mapping::compile_device(compile) << "\n";
+        } catch (std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    } else if (*graph) {
         if (qubits > 0) {
             int n = qubits;
             // compute adjacency matrix
@@ -146,60 +484,70 @@ int main(int argc, char** argv) {
             staq::mapping::Device dev(name, n, adj, sq_fi, tq_fi);
             std::cout << dev.to_json() << "\n";
         }
-    } else if (!rectangular.empty()) {
-        int l, w;
-        l = rectangular[0];
-        if (rectangular.size() >= 2) {
-            w = rectangular[1];
-        } else {
-            w = l;
-        }
-        if (l >= 2 && w >= 2) {
-            /** Qubits are arranged as follows:
-             *    0           1        ...     l-1
-             *    l          l+1       ...    2l-1
-             *    .           .                 .
-             *    :           :                 :
-             * l*(w-1)    l*(w-1)+1    ...    l*w-1
-             */
-            int n = l * w;
-            // compute adjacency matrix
-            std::vector<std::vector<bool>> adj(n, std::vector<bool>(n));
-            for (int i = 0; i < l; i++) {
-                for (int j = 0; j < w; j++) {
-                    int id = i + j * l;
-                    // connect to the left
-                    if (i > 0)
-                        adj[id][id - 1] = adj[id - 1][id] = true;
-                    // connect up
-                    if (j > 0)
-                        adj[id][id - l] = adj[id - l][id] = true;
+    } else {
+        std::mt19937_64 rng(seed);
+        fidelities.rng.seed(seed + 1);
+        coupling_graph g;
+        std::string device_name;
+        try {
+            if (!rectangular.empty()) {
+                int l = rectangular[0];
+                int w = rectangular.size() >= 2 ? rectangular[1] : l;
+                if (l >= 2 && w >= 2) {
+                    g = rectangle(l, w);
+                    device_name = "Rectangular_" + std::to_string(l) +
+                                  "_x_" + std::to_string(w);
+                }
+            } else if (circular >= 3) {
+                g = circle(circular);
+                device_name = "Circular_" + std::to_string(circular);
+            } else if (linear >= 2) {
+                g = line(linear);
+                device_name = "Linear_" + std::to_string(linear);
+            } else if (ladders >= 2) {
+                g = ladder(ladders);
+                device_name = "Ladder_" + std::to_string(ladders);
+            } else if (!hexagons.empty()) {
+                int r = hexagons[0];
+                int c = hexagons.size() >= 2 ? hexagons[1] : r;
+                if (r >= 1 && c >= 1) {
+                    g = heavy_hex(r, c);
+                    device_name = "Heavy_hex_" + std::to_string(r) +
+                                  "_x_" + std::to_string(c);
                 }
+            } else if (!modular.empty()) {
+                int m = modular[0], k = modular[1];
+                int links = modular.size() >= 3 ? modular[2] : 1;
+                if (m >= 2 && k >= 2 && links >= 1) {
+                    g = modules(m, k, links, rng);
+                    device_name = "Modular_" + std::to_string(m) + "_x_" +
+                                  std::to_string(k);
+                }
+            } else if (!regular.empty()) {
+                g = random_regular(regular[0], regular[1], rng);
+                device_name = "Random_regular_" +
+                              std::to_string(regular[0]) + "_" +
+                              std::to_string(regular[1]);
             }
-
-            write_to_stream(adj,
-                            "Rectangular_" + std::to_string(l) + "_x_" +
-                                std::to_string(w),
-                            std::cout);
-        }
-    } else if (circular >= 3) {
-        int n = circular;
-        // compute adjacency matrix
-        std::vector<std::vector<bool>> adj(n, std::vector<bool>(n));
-        for (int i = 0; i < n; i++) {
-            int j = (i + 1) % n;
-            adj[i][j] = adj[j][i] = true;
+        } catch (std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
         }
 
-        write_to_stream(adj, "Circular_" + std::to_string(n), std::cout);
-    } else if (linear >= 2) {
-        int n = linear;
-        // compute adjacency matrix
-        std::vector<std::vector<bool>> adj(n, std::vector<bool>(n));
-        for (int i = 1; i < n; i++) {
-            adj[i][i - 1] = adj[i - 1][i] = true;
+        if (!device_name.empty()) {
+            if (defect_rate >= 1) {
+                std::cerr << "Defect rate must be less than 1\n";
+                return 1;
+            }
+            if (defect_rate > 0) {
+                g = with_defects(g, defect_rate, rng);
+                device_name += "_defective";
+                if (g.n == 0) {
+                    std::cerr << "No qubits left after defects\n";
+                    return 1;
+                }
+            }
+            write_to_stream(g, device_name, fidelities, std::cout);
         }
-
-        write_to_stream(adj, "Linear_" + std::to_string(n), std::cout);
     }
 }
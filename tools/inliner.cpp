@@ -35,6 +35,7 @@ int main(int argc, char** argv) {
 
     bool clear_decls = false;
     bool inline_stdlib = false;
+    bool share_expressions = false;
     std::string ancilla_name = "anc";
 
     CLI::App app{"QASM inliner"};
@@ -44,6 +45,8 @@ int main(int argc, char** argv) {
                  "Inline qelib1.inc declarations as well");
     app.add_option("--ancilla-name", ancilla_name,
                    "Name of the global ancilla register, if applicable");
+    app.add_flag("--share-expressions", share_expressions,
+                 "Store equal gate parameters once");
 
     CLI11_PARSE(app, argc, argv);
 
@@ -52,8 +55,10 @@ int main(int argc, char** argv) {
         std::set<std::string_view> overrides =
             inline_stdlib ? std::set<std::string_view>()
                           : transformations::default_overrides;
-        transformations::inline_ast(*program,
-                                    {!clear_decls, overrides, ancilla_name});
+        transformations::Inliner::config config{!clear_decls, overrides,
+                                                ancilla_name};
+        config.share_expressions = share_expressions;
+        transformations::inline_ast(*program, config);
         std::cout << *program;
     } else {
         std::cerr << "Parsing failed\n";
@@ -33,8 +33,11 @@
 #include "mapping/layout/basic.hpp"
 #include "mapping/layout/eager.hpp"
 #include "mapping/layout/bestfit.hpp"
+#include "mapping/layout/anneal.hpp"
+#include "mapping/layout/vf2.hpp"
 #include "mapping/mapping/swap.hpp"
 #include "mapping/mapping/steiner.hpp"
+#include "mapping/mapping/sabre.hpp"
 
 #include <CLI/CLI.hpp>
 
@@ -58,9 +61,9 @@ int main(int argc, char** argv) {
         app.add_option("-d,--device", device_json, "Device to map onto (.json)")
             ->check(CLI::ExistingFile);
     app.add_option("-l", layout, "Layout algorithm to use. Default=" + layout)
-        ->check(CLI::IsMember({"linear", "eager", "bestfit"}));
+        ->check(CLI::IsMember({"linear", "eager", "bestfit", "vf2", "anneal"}));
     app.add_option("-m", mapper, "Mapping algorithm to use. Default=" + mapper)
-        ->check(CLI::IsMember({"swap", "steiner"}));
+        ->check(CLI::IsMember({"swap", "steiner", "sabre"}));
     app.add_flag("--evaluate-all", evaluate_all,
                  "Evaluate all expressions as real numbers");
 
@@ -88,6 +91,15 @@ int main(int argc, char** argv) {
             physical_layout = mapping::compute_eager_layout(dev, *program);
         } else if (layout == "bestfit") {
             physical_layout = mapping::compute_bestfit_layout(dev, *program);
+        } else if (layout == "vf2") {
+            physical_layout = mapping::compute_vf2_layout(dev, *program);
+        } else if (layout == "anneal") {
+            physical_layout = mapping::compute_bestfit_layout(dev, *program);
+            auto cost =
+                mapping::layout_cost(dev, *program, physical_layout, mapper,
+                                     mapping::layout_objective::cnot);
+            physical_layout =
+                mapping::compute_annealed_layout(dev, physical_layout, cost);
         }
         mapping::apply_layout(physical_layout, dev, *program);
 
@@ -96,6 +108,8 @@ int main(int argc, char** argv) {
             mapping::map_onto_device(dev, *program);
         } else if (mapper == "steiner") {
             mapping::steiner_mapping(dev, *program);
+        } else if (mapper == "sabre") {
+            mapping::sabre_mapping(dev, *program);
         }
 
         /* Evaluating symbolic expressions */
@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "qasmtools/ast/expr.hpp"
+#include "qasmtools/ast/expr_pool.hpp"
+
+#include <sstream>
+
+using namespace qasmtools;
+
+// Testing that constant values follow changes to sub-expressions
+/******************************************************************************/
+TEST(Expr, Constant_Eval) {
+    auto sum = ast::BExpr::create({}, ast::VarExpr::create({}, "a"),
+                                  ast::BinaryOp::Plus,
+                                  ast::IntExpr::create({}, 1));
+    auto& inner = *sum;
+    auto expr = ast::UExpr::create({}, ast::UnaryOp::Neg, std::move(sum));
+
+    EXPECT_FALSE(expr->constant_eval());
+
+    inner.set_lexp(ast::IntExpr::create({}, 2));
+    EXPECT_EQ(expr->constant_eval(), -3.0);
+
+    inner.set_rexp(ast::RealExpr::create({}, 0.5));
+    EXPECT_EQ(expr->constant_eval(), -2.5);
+    EXPECT_EQ(ast::object::clone(*expr)->constant_eval(), -2.5);
+}
+/******************************************************************************/
+
+// Testing that equal expressions are interned once
+/******************************************************************************/
+TEST(Expr, Pool_Intern) {
+    ast::ExprPool pool;
+    auto quarter = [] {
+        return ast::BExpr::create({}, ast::PiExpr::create({}),
+                                  ast::BinaryOp::Divide,
+                                  ast::IntExpr::create({}, 4));
+    };
+    auto a = pool.intern(*quarter());
+    auto b = pool.intern(*quarter());
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(pool.size(), 3);
+
+    // pi/4+pi/4 stores pi/4 once
+    auto sum = pool.binary(a, ast::BinaryOp::Plus, b);
+    EXPECT_EQ(pool.size(), 4);
+    auto& bexpr = static_cast<const ast::BExpr&>(*sum);
+    EXPECT_EQ(&static_cast<const ast::SharedExpr&>(bexpr.lexp()).target(),
+              &static_cast<const ast::SharedExpr&>(bexpr.rexp()).target());
+
+    // Interning a reference to an interned expression gives it back
+    auto shared = pool.share(*quarter());
+    EXPECT_EQ(pool.intern(*shared), a);
+    EXPECT_EQ(pool.intern(*ast::object::clone(*shared)), a);
+
+    // Literals are compared by value
+    EXPECT_NE(pool.intern(*ast::RealExpr::create({}, 0.0)),
+              pool.intern(*ast::RealExpr::create({}, -0.0)));
+    EXPECT_NE(pool.intern(*ast::IntExpr::create({}, 1)),
+              pool.intern(*ast::RealExpr::create({}, 1.0)));
+
+    // Shared expressions print as the expressions they refer to
+    std::stringstream expected, ss;
+    expected << *ast::BExpr::create({}, quarter(), ast::BinaryOp::Plus,
+                                    quarter());
+    ss << *ast::SharedExpr::create({}, sum);
+    EXPECT_EQ(ss.str(), expected.str());
+    EXPECT_DOUBLE_EQ(*shared->constant_eval(), utils::pi / 4);
+}
+/******************************************************************************/
+
+// Testing substitution into interned expressions
+/******************************************************************************/
+TEST(Expr, Pool_Substitute) {
+    ast::ExprPool pool;
+    auto half = pool.intern(*ast::BExpr::create(
+        {}, ast::VarExpr::create({}, "x"), ast::BinaryOp::Divide,
+        ast::IntExpr::create({}, 2)));
+    auto expr = pool.unary(ast::UnaryOp::Neg, half);
+    auto constant = pool.intern(*ast::PiExpr::create({}));
+
+    auto pi = ast::PiExpr::create({});
+    ast::ExprPool::subst_map subst{{"x", pi.get()}};
+    auto ret = pool.substitute(expr, subst);
+
+    std::stringstream ss;
+    ss << *ast::SharedExpr::create({}, ret);
+    EXPECT_EQ(ss.str(), "-(pi/2)");
+    EXPECT_EQ(pool.substitute(constant, subst), constant);
+    EXPECT_EQ(pool.substitute(expr, {{"y", pi.get()}}), expr);
+
+    // The result is interned
+    EXPECT_EQ(ret, pool.intern(*ast::SharedExpr::create({}, ret)->unshare()));
+}
+/******************************************************************************/
@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "mapping/device.hpp"
+#include <filesystem>
 #include <set>
 
 using namespace staq;
@@ -95,3 +96,96 @@ TEST(Device, Steiner_tree) {
                        steiner_edges(tmp4.begin(), tmp4.end())));
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Device, Steiner_workspace) {
+    mapping::Device test =
+        mapping::parse_json(PROJECT_ROOT_DIR "/qpus/ibm_tokyo.json");
+    std::vector<std::list<int>> terminal_sets{
+        {3, 5, 9, 14, 16, 19}, {1}, {2, 7, 12, 17}, {19, 0, 10}};
+
+    // Reusing one workspace gives the trees of fresh ones
+    mapping::steiner_workspace ws;
+    for (auto& terminals : terminal_sets) {
+        auto tree = test.steiner(terminals, 4, ws);
+        EXPECT_EQ(tree, test.steiner(terminals, 4));
+
+        // A tree reaching every terminal, parents before children
+        std::set<int> reached{4};
+        for (auto [parent, child] : tree) {
+            EXPECT_TRUE(test.coupled(parent, child) ||
+                        test.coupled(child, parent));
+            EXPECT_TRUE(reached.count(parent));
+            EXPECT_TRUE(reached.insert(child).second);
+        }
+        for (auto t : terminals)
+            EXPECT_TRUE(reached.count(t));
+    }
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Device, Routing_Cost) {
+    mapping::Device test = test_device;
+    test.set_routing_cost(mapping::hop_cost);
+    EXPECT_EQ(test.shortest_path(0, 6), mapping::path({0, 5, 6}));
+    test.set_routing_cost(nullptr);
+    EXPECT_EQ(test.shortest_path(0, 6), mapping::path({0, 1, 4, 7, 6}));
+
+    // Better CNOT gates through qubit 3, but only in one direction, so swaps
+    // through it need Hadamard gates
+    mapping::Device square("Square", 4,
+                           {
+                               {0, 1, 0, 1},
+                               {1, 0, 1, 0},
+                               {0, 1, 0, 0},
+                               {0, 0, 1, 0},
+                           },
+                           {0.97, 0.97, 0.97, 0.97},
+                           {
+                               {0, 0.95, 0, 0.97},
+                               {0.95, 0, 0.95, 0},
+                               {0, 0.95, 0, 0},
+                               {0, 0, 0.97, 0},
+                           });
+    EXPECT_EQ(square.shortest_path(0, 2), mapping::path({0, 3, 2}));
+    square.set_routing_cost(mapping::swap_cost);
+    EXPECT_EQ(square.shortest_path(0, 2), mapping::path({0, 1, 2}));
+    EXPECT_NEAR(mapping::swap_cost(square, 0, 1), -3 * std::log(0.95), 1e-12);
+    EXPECT_NEAR(mapping::swap_cost(square, 3, 0),
+                -3 * std::log(0.97) - 4 * std::log(0.97), 1e-12);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Device, Compiled) {
+    std::string fname =
+        (std::filesystem::temp_directory_path() / "staq_device_test.json")
+            .string();
+    {
+        std::ofstream ofs(fname);
+        ofs << test_device.to_json();
+    }
+    auto parsed = mapping::parse_json(fname);
+    auto compiled = mapping::compile_device(fname);
+    auto loaded = mapping::parse_json(fname);
+
+    EXPECT_EQ(loaded.to_json(), parsed.to_json());
+    for (int i = 0; i < test_device.qubits_; i++) {
+        for (int j = 0; j < test_device.qubits_; j++) {
+            EXPECT_EQ(loaded.shortest_path(i, j), parsed.shortest_path(i, j));
+            EXPECT_EQ(loaded.distance(i, j), parsed.distance(i, j));
+        }
+    }
+
+    // A stale compiled device is ignored
+    {
+        std::ofstream ofs(fname);
+        ofs << mapping::fully_connected(3).to_json();
+    }
+    EXPECT_EQ(mapping::parse_json(fname).qubits_, 3);
+
+    std::remove(fname.c_str());
+    std::remove(compiled.c_str());
+}
+/******************************************************************************/
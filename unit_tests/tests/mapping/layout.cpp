@@ -5,6 +5,8 @@
 #include "mapping/layout/basic.hpp"
 #include "mapping/layout/eager.hpp"
 #include "mapping/layout/bestfit.hpp"
+#include "mapping/layout/anneal.hpp"
+#include "mapping/layout/vf2.hpp"
 
 using namespace staq;
 using namespace qasmtools;
@@ -136,3 +138,191 @@ TEST(Layout, Best_Fit) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Layout, Anneal) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg orig[4];\n"
+                      "CX orig[0],orig[3];\n"
+                      "CX orig[0],orig[3];\n"
+                      "CX orig[1],orig[2];\n"
+                      "CX orig[3],orig[1];\n";
+
+    auto program = parser::parse_string(pre, "layout_anneal.qasm");
+    auto init = mapping::compute_basic_layout(test_device, *program);
+    auto cost = mapping::layout_cost(test_device, *program, init, "swap",
+                                     mapping::layout_objective::cnot);
+
+    mapping::LayoutAnnealer::config params;
+    params.time_budget_ms = 0;
+    params.iterations = 200;
+    params.restarts = 2;
+    params.seed = 1;
+    auto layout =
+        mapping::compute_annealed_layout(test_device, init, cost, params);
+
+    // Same seed and iteration budget, same layout
+    EXPECT_EQ(layout, mapping::compute_annealed_layout(test_device, init,
+                                                       cost, params));
+
+    // Every CNOT is local under the annealed layout
+    std::set<int> used;
+    for (auto& [va, idx] : layout) {
+        EXPECT_TRUE(0 <= idx && idx < test_device.qubits_);
+        used.insert(idx);
+    }
+    EXPECT_EQ(used.size(), layout.size());
+
+    // The annealed layout costs no more than the initial one
+    std::vector<int> initial, annealed;
+    for (auto& [va, idx] : init) {
+        initial.push_back(idx);
+        annealed.push_back(layout[va]);
+    }
+    EXPECT_LE(cost(annealed), cost(initial));
+
+    // Mapping with it gives a valid circuit of the predicted cost
+    mapping::apply_layout(layout, test_device, *program);
+    mapping::map_onto_device(test_device, *program);
+    int cnots = 0;
+    for (auto& stmt : program->body()) {
+        if (auto cnot = dynamic_cast<ast::CNOTGate*>(stmt.get())) {
+            EXPECT_TRUE(test_device.coupled(*cnot->ctrl().offset(),
+                                            *cnot->tgt().offset()));
+            cnots++;
+        }
+    }
+    EXPECT_EQ(cnots, cost(annealed));
+    EXPECT_LE(cnots, cost(initial));
+}
+/******************************************************************************/
+
+// Testing the dry run costs against mapping the program
+/******************************************************************************/
+TEST(Layout, Anneal_Costs) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg orig[4];\n"
+                      "creg c[4];\n"
+                      "U(pi/2,0,pi) orig[0];\n"
+                      "CX orig[0],orig[3];\n"
+                      "U(0,0,pi/4) orig[3];\n"
+                      "CX orig[1],orig[2];\n"
+                      "CX orig[3],orig[1];\n"
+                      "U(0.3,0,0) orig[1];\n"
+                      "measure orig[1] -> c[1];\n"
+                      "CX orig[2],orig[0];\n";
+
+    auto program = parser::parse_string(pre, "layout_anneal_costs.qasm");
+    auto init = mapping::compute_basic_layout(test_device, *program);
+    std::vector<int> placement{8, 0, 6, 2};
+
+    for (std::string mapper : {"swap", "steiner", "sabre"}) {
+        for (auto objective : {mapping::layout_objective::cnot,
+                               mapping::layout_objective::fidelity,
+                               mapping::layout_objective::depth}) {
+            auto cost = mapping::layout_cost(test_device, *program, init,
+                                             mapper, objective);
+
+            mapping::layout l;
+            std::size_t q = 0;
+            for (auto& [va, idx] : init)
+                l[va] = placement[q++];
+            auto mapped = ast::object::clone(*program);
+            mapping::apply_layout(l, test_device, *mapped);
+            if (mapper == "swap") {
+                mapping::map_onto_device(test_device, *mapped);
+            } else if (mapper == "steiner") {
+                mapping::steiner_mapping(test_device, *mapped);
+            } else {
+                mapping::SabreMapper::config params;
+                params.layout_passes = 0;
+                mapping::sabre_mapping(test_device, *mapped, params);
+            }
+
+            mapping::MappedCost measure(test_device);
+            EXPECT_DOUBLE_EQ(cost(placement),
+                             measure.run(*mapped, objective))
+                << mapper << " " << static_cast<int>(objective);
+        }
+    }
+
+    // Declared gates would be left out of the cost
+    std::string opaque = "OPENQASM 2.0;\n"
+                         "\n"
+                         "opaque g a,b;\n"
+                         "qreg orig[2];\n"
+                         "g orig[0],orig[1];\n";
+    program = parser::parse_string(opaque, "layout_anneal_opaque.qasm");
+    init = mapping::compute_basic_layout(test_device, *program);
+    EXPECT_THROW(mapping::layout_cost(test_device, *program, init, "swap",
+                                      mapping::layout_objective::cnot),
+                 std::logic_error);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Layout, VF2) {
+    // A 6-cycle with a pendant qubit embeds into the device
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg orig[7];\n"
+                      "CX orig[0],orig[1];\n"
+                      "CX orig[1],orig[2];\n"
+                      "CX orig[2],orig[3];\n"
+                      "CX orig[3],orig[4];\n"
+                      "CX orig[4],orig[5];\n"
+                      "CX orig[5],orig[0];\n"
+                      "CX orig[6],orig[3];\n"
+                      "CX orig[6],orig[3];\n";
+
+    auto program = parser::parse_string(pre, "layout_vf2.qasm");
+    auto layout = mapping::compute_vf2_layout(test_device, *program);
+
+    std::set<int> used;
+    for (auto& [va, idx] : layout) {
+        EXPECT_TRUE(0 <= idx && idx < test_device.qubits_);
+        used.insert(idx);
+    }
+    EXPECT_EQ(used.size(), layout.size());
+
+    // No CNOT needs routing
+    mapping::apply_layout(layout, test_device, *program);
+    mapping::map_onto_device(test_device, *program);
+    int cnots = 0;
+    for (auto& stmt : program->body()) {
+        if (dynamic_cast<ast::CNOTGate*>(stmt.get()))
+            cnots++;
+    }
+    EXPECT_EQ(cnots, 8);
+
+    // A triangle does not embed into the (bipartite) device, but the layout
+    // is still complete and keeps the heavier interactions local
+    std::string tri = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg orig[3];\n"
+                      "CX orig[0],orig[1];\n"
+                      "CX orig[0],orig[1];\n"
+                      "CX orig[1],orig[2];\n"
+                      "CX orig[1],orig[2];\n"
+                      "CX orig[2],orig[0];\n";
+
+    auto triangle = parser::parse_string(tri, "layout_vf2_triangle.qasm");
+    mapping::VF2Layout::config params;
+    params.max_states = 1000;
+    layout = mapping::compute_vf2_layout(test_device, *triangle, params);
+    ASSERT_EQ(layout.size(), 3);
+
+    // The state cap gives the same layout every time
+    EXPECT_EQ(mapping::compute_vf2_layout(test_device, *triangle, params),
+              layout);
+
+    std::vector<int> phys(3);
+    for (auto& [va, idx] : layout)
+        phys[va.offset().value()] = idx;
+    EXPECT_TRUE(test_device.coupled(phys[0], phys[1]));
+    EXPECT_TRUE(test_device.coupled(phys[1], phys[2]));
+    EXPECT_NE(phys[0], phys[2]);
+}
+/******************************************************************************/
@@ -1,9 +1,13 @@
 #include "gtest/gtest.h"
 #include "qasmtools/parser/parser.hpp"
 #include "mapping/device.hpp"
+#include "mapping/fidelity.hpp"
 
+#include "mapping/layout/basic.hpp"
 #include "mapping/mapping/swap.hpp"
 #include "mapping/mapping/steiner.hpp"
+#include "mapping/mapping/sabre.hpp"
+#include "mapping/mapping/sliced.hpp"
 
 using namespace staq;
 using namespace qasmtools;
@@ -88,6 +92,77 @@ TEST(Swap_Mapper, Shortest_Path) {
 }
 /******************************************************************************/
 
+/******************************************************************************/
+TEST(Swap_Mapper, Dry_Run) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg orig[4];\n"
+                      "CX orig[0],orig[3];\n"
+                      "CX orig[2],orig[1];\n"
+                      "CX orig[3],orig[1];\n"
+                      "CX orig[0],orig[2];\n";
+
+    auto program = parser::parse_string(pre, "swap_dry.qasm");
+    auto l = mapping::compute_basic_layout(test_device, *program);
+    for (auto& [va, idx] : l) {
+        idx = 8 - 2 * idx;
+    }
+    mapping::SwapDry dry(test_device, *program, l);
+    std::vector<int> placement;
+    for (auto& [va, idx] : l) {
+        placement.push_back(idx);
+    }
+    int expected = dry.get_cnot_count(placement);
+
+    mapping::apply_layout(l, test_device, *program);
+    mapping::map_onto_device(test_device, *program);
+    int cnots = 0;
+    for (auto& stmt : program->body()) {
+        if (dynamic_cast<ast::CNOTGate*>(stmt.get()))
+            cnots++;
+    }
+    EXPECT_EQ(cnots, expected);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Swap_Mapper, Sliced) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg orig[4];\n"
+                      "CX orig[0],orig[3];\n"
+                      "h orig[1];\n"
+                      "CX orig[2],orig[1];\n"
+                      "CX orig[3],orig[1];\n"
+                      "t orig[0];\n"
+                      "CX orig[0],orig[2];\n"
+                      "CX orig[1],orig[0];\n"
+                      "CX orig[3],orig[2];\n";
+
+    auto serial = parser::parse_string(pre, "swap_sliced.qasm");
+    auto sliced = parser::parse_string(pre, "swap_sliced.qasm");
+    auto l = mapping::compute_basic_layout(test_device, *serial);
+    for (auto& [va, idx] : l) {
+        idx = 8 - 2 * idx;
+    }
+    mapping::apply_layout(l, test_device, *serial);
+    mapping::apply_layout(l, test_device, *sliced);
+
+    mapping::SlicedMapper::config params;
+    params.slice_size = 2;
+    params.num_threads = 2;
+    auto perm = mapping::map_onto_device(test_device, *serial);
+    EXPECT_EQ(mapping::sliced_swap_mapping(test_device, *sliced, params),
+              perm);
+
+    std::stringstream ss1, ss2;
+    ss1 << *serial;
+    ss2 << *sliced;
+    EXPECT_EQ(ss1.str(), ss2.str());
+}
+/******************************************************************************/
+
 /******************************************************************************/
 TEST(Steiner_Mapper, Base) {
     std::string pre = "OPENQASM 2.0;\n"
@@ -192,3 +267,357 @@ TEST(Steiner_Mapper, Swap_No_Z) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Steiner_Mapper, Partial_Flush) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "CX q[0],q[1];\n"
+                      "U(pi/2,0,pi) q[2];\n"
+                      "CX q[0],q[1];\n"
+                      "U(pi/2,0,pi) q[1];\n";
+
+    std::string full = "OPENQASM 2.0;\n"
+                       "\n"
+                       "qreg q[9];\n"
+                       "CX q[0],q[1];\n"
+                       "U(pi/2,0,pi) q[2];\n"
+                       "CX q[0],q[1];\n"
+                       "U(pi/2,0,pi) q[1];\n";
+
+    // The Hadamard on q[2] leaves the CNOTs on q[0], q[1] pending
+    std::string partial = "OPENQASM 2.0;\n"
+                          "\n"
+                          "qreg q[9];\n"
+                          "U(pi/2,0,pi) q[2];\n"
+                          "U(pi/2,0,pi) q[1];\n";
+
+    auto program = parser::parse_string(pre, "steiner_partial.qasm");
+    mapping::steiner_mapping(test_device, *program);
+    std::stringstream ss1;
+    ss1 << *program;
+    EXPECT_EQ(ss1.str(), full);
+
+    mapping::SteinerMapper::config params;
+    params.partial_flush = true;
+    program = parser::parse_string(pre, "steiner_partial.qasm");
+    mapping::steiner_mapping(test_device, *program, params);
+    std::stringstream ss2;
+    ss2 << *program;
+    EXPECT_EQ(ss2.str(), partial);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Steiner_Mapper, Layout_Search) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg orig[6];\n"
+                      "CX orig[4],orig[2];\n"
+                      "CX orig[2],orig[3];\n"
+                      "CX orig[3],orig[1];\n"
+                      "CX orig[3],orig[5];\n"
+                      "CX orig[0],orig[2];\n"
+                      "CX orig[2],orig[3];\n"
+                      "U(0,0,pi/4) orig[5];\n"
+                      "CX orig[5],orig[3];\n"
+                      "CX orig[3],orig[0];\n"
+                      "CX orig[3],orig[5];\n"
+                      "CX orig[4],orig[0];\n";
+
+    auto program = parser::parse_string(pre, "steiner_layout.qasm");
+    auto init = mapping::compute_basic_layout(test_device, *program);
+    mapping::SteinerDry dry(test_device);
+    int initial_cost = dry.get_cnot_count(*program, init);
+
+    // Sequential hill climb, restarting after each improvement
+    auto expected = init;
+    int expected_cost = initial_cost;
+    for (bool improved = true; improved;) {
+        improved = false;
+        for (auto it = expected.begin(); !improved && it != expected.end();
+             it++) {
+            for (auto ti = std::next(it); ti != expected.end(); ti++) {
+                std::swap(it->second, ti->second);
+                int cost = dry.get_cnot_count(*program, expected);
+                if (cost < expected_cost) {
+                    expected_cost = cost;
+                    improved = true;
+                    break;
+                }
+                std::swap(it->second, ti->second);
+            }
+        }
+    }
+
+    // The default search gives the same layout for any number of threads
+    auto serial = init;
+    mapping::optimize_steiner_layout(test_device, serial, *program, {1});
+    EXPECT_EQ(serial, expected);
+    auto parallel = init;
+    mapping::optimize_steiner_layout(test_device, parallel, *program, {4});
+    EXPECT_EQ(parallel, expected);
+    EXPECT_EQ(dry.get_cnot_count(*program, parallel), 17);
+
+    // Cyclic scan, also independent of the number of threads
+    auto cyclic_serial = init;
+    mapping::optimize_steiner_layout(
+        test_device, cyclic_serial, *program,
+        {1, mapping::layout_search_strategy::cyclic});
+    auto cyclic_parallel = init;
+    mapping::optimize_steiner_layout(
+        test_device, cyclic_parallel, *program,
+        {4, mapping::layout_search_strategy::cyclic});
+    EXPECT_EQ(cyclic_serial, cyclic_parallel);
+    EXPECT_LE(dry.get_cnot_count(*program, cyclic_serial), initial_cost);
+
+    // Best improvement, limited to a single step
+    auto best = init;
+    mapping::optimize_steiner_layout(
+        test_device, best, *program,
+        {4, mapping::layout_search_strategy::best, 1});
+    int moved = 0;
+    for (auto& [va, idx] : best) {
+        if (init[va] != idx)
+            moved++;
+    }
+    EXPECT_TRUE(moved == 0 || moved == 2);
+    EXPECT_LE(dry.get_cnot_count(*program, best), initial_cost);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Steiner_Mapper, Chunked_Dry_Run) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg orig[4];\n"
+                      "CX orig[0],orig[3];\n"
+                      "U(0,0,pi/4) orig[3];\n"
+                      "CX orig[1],orig[3];\n"
+                      "U(0,0,pi/4) orig[3];\n"
+                      "U(pi/2,0,pi) orig[0];\n"
+                      "U(0,0,pi/4) orig[2];\n"
+                      "CX orig[2],orig[1];\n"
+                      "CX orig[0],orig[2];\n";
+
+    auto program = parser::parse_string(pre, "steiner_chunks.qasm");
+    auto l = mapping::compute_basic_layout(test_device, *program);
+    mapping::SteinerChunks chunks(*program, l);
+    EXPECT_EQ(chunks.chunks().size(), 2u);
+
+    // The chunks cost as much as the whole program, under any layout
+    mapping::SteinerDry dry(test_device);
+    for (auto& [va, idx] : l) {
+        idx = 8 - idx;
+        auto placement = chunks.placement(l);
+        int total = 0;
+        for (auto& chunk : chunks.chunks()) {
+            total += dry.get_cnot_count(chunk, placement);
+        }
+        EXPECT_EQ(total, dry.get_cnot_count(*program, l));
+    }
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Steiner_Mapper, Sliced) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "CX q[0],q[4];\n"
+                      "t q[4];\n"
+                      "CX q[3],q[8];\n"
+                      "h q[2];\n"
+                      "CX q[2],q[6];\n"
+                      "CX q[6],q[0];\n"
+                      "tdg q[0];\n"
+                      "h q[6];\n"
+                      "CX q[8],q[1];\n"
+                      "CX q[1],q[5];\n"
+                      "s q[5];\n"
+                      "CX q[7],q[3];\n";
+
+    auto serial = parser::parse_string(pre, "steiner_sliced.qasm");
+    auto sliced = parser::parse_string(pre, "steiner_sliced.qasm");
+    mapping::steiner_mapping(test_device, *serial);
+
+    // Slices end at synthesis points, so the output is the same
+    mapping::SlicedMapper::config params;
+    params.slice_size = 3;
+    params.num_threads = 2;
+    mapping::sliced_steiner_mapping(test_device, *sliced, params);
+
+    std::stringstream ss1, ss2;
+    ss1 << *serial;
+    ss2 << *sliced;
+    EXPECT_EQ(ss1.str(), ss2.str());
+
+    // The Steiner mapper options reach the slices
+    params.steiner.partial_flush = true;
+    serial = parser::parse_string(pre, "steiner_sliced.qasm");
+    sliced = parser::parse_string(pre, "steiner_sliced.qasm");
+    mapping::steiner_mapping(test_device, *serial, params.steiner);
+    params.slice_size = 100;
+    mapping::sliced_steiner_mapping(test_device, *sliced, params);
+
+    std::stringstream ss3, ss4;
+    ss3 << *serial;
+    ss4 << *sliced;
+    EXPECT_EQ(ss3.str(), ss4.str());
+    EXPECT_NE(ss3.str(), ss1.str());
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Sabre_Mapper, Base) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "CX q[0],q[2];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "\n"
+                       "qreg q[9];\n"
+                       "CX q[0],q[1];\n"
+                       "CX q[1],q[0];\n"
+                       "CX q[0],q[1];\n"
+                       "CX q[1],q[2];\n";
+
+    mapping::SabreMapper::config params;
+    params.layout_passes = 0;
+
+    auto program = parser::parse_string(pre, "sabre_base.qasm");
+    auto perm = mapping::sabre_mapping(test_device, *program, params);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+    EXPECT_EQ(perm[0], 1);
+    EXPECT_EQ(perm[1], 0);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Sabre_Mapper, Local) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "creg c[9];\n"
+                      "CX q[0],q[1];\n"
+                      "U(pi/2,0,pi) q[2];\n"
+                      "CX q[1],q[4];\n"
+                      "CX q[4],q[7];\n"
+                      "measure q[7] -> c[7];\n"
+                      "CX q[3],q[8];\n";
+
+    auto program = parser::parse_string(pre, "sabre_local.qasm");
+    mapping::sabre_mapping(test_device, *program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), pre);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Sabre_Mapper, Layout_Refinement) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg orig[3];\n"
+                      "CX orig[0],orig[2];\n"
+                      "CX orig[0],orig[2];\n";
+
+    auto program = parser::parse_string(pre, "sabre_layout.qasm");
+    auto layout = mapping::compute_basic_layout(test_device, *program);
+    mapping::apply_layout(layout, test_device, *program);
+    mapping::sabre_mapping(test_device, *program, layout);
+
+    // The refined placement needs no swaps at all
+    ast::VarAccess ctrl(parser::Position(), "orig", 0);
+    ast::VarAccess tgt(parser::Position(), "orig", 2);
+    int cnots = 0;
+    for (auto& stmt : program->body()) {
+        if (auto cx = dynamic_cast<ast::CNOTGate*>(stmt.get())) {
+            EXPECT_EQ(*cx->ctrl().offset(), layout[ctrl]);
+            EXPECT_EQ(*cx->tgt().offset(), layout[tgt]);
+            cnots++;
+        }
+    }
+    EXPECT_EQ(cnots, 2);
+    EXPECT_TRUE(test_device.coupled(layout[ctrl], layout[tgt]));
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Sabre_Mapper, Coupled) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "CX q[0],q[8];\n"
+                      "CX q[2],q[6];\n"
+                      "CX q[3],q[5];\n"
+                      "U(0,0,pi/4) q[8];\n"
+                      "CX q[8],q[2];\n"
+                      "CX q[6],q[0];\n"
+                      "CX q[5],q[1];\n"
+                      "CX q[7],q[3];\n"
+                      "CX q[4],q[0];\n"
+                      "CX q[1],q[6];\n";
+
+    auto program = parser::parse_string(pre, "sabre_coupled.qasm");
+    mapping::sabre_mapping(test_device, *program);
+
+    for (auto& stmt : program->body()) {
+        if (auto cx = dynamic_cast<ast::CNOTGate*>(stmt.get())) {
+            EXPECT_TRUE(test_device.coupled(*cx->ctrl().offset(),
+                                            *cx->tgt().offset()));
+        }
+    }
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Sabre_Mapper, Multi_Qubit_Gate) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "gate g(theta) a,b {\n"
+                      "\tU(theta,0,0) a;\n"
+                      "\tCX a,b;\n"
+                      "}\n"
+                      "opaque tri a,b,c;\n"
+                      "qreg q[9];\n"
+                      "g(pi) q[0],q[2];\n"
+                      "tri q[0],q[1],q[2];\n";
+
+    auto program = parser::parse_string(pre, "sabre_multi.qasm");
+    EXPECT_THROW(mapping::sabre_mapping(test_device, *program),
+                 std::logic_error);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Mapping, Estimated_Fidelity) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "CX q[0],q[1];\n"
+                      "U(pi/2,0,pi) q[4];\n"
+                      "CX q[1],q[4];\n"
+                      "CX q[7],q[8];\n";
+
+    auto program = parser::parse_string(pre, "fidelity.qasm");
+    EXPECT_NEAR(mapping::estimate_fidelity(test_device, *program),
+                0.9 * 0.8 * 0.5, 1e-12);
+
+    // Not mapped
+    std::string bad = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[9];\n"
+                      "CX q[0],q[8];\n";
+    auto unmapped = parser::parse_string(bad, "fidelity_unmapped.qasm");
+    EXPECT_THROW(mapping::estimate_fidelity(test_device, *unmapped),
+                 std::logic_error);
+}
+/******************************************************************************/
@@ -100,3 +100,38 @@ TEST(CNOT_resynthesis, Decl_opt) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(CNOT_resynthesis, Partial_flush) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[3];\n"
+                      "cx q[0],q[1];\n"
+                      "h q[2];\n"
+                      "t q[1];\n"
+                      "h q[0];\n"
+                      "cx q[0],q[1];\n";
+
+    // The first Hadamard leaves everything pending, the second one flushes
+    // q[0] and q[1], which share a parity
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "qreg q[3];\n"
+                       "h q[2];\n"
+                       "cx q[1],q[0];\n"
+                       "t q[0];\n"
+                       "cx q[1],q[0];\n"
+                       "cx q[0],q[1];\n"
+                       "h q[0];\n"
+                       "cx q[0],q[1];\n";
+
+    auto program = parser::parse_string(pre, "partial_flush.qasm");
+    optimization::optimize_CNOT(*program, {true});
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
@@ -176,3 +176,39 @@ TEST(Simplify, Nested_Cancellation) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Simplify, Gate_Body_And_Conditional) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "gate foo a {\n"
+                      "\th a;\n"
+                      "\th a;\n"
+                      "\tx a;\n"
+                      "}\n"
+                      "qreg q[1];\n"
+                      "creg c[1];\n"
+                      "if (c==1) U(0,0,0) q[0];\n"
+                      "foo q[0];\n"
+                      "x q[0];\n"
+                      "x q[0];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "\n"
+                       "gate foo a {\n"
+                       "\tx a;\n"
+                       "}\n"
+                       "qreg q[1];\n"
+                       "creg c[1];\n"
+                       "foo q[0];\n";
+
+    auto program = parser::parse_string(pre, "gate_body_and_conditional.qasm");
+    optimization::simplify(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
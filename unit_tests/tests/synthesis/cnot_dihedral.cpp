@@ -153,6 +153,46 @@ TEST(Gray_Synth, Gray_code) {
 }
 /******************************************************************************/
 
+/******************************************************************************/
+TEST(Gray_Synth, Split_dependent) {
+    std::list<synthesis::phase_term> f;
+    f.emplace_back(phase({false, true, true, false}, angles::pi_quarter));
+    f.emplace_back(phase({false, false, false, true}, angles::pi_half));
+
+    synthesis::linear_op<bool> mat{
+        {1, 0, 0, 0},
+        {1, 1, 0, 0},
+        {0, 0, 1, 0},
+        {0, 0, 0, 1},
+    };
+
+    // Wire 1 depends on wire 0 through the linear part, and wire 2 on wire 1
+    // through the first phase term
+    auto [terms, part] = synthesis::split_dependent(f, mat, {0});
+
+    synthesis::linear_op<bool> id{
+        {1, 0, 0, 0},
+        {0, 1, 0, 0},
+        {0, 0, 1, 0},
+        {0, 0, 0, 1},
+    };
+    synthesis::linear_op<bool> expected{
+        {1, 0, 0, 0},
+        {1, 1, 0, 0},
+        {0, 0, 1, 0},
+        {0, 0, 0, 1},
+    };
+
+    EXPECT_EQ(part, expected);
+    EXPECT_EQ(mat, id);
+    ASSERT_EQ(terms.size(), 1);
+    EXPECT_EQ(terms.front().first,
+              std::vector<bool>({false, true, true, false}));
+    ASSERT_EQ(f.size(), 1);
+    EXPECT_EQ(f.front().first, std::vector<bool>({false, false, false, true}));
+}
+/******************************************************************************/
+
 /******************************************************************************/
 // This test should mimic the Steiner_Gauss base case
 TEST(Gray_Steiner, Base) {
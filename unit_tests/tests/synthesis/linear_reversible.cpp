@@ -2,6 +2,8 @@
 #include "mapping/device.hpp"
 #include "synthesis/linear_reversible.hpp"
 
+#include <random>
+
 using namespace staq;
 using circuit = std::list<std::pair<int, int>>;
 
@@ -73,6 +75,54 @@ TEST(Gaussian_Synthesis, 3_Qubit) {
 }
 /******************************************************************************/
 
+/******************************************************************************/
+TEST(PMH_Synthesis, Base) {
+    synthesis::linear_op<bool> mat{
+        {1, 0},
+        {1, 1},
+    };
+    EXPECT_EQ(synthesis::pmh(mat), circuit({{0, 1}}));
+
+    synthesis::linear_op<bool> swap{
+        {0, 1},
+        {1, 0},
+    };
+    EXPECT_EQ(synthesis::pmh(swap), circuit({{1, 0}, {0, 1}, {1, 0}}));
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(PMH_Synthesis, Random) {
+    std::size_t n = 100;
+    synthesis::linear_op<bool> id(n, std::vector<bool>(n, false));
+    for (std::size_t i = 0; i < n; i++)
+        id[i][i] = true;
+
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<std::size_t> dist(0, n - 1);
+    auto mat = id;
+    for (std::size_t k = 0; k < n * n; k++) {
+        auto ctrl = dist(gen);
+        auto tgt = dist(gen);
+        if (ctrl != tgt)
+            synthesis::operator^=(mat[tgt], mat[ctrl]);
+    }
+
+    auto pmh = synthesis::pmh(mat);
+    auto applied = id;
+    for (auto& [ctrl, tgt] : pmh)
+        synthesis::operator^=(applied[tgt], applied[ctrl]);
+    EXPECT_EQ(applied, mat);
+    EXPECT_LT(pmh.size(), synthesis::gauss_jordan(mat).size());
+
+    // Oversized sections are capped rather than tabulating 2^60 patterns
+    applied = id;
+    for (auto& [ctrl, tgt] : synthesis::pmh(mat, 60))
+        synthesis::operator^=(applied[tgt], applied[ctrl]);
+    EXPECT_EQ(applied, mat);
+}
+/******************************************************************************/
+
 /******************************************************************************/
 TEST(Steiner_Gauss, Base) {
     synthesis::linear_op<bool> mat{
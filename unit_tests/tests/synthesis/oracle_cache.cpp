@@ -0,0 +1,239 @@
+#include "gtest/gtest.h"
+#include "qasmtools/parser/parser.hpp"
+#include "synthesis/oracle_cache.hpp"
+#include "transformations/oracle_synthesizer.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace staq;
+using namespace qasmtools;
+
+static synthesis::oracle_circuit test_oracle() {
+    synthesis::oracle_circuit ret;
+    ret.num_inputs = 2;
+    ret.num_qubits = 3;
+    ret.gates.push_back({"h", std::nullopt, {2}});
+    ret.gates.push_back({"cx", std::nullopt, {0, 2}});
+    ret.gates.push_back({"rz", utils::Angle(3, 4), {2}});
+    ret.gates.push_back({"rx", utils::Angle(0.1), {1}});
+    ret.gates.push_back({"ccx", std::nullopt, {0, 1, 2}});
+    return ret;
+}
+
+// In-memory entries are shared by the whole process, so every test starts
+// from an empty cache
+class Oracle_cache : public ::testing::Test {
+  protected:
+    void SetUp() override { synthesis::OracleCache::clear_memory(); }
+    void TearDown() override { synthesis::OracleCache::clear_memory(); }
+};
+
+// Testing the synthesized oracle cache
+/******************************************************************************/
+TEST_F(Oracle_cache, Round_trip) {
+    auto oracle = test_oracle();
+    std::stringstream ss;
+    synthesis::write_oracle(ss, oracle);
+    auto read = synthesis::read_oracle(ss);
+
+    ASSERT_TRUE(read);
+    EXPECT_EQ(read->num_inputs, 2);
+    EXPECT_EQ(read->num_qubits, 3);
+    ASSERT_EQ(read->gates.size(), oracle.gates.size());
+    for (std::size_t i = 0; i < oracle.gates.size(); i++) {
+        EXPECT_EQ(read->gates[i].name, oracle.gates[i].name);
+        EXPECT_EQ(read->gates[i].angle, oracle.gates[i].angle);
+        EXPECT_EQ(read->gates[i].qubits, oracle.gates[i].qubits);
+    }
+    EXPECT_TRUE(read->gates[2].angle->is_symbolic());
+    EXPECT_TRUE(read->gates[3].angle->is_numeric());
+
+    std::stringstream truncated(ss.str().substr(0, ss.str().size() / 2));
+    EXPECT_FALSE(synthesis::read_oracle(truncated));
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST_F(Oracle_cache, Body) {
+    parser::Position pos;
+    auto body = synthesis::oracle_body(pos, test_oracle(), {"x", "y"});
+
+    std::stringstream ss;
+    for (auto& gate : body)
+        ss << *gate;
+    EXPECT_EQ(ss.str(), "ancilla anc[1];\n"
+                        "h anc[0];\n"
+                        "cx x,anc[0];\n"
+                        "rz((pi*3)/4) anc[0];\n"
+                        "rx(0.1) y;\n"
+                        "ccx x,y,anc[0];\n");
+
+    EXPECT_THROW(synthesis::oracle_body(pos, test_oracle(), {"x"}),
+                 ast::SemanticError);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST_F(Oracle_cache, Disk) {
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / "staq_oracle_cache_test";
+    fs::remove_all(dir);
+
+    auto logic = fs::temp_directory_path() / "staq_oracle_cache_test.v";
+    std::ofstream(logic) << "module top (a, b);\n";
+    auto key = synthesis::oracle_key(logic.string());
+    ASSERT_TRUE(key);
+
+    // Different contents, different key
+    std::ofstream(logic) << "module top (a, c);\n";
+    EXPECT_NE(synthesis::oracle_key(logic.string()), key);
+    EXPECT_FALSE(synthesis::oracle_key((dir / "missing.v").string()));
+
+    synthesis::OracleCache cache(dir.string());
+    cache.insert(*key, test_oracle());
+    EXPECT_TRUE(synthesis::OracleCache().find(*key));
+
+    // Found on disk once the process forgets it
+    synthesis::OracleCache::clear_memory();
+    EXPECT_FALSE(synthesis::OracleCache().find(*key));
+    auto found = cache.find(*key);
+    ASSERT_TRUE(found);
+    EXPECT_EQ(found->gates.size(), 5u);
+
+    std::ifstream ifs(cache.path(*key));
+    std::uint64_t check, size;
+    ifs >> check >> size;
+    EXPECT_EQ(check, key->check);
+    EXPECT_EQ(size, key->size);
+    ifs.ignore(1);
+    auto stored = synthesis::read_oracle(ifs);
+    ASSERT_TRUE(stored);
+    EXPECT_EQ(stored->gates.size(), 5u);
+
+    // A colliding hash is a miss, in memory and on disk
+    auto collision = *key;
+    collision.check++;
+    EXPECT_FALSE(cache.find(collision));
+    synthesis::OracleCache::clear_memory();
+    EXPECT_FALSE(cache.find(collision));
+    collision = *key;
+    collision.size++;
+    EXPECT_FALSE(cache.find(collision));
+    EXPECT_TRUE(cache.find(*key));
+
+    fs::remove_all(dir);
+    fs::remove(logic);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST_F(Oracle_cache, Parallel_synthesis) {
+    namespace fs = std::filesystem;
+    auto maj = fs::temp_directory_path() / "staq_oracle_synthesizer_maj.v";
+    auto parity = fs::temp_directory_path() / "staq_oracle_synthesizer_xor.v";
+    std::ofstream(maj) << "module top (a, b, c, y);\n"
+                          "  input a, b, c;\n"
+                          "  output y;\n"
+                          "  assign y = (a & b) | (a & c) | (b & c);\n"
+                          "endmodule\n";
+    std::ofstream(parity) << "module top (a, b, c, y);\n"
+                             "  input a, b, c;\n"
+                             "  output y;\n"
+                             "  assign y = a ^ b ^ c;\n"
+                             "endmodule\n";
+
+    std::string src = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "oracle maj1 a,b,c,y { \"" +
+                      maj.generic_string() +
+                      "\" }\n"
+                      "oracle parity a,b,c,y { \"" +
+                      parity.generic_string() +
+                      "\" }\n"
+                      "oracle maj2 a,b,c,y { \"" +
+                      maj.generic_string() +
+                      "\" }\n"
+                      "qreg q[4];\n"
+                      "maj1 q[0],q[1],q[2],q[3];\n"
+                      "parity q[0],q[1],q[2],q[3];\n"
+                      "maj2 q[0],q[1],q[2],q[3];\n";
+
+    transformations::OracleSynthesizer::config serial;
+    serial.cache = false;
+    auto expected = parser::parse_string(src, "parallel.qasm");
+    transformations::OracleSynthesizer alg(serial);
+    expected->accept(alg);
+
+    transformations::OracleSynthesizer::config parallel;
+    parallel.cache = false;
+    parallel.num_threads = 3;
+    auto program = parser::parse_string(src, "parallel.qasm");
+    transformations::synthesize_oracles(*program, parallel);
+
+    std::stringstream ss1, ss2;
+    ss1 << *expected;
+    ss2 << *program;
+    EXPECT_EQ(ss2.str(), ss1.str());
+    EXPECT_EQ(ss2.str().find("oracle"), std::string::npos);
+    EXPECT_LT(ss2.str().find("gate maj1"), ss2.str().find("gate parity"));
+    EXPECT_LT(ss2.str().find("gate parity"), ss2.str().find("gate maj2"));
+
+    fs::remove(maj);
+    fs::remove(parity);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST_F(Oracle_cache, Synthesis_settings) {
+    namespace fs = std::filesystem;
+    auto logic = fs::temp_directory_path() / "staq_oracle_settings_test.v";
+    std::ofstream(logic) << "module top (a, b, c, d, y);\n"
+                            "  input a, b, c, d;\n"
+                            "  output y;\n"
+                            "  assign y = (a & b) ^ (c & d) ^ (a & c);\n"
+                            "endmodule\n";
+
+    synthesis::LogicSynthesizer::config settings;
+    auto net = synthesis::read_network(logic.string());
+    auto base = synthesis::synthesize_circuit(net, settings);
+    ASSERT_TRUE(base);
+    EXPECT_EQ(base->num_inputs, 5);
+
+    settings.cut_size = 4;
+    settings.strategy = synthesis::lhrs_strategy::bennett;
+    settings.stg = synthesis::stg_method::pprm;
+    settings.max_controls = 2;
+    settings.t_par = true;
+    auto other = synthesis::synthesize_circuit(net, settings);
+    ASSERT_TRUE(other);
+    EXPECT_EQ(other->num_inputs, 5);
+    EXPECT_NE(synthesis::oracle_key(logic.string(), settings),
+              synthesis::oracle_key(logic.string()));
+
+    // The portfolio tries the default settings, so does no worse
+    synthesis::LogicSynthesizer::config portfolio;
+    portfolio.portfolio = true;
+    portfolio.num_threads = 2;
+    synthesis::LogicSynthesizer alg(portfolio);
+    EXPECT_EQ(alg.candidates().size(), 12u);
+    auto best = alg.run(net);
+    ASSERT_TRUE(best);
+    EXPECT_TRUE(alg.complete());
+    EXPECT_LE(synthesis::t_count(*best), synthesis::t_count(*base));
+
+    // Complete portfolios don't depend on the workers or the budget
+    auto budgeted = portfolio;
+    budgeted.num_threads = 1;
+    budgeted.time_budget_ms = 10;
+    EXPECT_EQ(synthesis::oracle_key(logic.string(), budgeted),
+              synthesis::oracle_key(logic.string(), portfolio));
+
+    settings.max_controls = 5;
+    EXPECT_THROW(synthesis::synthesize_circuit(net, settings),
+                 std::logic_error);
+
+    fs::remove(logic);
+}
+/******************************************************************************/
@@ -53,3 +53,32 @@ TEST(BarrierMerge, NonAdjacent) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+// Testing that barriers on whole registers are not merged
+/******************************************************************************/
+TEST(BarrierMerge, Registers) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[3];\n"
+                      "qreg p[2];\n"
+                      "barrier q;\n"
+                      "barrier p;\n"
+                      "barrier q[0];\n"
+                      "barrier p[1];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "\n"
+                       "qreg q[3];\n"
+                       "qreg p[2];\n"
+                       "barrier q;\n"
+                       "barrier p;\n"
+                       "barrier q[0],p[1];\n";
+
+    auto program = parser::parse_string(pre, "registers.qasm");
+    transformations::merge_barriers(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
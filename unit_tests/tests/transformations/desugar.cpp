@@ -2,6 +2,7 @@
 #include "qasmtools/parser/parser.hpp"
 #include "transformations/desugar.hpp"
 #include "transformations/barrier_merge.hpp"
+#include "tools/resource_estimator.hpp"
 
 using namespace staq;
 using namespace qasmtools;
@@ -104,3 +105,103 @@ TEST(Desugar, Mixin) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+// Testing resource counts of gates applied to whole registers
+/******************************************************************************/
+TEST(Desugar, Batch_Resources) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "gate maj a,b,c {\n"
+                      "\tcx c,b;\n"
+                      "\tcx c,a;\n"
+                      "\tccx a,b,c;\n"
+                      "}\n"
+                      "qreg q[3];\n"
+                      "qreg p[3];\n"
+                      "qreg w[1];\n"
+                      "creg c[3];\n"
+                      "h q;\n"
+                      "cx q,p;\n"
+                      "t p[1];\n"
+                      "maj q,p,w[0];\n"
+                      "barrier q,p[1];\n"
+                      "rz(pi/4) p;\n"
+                      "reset w;\n"
+                      "measure p -> c;\n";
+
+    auto batched = parser::parse_string(src, "batched.qasm");
+    auto expected = parser::parse_string(src, "expanded.qasm");
+    transformations::desugar(*expected);
+    transformations::merge_barriers(*expected);
+
+    EXPECT_EQ(tools::estimate_resources(*batched),
+              tools::estimate_resources(*expected));
+}
+/******************************************************************************/
+
+// Testing that merging barriers before desugaring, as --lazy-registers does,
+// gives the same program as merging after
+/******************************************************************************/
+TEST(Desugar, Batch_Barriers) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "include \"qelib1.inc\";\n"
+                      "\n"
+                      "qreg q[3];\n"
+                      "qreg w[3];\n"
+                      "qreg p[2];\n"
+                      "h q;\n"
+                      "barrier q;\n"
+                      "barrier w[0];\n"
+                      "cx q,w;\n"
+                      "barrier w[1];\n"
+                      "barrier q;\n"
+                      "barrier p;\n"
+                      "barrier w[2],q[0];\n"
+                      "barrier q,w[1];\n"
+                      "h p;\n";
+
+    auto lazy = parser::parse_string(src, "lazy.qasm");
+    transformations::merge_barriers(*lazy);
+    auto lazy_count = tools::estimate_resources(*lazy);
+    transformations::desugar(*lazy);
+    transformations::merge_barriers(*lazy);
+
+    auto eager = parser::parse_string(src, "eager.qasm");
+    transformations::desugar(*eager);
+    transformations::merge_barriers(*eager);
+
+    // Resources are counted on the sugared program in lazy mode
+    EXPECT_EQ(lazy_count, tools::estimate_resources(*eager));
+
+    std::stringstream ss1, ss2;
+    ss1 << *lazy;
+    ss2 << *eager;
+    EXPECT_EQ(ss1.str(), ss2.str());
+    EXPECT_NE(ss2.str().find("barrier q[0],q[1],q[2],w[0];\n"),
+              std::string::npos);
+    auto decl = ss2.str().find("qreg p[2];\n") + 11;
+    EXPECT_EQ(ss2.str().find("p[2]", decl), std::string::npos);
+
+    src = "OPENQASM 2.0;\n"
+          "include \"qelib1.inc\";\n"
+          "\n"
+          "qreg q[3];\n"
+          "qreg p[3];\n"
+          "h q;\n"
+          "barrier q;\n"
+          "barrier p;\n"
+          "cx q,p;\n";
+
+    lazy = parser::parse_string(src, "lazy.qasm");
+    transformations::merge_barriers(*lazy);
+    lazy_count = tools::estimate_resources(*lazy);
+
+    eager = parser::parse_string(src, "eager.qasm");
+    transformations::desugar(*eager);
+    transformations::merge_barriers(*eager);
+
+    EXPECT_EQ(lazy_count, tools::estimate_resources(*eager));
+    EXPECT_EQ(lazy_count["barrier"], 1);
+}
+/******************************************************************************/
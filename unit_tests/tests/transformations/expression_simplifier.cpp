@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 #include "qasmtools/parser/parser.hpp"
 #include "transformations/expression_simplifier.hpp"
+#include "transformations/inline.hpp"
 
 using namespace staq;
 using namespace qasmtools;
@@ -52,6 +53,48 @@ TEST(ExprSimplify, Rationals) {
 }
 /******************************************************************************/
 
+// Testing rationals which do not fit in 32 bits
+/******************************************************************************/
+TEST(ExprSimplify, Large_Rationals) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[1];\n"
+                      "U(pi/3+pi/5+pi/7+pi/11+pi/13+pi/17+pi/19+pi/23+pi/29"
+                      "-pi/29-pi/23-pi/19-pi/17-pi/13-pi/11-pi/7-pi/5,"
+                      "pi/65536/65536*1073741824,"
+                      "pi/65536/65536) q[0];\n"
+                      "U(pi/3+pi/5+pi/7+pi/11+pi/13+pi/17+pi/19+pi/23+pi/29"
+                      "+pi/31+pi/37+pi/41+pi/43+pi/47+pi/53,0,0) q[0];\n";
+
+    auto program = parser::parse_string(pre, "large_rationals.qasm");
+    transformations::expr_simplify(*program);
+    std::vector<ast::UGate*> gates;
+    program->foreach_stmt([&gates](auto& stmt) {
+        if (auto gate = dynamic_cast<ast::UGate*>(&stmt))
+            gates.push_back(gate);
+    });
+    ASSERT_EQ(gates.size(), 2);
+
+    // exact in 64 bits
+    std::stringstream ss;
+    ss << gates[0]->theta() << "," << gates[0]->phi();
+    EXPECT_EQ(ss.str(), "pi/3,pi/4");
+
+    // exact, but the denominator does not fit an integer literal
+    auto lambda = gates[0]->lambda().constant_eval();
+    ASSERT_TRUE(lambda);
+    EXPECT_DOUBLE_EQ(*lambda, utils::pi / 4294967296.0);
+
+    // overflows 64 bits, evaluated in floating point
+    double sum = 0;
+    for (int p : {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53})
+        sum += utils::pi / p;
+    auto theta = gates[1]->theta().constant_eval();
+    ASSERT_TRUE(theta);
+    EXPECT_NEAR(*theta, sum, 1e-12);
+}
+/******************************************************************************/
+
 // Testing variable expressions
 /******************************************************************************/
 TEST(ExprSimplify, Variables) {
@@ -122,3 +165,39 @@ TEST(ExprSimplify, Mixed) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+// Testing simplifying shared expressions
+/******************************************************************************/
+TEST(ExprSimplify, Shared) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "gate foo(x,y) p {\n"
+                      "\tU(x/2+x/2,(y+1)-1,-(-x)) p;\n"
+                      "}\n"
+                      "qreg q[2];\n"
+                      "foo(pi/4,2*pi) q[0];\n"
+                      "foo(pi/4,1.5) q[1];\n"
+                      "foo(pi/4,2*pi) q[1];\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "\n"
+                       "qreg q[2];\n"
+                       "U(pi/4,2*pi,pi/4) q[0];\n"
+                       "U(pi/4,1.5,pi/4) q[1];\n"
+                       "U(pi/4,2*pi,pi/4) q[1];\n";
+
+    for (bool share_expressions : {false, true}) {
+        transformations::Inliner::config params;
+        params.keep_declarations = false;
+        params.share_expressions = share_expressions;
+
+        auto program = parser::parse_string(pre, "shared.qasm");
+        transformations::inline_ast(*program, params);
+        transformations::expr_simplify(*program);
+        std::stringstream ss;
+        ss << *program;
+
+        EXPECT_EQ(ss.str(), post);
+    }
+}
+/******************************************************************************/
@@ -228,3 +228,106 @@ TEST(Inline, Mixed_Ancilla) {
     EXPECT_EQ(ss.str(), post);
 }
 /******************************************************************************/
+
+/******************************************************************************/
+TEST(Inline, Flat_Size_Cap) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "gate foo(x) p,q {\n"
+                      "\tancilla a[2];\n"
+                      "\tdirty ancilla b[1];\n"
+                      "\tU(x,x/2,0) p;\n"
+                      "\tCX p,a[0];\n"
+                      "\tCX a[0],b[0];\n"
+                      "\tbarrier p,q,a;\n"
+                      "\tCX a[1],q;\n"
+                      "}\n"
+                      "gate bar(y) p,q,r {\n"
+                      "\tdirty ancilla c[2];\n"
+                      "\tfoo(2*y) p,q;\n"
+                      "\tfoo(-y) q,c[1];\n"
+                      "\tCX r,c[0];\n"
+                      "\tU(y,0,0) r;\n"
+                      "}\n"
+                      "gate baz p,q,r {\n"
+                      "\tancilla z[1];\n"
+                      "\tbar(pi) p,q,r;\n"
+                      "\tbar(pi/4) r,z[0],q;\n"
+                      "}\n"
+                      "qreg q[3];\n"
+                      "qreg w[2];\n"
+                      "baz q[0],q[1],q[2];\n"
+                      "bar(1) w[0],q[2],w[1];\n";
+
+    auto inlined = [&pre](std::size_t max_flat_size) {
+        transformations::Inliner::config params;
+        params.keep_declarations = false;
+        params.max_flat_size = max_flat_size;
+
+        auto program = parser::parse_string(pre, "flat_size_cap.qasm");
+        transformations::inline_ast(*program, params);
+        std::stringstream ss;
+        ss << *program;
+        return ss.str();
+    };
+
+    // Calls above the cap are expanded on the fly, with the same result
+    auto expected = inlined(transformations::Inliner::config{}.max_flat_size);
+    for (std::size_t cap : {0, 1, 5, 6, 12}) {
+        EXPECT_EQ(inlined(cap), expected);
+    }
+}
+/******************************************************************************/
+
+// Testing inlining with shared parameters
+/******************************************************************************/
+TEST(Inline, Shared_Expressions) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "gate foo(x) p {\n"
+                      "\tU(x,x/2,pi/4) p;\n"
+                      "}\n"
+                      "gate bar(y) p,q {\n"
+                      "\tfoo(2*y) p;\n"
+                      "\tfoo(y) q;\n"
+                      "\tU(0,0,pi/4) q;\n"
+                      "}\n"
+                      "qreg q[2];\n"
+                      "bar(pi/4) q[0],q[1];\n"
+                      "bar(pi/4) q[1],q[0];\n";
+
+    auto inlined = [&pre](bool share_expressions) {
+        transformations::Inliner::config params;
+        params.keep_declarations = false;
+        params.share_expressions = share_expressions;
+
+        auto program = parser::parse_string(pre, "shared_expressions.qasm");
+        transformations::inline_ast(*program, params);
+        return program;
+    };
+
+    auto program = inlined(true);
+    std::stringstream expected, ss;
+    expected << *inlined(false);
+    ss << *program;
+    EXPECT_EQ(ss.str(), expected.str());
+
+    // The parameters of both calls to bar are stored once
+    std::vector<ast::UGate*> gates;
+    program->foreach_stmt([&gates](ast::Stmt& stmt) {
+        if (auto u = dynamic_cast<ast::UGate*>(&stmt))
+            gates.push_back(u);
+    });
+    ASSERT_EQ(gates.size(), 6);
+    auto target = [](ast::Expr& expr) {
+        auto shared = dynamic_cast<ast::SharedExpr*>(&expr);
+        EXPECT_NE(shared, nullptr);
+        return shared ? &shared->target() : nullptr;
+    };
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(target(gates[i]->theta()), target(gates[i + 3]->theta()));
+        EXPECT_EQ(target(gates[i]->phi()), target(gates[i + 3]->phi()));
+    }
+    EXPECT_EQ(target(gates[0]->lambda()), target(gates[2]->lambda()));
+}
+/******************************************************************************/
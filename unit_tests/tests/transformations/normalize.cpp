@@ -0,0 +1,75 @@
+#include "gtest/gtest.h"
+#include "qasmtools/parser/parser.hpp"
+#include "transformations/normalize.hpp"
+
+using namespace staq;
+using namespace qasmtools;
+
+// Testing the fused pass on registers, expressions and barriers
+/******************************************************************************/
+TEST(Normalize, Basic) {
+    std::string pre = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "creg c[2];\n"
+                      "U(pi/2+pi/2,0*pi,1*pi) q;\n"
+                      "barrier q[0];\n"
+                      "barrier q;\n"
+                      "measure q -> c;\n";
+
+    std::string post = "OPENQASM 2.0;\n"
+                       "\n"
+                       "qreg q[2];\n"
+                       "creg c[2];\n"
+                       "U(pi,0,pi) q[0];\n"
+                       "U(pi,0,pi) q[1];\n"
+                       "barrier q[0],q[1];\n"
+                       "measure q[0] -> c[0];\n"
+                       "measure q[1] -> c[1];\n";
+
+    auto program = parser::parse_string(pre, "basic.qasm");
+    transformations::normalize(*program);
+    std::stringstream ss;
+    ss << *program;
+
+    EXPECT_EQ(ss.str(), post);
+}
+/******************************************************************************/
+
+// Testing the fused pass against the passes applied in turn
+/******************************************************************************/
+TEST(Normalize, Same_As_Sequential) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "creg c[2];\n"
+                      "barrier q[1];\n"
+                      "gate g(x) a,b {\n"
+                      "\tbarrier a;\n"
+                      "\tU(x*1,0+0,2*pi/4) a;\n"
+                      "\tbarrier b;\n"
+                      "\tbarrier a,b;\n"
+                      "}\n"
+                      "barrier q;\n"
+                      "qreg r[2];\n"
+                      "g(pi+pi) q,r;\n"
+                      "if(c==1) CX q,r;\n"
+                      "barrier r;\n"
+                      "reset q;\n"
+                      "barrier q[0],r[1];\n";
+
+    auto fused = parser::parse_string(src, "fused.qasm");
+    transformations::normalize(*fused);
+    std::stringstream fused_ss;
+    fused_ss << *fused;
+
+    auto seq = parser::parse_string(src, "sequential.qasm");
+    transformations::expr_simplify(*seq);
+    transformations::desugar(*seq);
+    transformations::merge_barriers(*seq);
+    std::stringstream seq_ss;
+    seq_ss << *seq;
+
+    EXPECT_EQ(fused_ss.str(), seq_ss.str());
+}
+/******************************************************************************/
@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "qasmtools/utils/angle.hpp"
+
+#include <utility>
+
+using namespace qasmtools;
+using utils::Angle;
+
+// Testing symbolic and numeric rotation angles
+/******************************************************************************/
+TEST(Angle, Normal_Form) {
+    EXPECT_EQ(Angle(2, 4).symbolic_value(), std::make_pair(1, 2));
+    EXPECT_EQ(Angle(5, 2).symbolic_value(), std::make_pair(1, 2));
+    EXPECT_EQ(Angle(-1, 4).symbolic_value(), std::make_pair(7, 4));
+    EXPECT_EQ(Angle(1, -4).symbolic_value(), std::make_pair(7, 4));
+    EXPECT_EQ(Angle(2, 1).symbolic_value(), std::make_pair(0, 1));
+    EXPECT_EQ(Angle(-2, 1).symbolic_value(), std::make_pair(0, 1));
+    EXPECT_EQ(Angle(-6, 3).symbolic_value(), std::make_pair(0, 1));
+    EXPECT_EQ(Angle(0, 5).symbolic_value(), std::make_pair(0, 1));
+    EXPECT_THROW(Angle(1, 0), std::invalid_argument);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Angle, Dyadic_Arithmetic) {
+    EXPECT_EQ(Angle(1, 4) + Angle(1, 2), Angle(3, 4));
+    EXPECT_EQ(Angle(1, 4) - Angle(1, 2), Angle(7, 4));
+    EXPECT_EQ(Angle(1, 2) - Angle(1, 2), utils::angles::zero);
+    EXPECT_EQ(-utils::angles::zero, utils::angles::zero);
+    EXPECT_EQ(-Angle(1, 4), Angle(7, 4));
+
+    // Wraparound at 2pi
+    EXPECT_EQ(Angle(3, 2) + Angle(1, 2), utils::angles::zero);
+    EXPECT_EQ(Angle(7, 4) + Angle(1, 4), utils::angles::zero);
+    EXPECT_EQ(utils::angles::pi + utils::angles::pi, utils::angles::zero);
+    EXPECT_EQ(Angle(7, 4) + Angle(3, 4), Angle(1, 2));
+    EXPECT_EQ(Angle(1, 8) - Angle(3, 8), Angle(7, 4));
+
+    // Factors of two are stripped from the result
+    EXPECT_EQ((Angle(1, 8) + Angle(1, 8)).symbolic_value(),
+              std::make_pair(1, 4));
+    EXPECT_EQ((Angle(1, 8) + Angle(3, 8)).symbolic_value(),
+              std::make_pair(1, 2));
+    EXPECT_EQ((Angle(1, 16) + Angle(15, 16)).symbolic_value(),
+              std::make_pair(1, 1));
+    EXPECT_EQ((Angle(1, 16) + Angle(31, 16)).symbolic_value(),
+              std::make_pair(0, 1));
+    EXPECT_EQ((Angle(3, 4) + Angle(3, 4)).symbolic_value(),
+              std::make_pair(3, 2));
+    EXPECT_EQ((Angle(1, 1024) + Angle(1, 2)).symbolic_value(),
+              std::make_pair(513, 1024));
+
+    // Sums of many multiples of pi/4 are exact
+    Angle sum = utils::angles::zero;
+    for (int k = 0; k < 1000; k++)
+        sum += utils::angles::pi_quarter;
+    EXPECT_EQ(sum, utils::angles::zero);
+    EXPECT_TRUE(sum.is_symbolic());
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Angle, Non_Dyadic_Arithmetic) {
+    EXPECT_EQ(Angle(1, 3) + Angle(1, 6), Angle(1, 2));
+    EXPECT_EQ(Angle(1, 2) + Angle(1, 3), Angle(5, 6));
+    EXPECT_EQ((Angle(5, 3) + Angle(1, 3)).symbolic_value(),
+              std::make_pair(0, 1));
+    EXPECT_EQ(Angle(1, 3) - Angle(2, 3), Angle(5, 3));
+    EXPECT_EQ(Angle(1, 3) * 6, utils::angles::zero);
+    EXPECT_EQ(Angle(1, 3) / 2, Angle(1, 6));
+    EXPECT_NE(Angle(1, 3), Angle(1, 6));
+    EXPECT_TRUE((Angle(1, 3) + Angle(1, 5)).is_symbolic());
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Angle, Mixed_Arithmetic) {
+    auto sum = Angle(1, 4) + Angle(0.5);
+    EXPECT_TRUE(sum.is_numeric());
+    EXPECT_DOUBLE_EQ(sum.numeric_value(), utils::pi / 4 + 0.5);
+
+    // The symbolic side is negated modulo 2pi first
+    auto diff = Angle(0.5) - Angle(1, 2);
+    EXPECT_TRUE(diff.is_numeric());
+    EXPECT_DOUBLE_EQ(diff.numeric_value(), 0.5 + 3 * utils::pi / 2);
+
+    // Symbolic and numeric angles compare by value
+    EXPECT_EQ(Angle(1, 4), Angle(utils::pi / 4));
+    EXPECT_EQ(Angle(utils::pi), utils::angles::pi);
+    EXPECT_NE(Angle(1, 4), Angle(0.25));
+    EXPECT_EQ(Angle(0.25) + Angle(0.5), Angle(0.75));
+    EXPECT_TRUE((Angle(0.25) + Angle(0.5)).is_numeric());
+}
+/******************************************************************************/
@@ -0,0 +1,137 @@
+#include "gtest/gtest.h"
+#include "qasmtools/ast/expr.hpp"
+#include "qasmtools/ast/stmt.hpp"
+#include "qasmtools/parser/parser.hpp"
+#include "qasmtools/utils/emitter.hpp"
+
+#include <ios>
+#include <sstream>
+
+using namespace qasmtools;
+
+// Testing buffered output against std::ostream
+/******************************************************************************/
+TEST(Emitter, Program) {
+    std::string src = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[2];\n"
+                      "U(0.5+0.25,-2.5,pi/3) q[0];\n"
+                      "U(1.5/3,123456789,-pi) q[1];\n";
+
+    auto program = parser::parse_string(src, "emitter.qasm");
+
+    std::stringstream ss;
+    {
+        utils::Emitter emitter(ss);
+        emitter << *program;
+        EXPECT_EQ(ss.str(), "");
+    }
+    EXPECT_EQ(ss.str(), src);
+
+    ss.str("");
+    program->pretty_print(ss);
+    EXPECT_EQ(ss.str(), src);
+}
+/******************************************************************************/
+
+/******************************************************************************/
+TEST(Emitter, Numbers) {
+    std::stringstream expected;
+    utils::Emitter emitter;
+    for (double x : {0.0, -0.5, 1.0 / 3, 1e-7, 2.5e20, 123456789.0}) {
+        emitter << x << ' ' << -42 << ' ';
+        expected << x << ' ' << -42 << ' ';
+    }
+    EXPECT_EQ(emitter.str(), expected.str());
+
+    emitter.clear();
+    expected.str("");
+    emitter.precision(15);
+    expected.precision(15);
+    emitter << 1.0 / 3 << std::string("pi");
+    expected << 1.0 / 3 << std::string("pi");
+    EXPECT_EQ(emitter.str(), expected.str());
+}
+/******************************************************************************/
+
+// Testing that the stream's formatting of doubles is kept
+/******************************************************************************/
+TEST(Emitter, Stream_Flags) {
+    const std::ios_base::fmtflags flag_sets[] = {
+        std::ios_base::fixed,
+        std::ios_base::scientific,
+        std::ios_base::fixed | std::ios_base::scientific,
+        std::ios_base::showpoint,
+        std::ios_base::showpos,
+        std::ios_base::scientific | std::ios_base::uppercase,
+    };
+
+    for (auto flags : flag_sets) {
+        for (int precision : {0, 3, 6, 17}) {
+            std::stringstream ss, expected;
+            ss.flags(flags);
+            ss.precision(precision);
+            expected.flags(flags);
+            expected.precision(precision);
+
+            utils::Emitter emitter(ss);
+            for (double x : {0.0, -0.5, 1.0 / 3, 1e-7, 2.5e20, 1e300}) {
+                emitter << x << ' ';
+                expected << x << ' ';
+            }
+            emitter.flush();
+            EXPECT_EQ(ss.str(), expected.str());
+        }
+    }
+
+    // Real literals are printed with a precision of 15
+    auto real = ast::RealExpr::create({}, 0.5);
+    std::stringstream ss;
+    ss << std::fixed << *real << ' ' << std::scientific << *real << ' ';
+    real->pretty_print(ss, false);
+    EXPECT_EQ(ss.str(), "0.500000000000000 5.000000000000000e-01 "
+                        "5.000000000000000e-01");
+
+    std::string src = "OPENQASM 2.0;\n"
+                      "\n"
+                      "qreg q[1];\n"
+                      "U(0.5,0.25,pi/2) q[0];\n";
+    auto program = parser::parse_string(src, "flags.qasm");
+    ss.str("");
+    ss << std::fixed << *program;
+    EXPECT_EQ(ss.str(), "OPENQASM 2.0;\n"
+                        "\n"
+                        "qreg q[1];\n"
+                        "U(0.500000000000000,0.250000000000000,pi/2) q[0];\n");
+}
+/******************************************************************************/
+
+// Testing that stream printing overridden by a node is used
+/******************************************************************************/
+class Legacy_Stmt final : public ast::Stmt {
+  public:
+    Legacy_Stmt() : Stmt(parser::Position()) {}
+    void accept(ast::Visitor&) override {}
+    utils::Emitter& pretty_print(utils::Emitter& os, bool) const override {
+        return os << "emitter;\n";
+    }
+    std::ostream& pretty_print(std::ostream& os, bool) const override {
+        return os << "stream;\n";
+    }
+
+  protected:
+    Legacy_Stmt* clone() const override { return new Legacy_Stmt(*this); }
+};
+
+TEST(Emitter, Stream_Override) {
+    Legacy_Stmt stmt;
+
+    std::stringstream ss;
+    ss << stmt;
+    EXPECT_EQ(ss.str(), "stream;\n");
+
+    utils::Emitter emitter;
+    emitter << stmt;
+    EXPECT_EQ(emitter.str(), "emitter;\n");
+}
+/******************************************************************************/